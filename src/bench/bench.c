@@ -0,0 +1,131 @@
+// Last Update:2026-10-17 10:40:02
+/**
+ * @file bench.c
+ * @brief micro benchmarks, ./bench [name...]
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+
+typedef struct Bench {
+    const char *name;
+    int (*run)( int argc, char **argv );
+} Bench;
+
+static const Bench benches[] = {
+    { "startcode", bench_startcode },
+    { "rtp_pack",  bench_rtp_pack },
+    { "index",     bench_index },
+    { "file",      bench_file },
+    { "parse_mt",  bench_parse_mt },
+    { "engine",    bench_engine },
+    { "epb",       bench_epb },
+    { "sei",       bench_sei },
+};
+
+#define BENCH_NB (int)(sizeof(benches)/sizeof(benches[0]))
+
+static uint32_t rand_state = 0x12345678;
+
+uint32_t bench_rand( void )
+{
+    // xorshift32
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+double bench_now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t put_nal( uint8_t *p, size_t room, int type, int payload )
+{
+    size_t n = 0;
+    int zeros = 0, i;
+
+    if ( room < 8 )
+        return 0;
+
+    p[n++] = 0; p[n++] = 0; p[n++] = 0; p[n++] = 1;
+    p[n++] = type << 1;
+    p[n++] = 1;
+
+    for ( i = 0; i < payload && n + 2 < room; i++ ) {
+        // compressed data, with the odd zero run
+        uint8_t c = (bench_rand() & 0xff) ? bench_rand() : 0;
+
+        if ( zeros >= 2 && c <= 3 ) {
+            p[n++] = 3;
+            zeros = 0;
+        }
+        p[n++] = c;
+        zeros = c ? 0 : zeros + 1;
+    }
+    if ( zeros )
+        p[n++] = 0x80; // rbsp_stop_one_bit
+
+    return n;
+}
+
+int bench_make_stream( uint8_t *buf, size_t size, int avg_nal, int gop )
+{
+    size_t pos = 0, n;
+    int count = 0;
+
+    for ( ;; ) {
+        int type = 1, payload = avg_nal / 2 + bench_rand() % (avg_nal + 1);
+
+        if ( gop > 0 && count % gop == 0 ) {
+            pos += put_nal( buf + pos, size - pos, 32, 20 );
+            pos += put_nal( buf + pos, size - pos, 33, 40 );
+            pos += put_nal( buf + pos, size - pos, 34, 8 );
+            count += 3;
+            type = 19;
+        }
+
+        n = put_nal( buf + pos, size - pos, type, payload );
+        if ( !n || pos + n >= size )
+            break;
+        pos += n;
+        count++;
+    }
+    memset( buf + pos, 0, size - pos );
+
+    return count;
+}
+
+int main( int argc, char **argv )
+{
+    int i, ran = 0;
+
+    for ( i = 0; i < BENCH_NB; i++ ) {
+        if ( argc > 1 && strcmp( argv[1], benches[i].name ) )
+            continue;
+        printf( "[ BENCH ] %s\n", benches[i].name );
+        if ( benches[i].run( argc > 1 ? argc - 1 : 0, argv + 1 ) < 0 ) {
+            printf( "[ FAIL ] %s\n", benches[i].name );
+            return 1;
+        }
+        ran++;
+    }
+
+    if ( !ran ) {
+        printf( "usage: %s [", argv[0] );
+        for ( i = 0; i < BENCH_NB; i++ )
+            printf( "%s%s", i ? "|" : "", benches[i].name );
+        printf( "]\n" );
+        return 1;
+    }
+    return 0;
+}
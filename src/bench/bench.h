@@ -0,0 +1,34 @@
+// Last Update:2026-10-17 10:40:02
+/**
+ * @file bench.h
+ * @brief micro benchmarks, one bench_xxx() per feature
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BENCH_MIN_SECONDS 0.5
+
+extern double bench_now( void );
+/* fill buf with an Annex-B stream of random payload (emulation prevention
+ * applied) and returns the number of NAL units written. NAL sizes average
+ * avg_nal bytes, every gop-th one is an IDR preceded by VPS/SPS/PPS */
+extern int bench_make_stream( uint8_t *buf, size_t size, int avg_nal, int gop );
+extern uint32_t bench_rand( void );
+
+extern int bench_startcode( int argc, char **argv );
+extern int bench_rtp_pack( int argc, char **argv );
+extern int bench_index( int argc, char **argv );
+extern int bench_file( int argc, char **argv );
+extern int bench_parse_mt( int argc, char **argv );
+extern int bench_engine( int argc, char **argv );
+extern int bench_epb( int argc, char **argv );
+extern int bench_sei( int argc, char **argv );
+
+#endif  /*BENCH_H*/
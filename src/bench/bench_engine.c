@@ -0,0 +1,92 @@
+// Last Update:2026-10-17 20:48:10
+/**
+ * @file bench_engine.c
+ * @brief multi-stream ingest, aggregate NAL/s per pool size, ./bench engine [streams] [MB]
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+#include "hevc.h"
+#include "hevc_engine.h"
+
+#define FEED_SIZE (64*1024)     // what a socket read hands over
+
+/* a stream only runs on one worker at a time, no atomics needed */
+static void on_nalu( const NalUnit *nalu, void *opaque )
+{
+    (void)nalu;
+    ++*(long *)opaque;
+}
+
+static int run( int threads, int streams, const uint8_t *buf, size_t size, long *nalus )
+{
+    HevcEngine *e = hevc_engine_new( threads );
+    HevcStream **s = calloc( streams, sizeof(HevcStream *) );
+    size_t offset;
+    int i, ret = -1;
+
+    if ( !e || !s )
+        goto out;
+    for ( i = 0; i < streams; i++ ) {
+        nalus[i] = 0;
+        if ( !(s[i] = hevc_engine_add_stream( e, on_nalu, NULL, &nalus[i] )) )
+            goto out;
+    }
+    // interleaved like many sockets read by one thread
+    for ( offset = 0; offset < size; offset += FEED_SIZE ) {
+        int n = size - offset < FEED_SIZE ? size - offset : FEED_SIZE;
+
+        for ( i = 0; i < streams; i++ )
+            if ( hevc_engine_feed( s[i], buf + offset, n ) < 0 )
+                goto out;
+    }
+    for ( i = 0; i < streams; i++ )
+        hevc_engine_flush( s[i] );
+    hevc_engine_wait( e );
+    ret = 0;
+
+out:
+    hevc_engine_free( e );
+    free( s );
+    return ret;
+}
+
+int bench_engine( int argc, char **argv )
+{
+    int streams = argc > 1 ? atoi( argv[1] ) : 64;
+    size_t size = (size_t)(argc > 2 ? atoi( argv[2] ) : 16) << 20;
+    uint8_t *buf = malloc( size );
+    long cpus = sysconf( _SC_NPROCESSORS_ONLN ), *nalus = NULL;
+    int threads, count, i, ret = -1;
+
+    if ( streams <= 0 || !buf || !(nalus = calloc( streams, sizeof(long) )) )
+        goto out;
+    count = bench_make_stream( buf, size, 1400, 30 );
+    printf( "%d streams of %zu MB, %d NAL units each\n", streams, size >> 20, count );
+
+    for ( threads = 1; threads <= 2 * cpus; threads *= 2 ) {
+        double start = bench_now(), elapsed;
+
+        if ( run( threads, streams, buf, size, nalus ) < 0 )
+            goto out;
+        elapsed = bench_now() - start;
+        for ( i = 0; i < streams; i++ )
+            if ( nalus[i] != count ) {
+                printf( "stream %d: %ld NAL units, expected %d\n", i, nalus[i], count );
+                goto out;
+            }
+        printf( "%3d threads %8.2f M NAL/s %8.2f GB/s\n", threads,
+                (double)count * streams / elapsed / 1e6, (double)size * streams / elapsed / 1e9 );
+    }
+    ret = 0;
+
+out:
+    free( nalus );
+    free( buf );
+    return ret;
+}
@@ -0,0 +1,164 @@
+// Last Update:2026-10-17 21:31:40
+/**
+ * @file bench_epb.c
+ * @brief emulation prevention removal and insertion per instruction set,
+ *        on the slices of ./bench epb [file.265] or of a generated stream
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "hevc.h"
+#include "hevc_file.h"
+#include "epb.h"
+
+#define STREAM_SIZE (64*1024*1024)
+
+typedef struct Slices {
+    const uint8_t **nal;    // input of the pass
+    int *size;
+    int count;
+    long bytes;
+} Slices;
+
+/* run f over all slices into out until BENCH_MIN_SECONDS, returns GB/s of input */
+static double run( EpbFunc f, const Slices *in, uint8_t *out, int *out_size, long *total )
+{
+    double start = bench_now(), elapsed;
+    long bytes = 0;
+    int i;
+
+    do {
+        uint8_t *d = out;
+
+        for ( i = 0; i < in->count; i++ ) {
+            out_size[i] = f( in->nal[i], in->size[i], d );
+            d += EPB_INSERT_SIZE( in->size[i] );
+        }
+        bytes += in->bytes;
+        elapsed = bench_now() - start;
+    } while ( elapsed < BENCH_MIN_SECONDS );
+
+    *total = 0;
+    for ( i = 0; i < in->count; i++ )
+        *total += out_size[i];
+    return bytes / elapsed / 1e9;
+}
+
+/* one direction for every variant, checked against the C one */
+static int bench_pass( const char *name, EpbFunc (*get)( EpbImpl ), const Slices *in,
+                       uint8_t *ref, uint8_t *out, int *ref_size, int *out_size )
+{
+    long total;
+    int impl, i;
+
+    for ( impl = EPB_IMPL_C; impl < EPB_IMPL_NB; impl++ ) {
+        EpbFunc f = get( impl );
+        double rate;
+
+        if ( !f ) {
+            printf( "%-6s %-6s unsupported\n", name, epb_impl_name( impl ) );
+            continue;
+        }
+        rate = run( f, in, impl == EPB_IMPL_C ? ref : out, impl == EPB_IMPL_C ? ref_size : out_size, &total );
+        if ( impl != EPB_IMPL_C ) {
+            const uint8_t *a = ref, *b = out;
+
+            for ( i = 0; i < in->count; i++ ) {
+                if ( out_size[i] != ref_size[i] || memcmp( a, b, ref_size[i] ) ) {
+                    printf( "%-6s %-6s slice %d differs from the c output\n", name, epb_impl_name( impl ), i );
+                    return -1;
+                }
+                a += EPB_INSERT_SIZE( in->size[i] );
+                b += EPB_INSERT_SIZE( in->size[i] );
+            }
+        }
+        printf( "%-6s %-6s %8.2f GB/s (%ld -> %ld bytes)\n", name, epb_impl_name( impl ),
+                rate, in->bytes, total );
+    }
+    return 0;
+}
+
+int bench_epb( int argc, char **argv )
+{
+    HevcFileSource *src = NULL;
+    uint8_t *stream = NULL, *rbsp = NULL, *nal = NULL, *out = NULL;
+    const uint8_t *data;
+    int *rbsp_size = NULL, *nal_size = NULL, *out_size = NULL;
+    Slices slices = { 0 }, rbsps = { 0 };
+    NalUnitList list;
+    size_t size, room = 0;
+    int i, ret = -1;
+
+    hevc_nalu_list_init( &list );
+    if ( argc > 1 ) {
+        if ( !(src = hevc_file_open( argv[1], 0 )) || hevc_file_size( src ) > 0x7fffffff ) {
+            printf( "can't read %s\n", argv[1] );
+            goto out;
+        }
+        data = hevc_file_data( src );
+        size = hevc_file_size( src );
+    } else {
+        if ( !(stream = malloc( STREAM_SIZE )) )
+            goto out;
+        bench_make_stream( stream, STREAM_SIZE, 1400, 30 );
+        data = stream;
+        size = STREAM_SIZE;
+    }
+    if ( hevc_nalu_list_parse( &list, data, size ) <= 0 )
+        goto out;
+
+    slices.nal = malloc( list.count * sizeof(uint8_t *) );
+    slices.size = malloc( list.count * sizeof(int) );
+    rbsps.nal = malloc( list.count * sizeof(uint8_t *) );
+    rbsps.size = rbsp_size = malloc( list.count * sizeof(int) );
+    nal_size = malloc( list.count * sizeof(int) );
+    out_size = malloc( list.count * sizeof(int) );
+    if ( !slices.nal || !slices.size || !rbsps.nal || !rbsp_size || !nal_size || !out_size )
+        goto out;
+    for ( i = 0; i < list.count; i++ )
+        if ( list.nalu[i].nalu_type < 32 ) {
+            slices.nal[slices.count] = list.nalu[i].addr;
+            slices.size[slices.count++] = list.nalu[i].size;
+            slices.bytes += list.nalu[i].size;
+            room += EPB_INSERT_SIZE( list.nalu[i].size );
+        }
+    if ( !(rbsp = malloc( room )) || !(nal = malloc( room )) || !(out = malloc( room )) )
+        goto out;
+    printf( "%d slices, %ld bytes\n", slices.count, slices.bytes );
+
+    if ( bench_pass( "remove", epb_get_remove, &slices, rbsp, out, rbsp_size, out_size ) < 0 )
+        goto out;
+
+    // the c output of the removal is the input of the insertion
+    rbsps.count = slices.count;
+    rbsps.bytes = 0;
+    for ( i = 0, data = rbsp; i < slices.count; i++ ) {
+        rbsps.nal[i] = data;
+        rbsps.bytes += rbsp_size[i];
+        data += EPB_INSERT_SIZE( slices.size[i] );
+    }
+    // the insertion output of a slice is spaced by its rbsp size
+    if ( bench_pass( "insert", epb_get_insert, &rbsps, nal, out, nal_size, out_size ) < 0 )
+        goto out;
+    ret = 0;
+
+out:
+    free( slices.nal );
+    free( slices.size );
+    free( rbsps.nal );
+    free( rbsp_size );
+    free( nal_size );
+    free( out_size );
+    free( rbsp );
+    free( nal );
+    free( out );
+    free( stream );
+    hevc_file_close( src );
+    hevc_nalu_list_free( &list );
+    return ret;
+}
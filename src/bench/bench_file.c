@@ -0,0 +1,161 @@
+// Last Update:2026-10-17 18:40:26
+/**
+ * @file bench_file.c
+ * @brief mmap file source against read() + splitter, ./bench file [MB]
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bench.h"
+#include "hevc.h"
+#include "hevc_file.h"
+
+#define CHUNK_SIZE (64*1024*1024)
+#define READ_SIZE  (1024*1024)
+
+/* resident set in MB */
+static long rss_mb( void )
+{
+    FILE *f = fopen( "/proc/self/statm", "r" );
+    long size = 0, resident = 0;
+
+    if ( f ) {
+        if ( fscanf( f, "%ld %ld", &size, &resident ) != 2 )
+            resident = 0;
+        fclose( f );
+    }
+    return resident * sysconf( _SC_PAGESIZE ) >> 20;
+}
+
+static long peak_rss;
+
+/* every 64k NAL units, sample the resident set */
+static void count_nalu( long *count )
+{
+    long rss;
+
+    if ( !(++*count & 0xffff) && (rss = rss_mb()) > peak_rss )
+        peak_rss = rss;
+}
+
+static void on_nalu( const NalUnit *nalu, void *opaque )
+{
+    (void)nalu;
+    count_nalu( opaque );
+}
+
+static int scan_read( const char *path, uint8_t *buf, long *count )
+{
+    HevcNalSplitter *s = hevc_splitter_new( on_nalu, count );
+    int fd = open( path, O_RDONLY ), ret = -1;
+    ssize_t n;
+
+    if ( fd < 0 || !s )
+        goto out;
+    while ( (n = read( fd, buf, READ_SIZE )) > 0 )
+        if ( hevc_splitter_feed( s, buf, n ) < 0 )
+            goto out;
+    if ( n == 0 && hevc_splitter_flush( s ) >= 0 )
+        ret = 0;
+
+out:
+    hevc_splitter_free( s );
+    if ( fd >= 0 )
+        close( fd );
+    return ret;
+}
+
+static int scan_mmap( const char *path, long *count )
+{
+    HevcFileSource *src = hevc_file_open( path, 0 );
+    NalUnit nalu;
+
+    if ( !src )
+        return -1;
+    while ( hevc_file_next_nalu( src, &nalu, NULL ) )
+        count_nalu( count );
+    hevc_file_close( src );
+    return 0;
+}
+
+static int scan_spans( const char *path, long *count )
+{
+    HevcFileSource *src = hevc_file_open( path, 0 );
+    NalUnitList list;
+    int n;
+
+    if ( !src )
+        return -1;
+    hevc_nalu_list_init( &list );
+    while ( (n = hevc_file_parse( src, &list, HEVC_FILE_WINDOW )) > 0 ) {
+        long rss = rss_mb();
+
+        *count += n;
+        if ( rss > peak_rss )
+            peak_rss = rss;
+    }
+    hevc_nalu_list_free( &list );
+    hevc_file_close( src );
+    return n;
+}
+
+int bench_file( int argc, char **argv )
+{
+    char path[] = "/tmp/bench_file_XXXXXX";
+    int mb = argc > 1 ? atoi( argv[1] ) : 1024;
+    uint8_t *buf = malloc( CHUNK_SIZE );
+    const char *names[] = { "read()", "mmap", "mmap spans" };
+    long expect = -1;
+    FILE *f = NULL;
+    int fd, i, ret = -1;
+    double bytes;
+
+    fd = mkstemp( path );
+    if ( !buf || fd < 0 || !(f = fdopen( fd, "wb" )) )
+        goto out;
+    fd = -1;
+    bench_make_stream( buf, CHUNK_SIZE, 1400, 30 );
+    for ( i = 0; i < mb / 64 || i < 1; i++ )
+        if ( fwrite( buf, 1, CHUNK_SIZE, f ) != CHUNK_SIZE )
+            goto out;
+    fclose( f );
+    f = NULL;
+    bytes = (double)i * CHUNK_SIZE;
+
+    // page cache warm for all three, this measures the copy and the scan
+    printf( "%d MB file, rss %ld MB before\n", i * (CHUNK_SIZE >> 20), rss_mb() );
+    for ( i = 0; i < 3; i++ ) {
+        long count = 0;
+        double start, elapsed;
+        int r;
+
+        peak_rss = rss_mb();
+        start = bench_now();
+        r = i == 0 ? scan_read( path, buf, &count ) :
+                i == 1 ? scan_mmap( path, &count ) : scan_spans( path, &count );
+
+        elapsed = bench_now() - start;
+        if ( r < 0 || (expect >= 0 && count != expect) ) {
+            printf( "%-10s found %ld NAL units, expected %ld\n", names[i], count, expect );
+            goto out;
+        }
+        expect = count;
+        printf( "%-10s %8.2f GB/s %10ld NAL units, peak rss %ld MB\n", names[i],
+                bytes / elapsed / 1e9, count, peak_rss );
+    }
+    ret = 0;
+
+out:
+    if ( f )
+        fclose( f );
+    else if ( fd >= 0 )
+        close( fd );
+    unlink( path );
+    free( buf );
+    return ret;
+}
@@ -0,0 +1,131 @@
+// Last Update:2026-10-17 18:02:11
+/**
+ * @file bench_index.c
+ * @brief seek index build, incremental update and lookup, ./bench index [MB]
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "hevc_index.h"
+
+#define CHUNK_SIZE  (64*1024*1024)
+#define GOP         60
+#define SLICE_SIZE  20000   // ~10 Mbps at 60 fps
+#define LOOKUPS     (1 << 22)
+
+/* the parameter sets of the test fixture, 1080p with 8 bit POC LSBs */
+static const uint8_t param_sets[] = {
+    0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0c, 0x03, 0xff, 0xff, 0x01, 0x60,
+    0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00,
+    0x5d, 0x00, 0x00, 0x91, 0x48, 0xa0, 0x48,
+    0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x03, 0x01, 0x60, 0x00, 0x00, 0x03,
+    0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5d, 0x00, 0x00,
+    0xa0, 0x03, 0xc0, 0x80, 0x11, 0x07, 0xcb, 0x96, 0xf2, 0x2c, 0x92, 0x24,
+    0xcd, 0x73, 0xfb, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0x82, 0x00, 0x00, 0x07,
+    0xd2, 0x00, 0x01, 0xd4, 0xc0, 0x59, 0x5a, 0x08, 0x04, 0x10,
+    0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0xc0, 0x73, 0xc1, 0x89,
+};
+/* IDR and TRAIL_R slice headers from the fixture */
+static const uint8_t idr_header[] = { 0x00, 0x00, 0x00, 0x01, 0x26, 0x01, 0xaf, 0x80 };
+static const uint8_t trail_header[] = { 0x00, 0x00, 0x00, 0x01, 0x02, 0x01, 0xd0, 0x0d, 0xc0 };
+
+static size_t put( uint8_t *p, const uint8_t *data, size_t size )
+{
+    memcpy( p, data, size );
+    return size;
+}
+
+/* append size bytes of GOP structured stream, pictures are numbered on */
+static int append_stream( FILE *f, uint8_t *buf, size_t size, long *pictures )
+{
+    size_t pos = 0;
+
+    while ( pos + sizeof(param_sets) + sizeof(trail_header) + SLICE_SIZE <= size ) {
+        int i;
+
+        if ( *pictures % GOP == 0 ) {
+            pos += put( buf + pos, param_sets, sizeof(param_sets) );
+            pos += put( buf + pos, idr_header, sizeof(idr_header) );
+        } else {
+            pos += put( buf + pos, trail_header, sizeof(trail_header) );
+        }
+        // slice data without zero bytes, nothing to escape
+        for ( i = 0; i < SLICE_SIZE; i++ )
+            buf[pos++] = bench_rand() | 1;
+        (*pictures)++;
+    }
+    return fwrite( buf, 1, pos, f ) == pos ? 0 : -1;
+}
+
+int bench_index( int argc, char **argv )
+{
+    char media[] = "/tmp/bench_index_XXXXXX", sidecar[64];
+    int mb = argc > 1 ? atoi( argv[1] ) : 1024;
+    uint8_t *buf = malloc( CHUNK_SIZE );
+    long pictures = 0, i;
+    int64_t count, found = 0;
+    double start, elapsed;
+    HevcIndex *idx = NULL;
+    FILE *f = NULL;
+    int fd, ret = -1;
+
+    fd = mkstemp( media );
+    if ( !buf || fd < 0 )
+        goto out;
+    close( fd );
+    snprintf( sidecar, sizeof(sidecar), "%s.idx", media );
+    if ( !(f = fopen( media, "wb" )) )
+        goto out;
+
+    for ( i = 0; i < mb / 64 || i < 1; i++ )
+        if ( append_stream( f, buf, CHUNK_SIZE, &pictures ) < 0 )
+            goto out;
+    fflush( f );
+
+    start = bench_now();
+    count = hevc_index_update( media, sidecar );
+    elapsed = bench_now() - start;
+    if ( count <= 0 )
+        goto out;
+    printf( "build   %5ld MB %8.2f GB/s %10lld records\n", (i * CHUNK_SIZE) >> 20,
+            (double)i * CHUNK_SIZE / elapsed / 1e9, (long long)count );
+
+    // one more chunk recorded, only the tail is scanned
+    if ( append_stream( f, buf, CHUNK_SIZE, &pictures ) < 0 )
+        goto out;
+    fflush( f );
+    start = bench_now();
+    count = hevc_index_update( media, sidecar );
+    elapsed = bench_now() - start;
+    if ( count != pictures )
+        goto out;
+    printf( "update  %5d MB %8.2f ms\n", CHUNK_SIZE >> 20, elapsed * 1e3 );
+
+    idx = hevc_index_open( sidecar );
+    if ( !idx )
+        goto out;
+    start = bench_now();
+    for ( i = 0; i < LOOKUPS; i++ ) {
+        uint64_t offset = ((uint64_t)bench_rand() << 32 | bench_rand()) % hevc_index_media_size( idx );
+
+        found += hevc_index_seek( idx, hevc_index_find( idx, offset ) );
+    }
+    elapsed = bench_now() - start;
+    printf( "lookup  %8.2f M seeks/s (%lld)\n", LOOKUPS / elapsed / 1e6, (long long)found );
+    ret = 0;
+
+out:
+    hevc_index_close( idx );
+    if ( f )
+        fclose( f );
+    unlink( media );
+    unlink( sidecar );
+    free( buf );
+    return ret;
+}
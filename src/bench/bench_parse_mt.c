@@ -0,0 +1,59 @@
+// Last Update:2026-10-17 19:15:02
+/**
+ * @file bench_parse_mt.c
+ * @brief serial against chunked multi-threaded NAL indexing, ./bench parse_mt [MB]
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "hevc.h"
+
+int bench_parse_mt( int argc, char **argv )
+{
+    size_t size = (size_t)(argc > 1 ? atoi( argv[1] ) : 1024) << 20;
+    uint8_t *buf = malloc( size );
+    long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    NalUnitList serial, mt;
+    int threads, ret = -1;
+    double start, elapsed;
+
+    hevc_nalu_list_init( &serial );
+    hevc_nalu_list_init( &mt );
+    // the serial path takes an int size
+    if ( !buf || size > 0x7fffffff )
+        goto out;
+
+    bench_make_stream( buf, size, 1400, 30 );
+    // the first call sizes the list, time the second one
+    hevc_nalu_list_parse( &serial, buf, size );
+    start = bench_now();
+    if ( hevc_nalu_list_parse( &serial, buf, size ) <= 0 )
+        goto out;
+    elapsed = bench_now() - start;
+    printf( "serial      %8.2f GB/s %10d NAL units\n", size / elapsed / 1e9, serial.count );
+
+    hevc_nalu_list_parse_mt( &mt, buf, size, 1 );
+    for ( threads = 1; threads <= 2 * cpus; threads *= 2 ) {
+        start = bench_now();
+        if ( hevc_nalu_list_parse_mt( &mt, buf, size, threads ) != serial.count ||
+             memcmp( mt.nalu, serial.nalu, serial.count * sizeof(NalUnit) ) ) {
+            printf( "%d threads: list differs from the serial one\n", threads );
+            goto out;
+        }
+        elapsed = bench_now() - start;
+        printf( "%3d threads %8.2f GB/s\n", threads, size / elapsed / 1e9 );
+    }
+    ret = 0;
+
+out:
+    hevc_nalu_list_free( &serial );
+    hevc_nalu_list_free( &mt );
+    free( buf );
+    return ret;
+}
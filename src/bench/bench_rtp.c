@@ -0,0 +1,83 @@
+// Last Update:2026-10-17 15:40:18
+/**
+ * @file bench_rtp.c
+ * @brief RTP packetizer throughput
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "hevc.h"
+#include "hevc_rtp.h"
+
+#define STREAM_SIZE (64*1024*1024)
+#define MAX_PACKETS 4096
+
+int bench_rtp_pack( int argc, char **argv )
+{
+    uint8_t *buf = malloc( STREAM_SIZE );
+    HevcRtpPacket *packets = malloc( MAX_PACKETS * sizeof(HevcRtpPacket) );
+    NalUnitList list;
+    HevcAuDetector au;
+    int *au_start = NULL, au_count = 0, i, ret = -1;
+
+    (void)argc; (void)argv;
+    hevc_nalu_list_init( &list );
+    if ( !buf || !packets )
+        goto out;
+
+    // slices the size of a 4K stream at ~25 Mbps cut in 8, a parameter set
+    // burst per GOP
+    bench_make_stream( buf, STREAM_SIZE, 7500, 240 );
+    if ( hevc_nalu_list_parse( &list, buf, STREAM_SIZE ) <= 0 )
+        goto out;
+
+    // group into access units once, as a muxer receiving pictures would;
+    // the random payload sets first_slice_segment_in_pic_flag every other slice
+    au_start = malloc( (list.count + 1) * sizeof(int) );
+    if ( !au_start )
+        goto out;
+    hevc_au_init( &au );
+    for ( i = 0; i < list.count; i++ )
+        if ( hevc_au_starts( &au, &list.nalu[i] ) )
+            au_start[au_count++] = i;
+    au_start[au_count] = list.count;
+
+    for ( i = 1200; i <= 1400; i += 200 ) {
+        HevcRtpPacketizer pack;
+        long long bytes = 0, npackets = 0;
+        double start, elapsed;
+        int a;
+
+        hevc_rtp_pack_init( &pack, i, 96, 0x12345678, 0 );
+        start = bench_now();
+        do {
+            for ( a = 0; a < au_count; a++ ) {
+                int first = au_start[a], n = au_start[a+1] - first, k;
+                int count = hevc_rtp_pack_au( &pack, &list.nalu[first], n, a * 3000,
+                                              packets, MAX_PACKETS );
+
+                if ( count < 0 )
+                    goto out;
+                for ( k = 0; k < count; k++ )
+                    bytes += packets[k].size;
+                npackets += count;
+            }
+            elapsed = bench_now() - start;
+        } while ( elapsed < BENCH_MIN_SECONDS );
+
+        printf( "mtu %d %8.2f GB/s %8.2f Mpkt/s (%d access units)\n", i,
+                bytes / elapsed / 1e9, npackets / elapsed / 1e6, au_count );
+    }
+    ret = 0;
+
+out:
+    hevc_nalu_list_free( &list );
+    free( au_start );
+    free( packets );
+    free( buf );
+    return ret;
+}
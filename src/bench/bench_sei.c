@@ -0,0 +1,136 @@
+// Last Update:2026-10-17 23:41:27
+/**
+ * @file bench_sei.c
+ * @brief SEI walk with lazy decoding against unescaping the whole NAL unit,
+ *        ./bench sei [vendor payload KB]
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "bs.h"
+#include "hevc.h"
+#include "hevc_sei.h"
+#include "epb.h"
+
+#define POOL_SIZE (64*1024*1024)
+
+static void sei_header( bw_t *bw, int type, int size )
+{
+    for ( ; type >= 255; type -= 255 )
+        bw_write_u( bw, 8, 0xff );
+    bw_write_u( bw, 8, type );
+    for ( ; size >= 255; size -= 255 )
+        bw_write_u( bw, 8, 0xff );
+    bw_write_u( bw, 8, size );
+}
+
+/* a vendor user data message of random bytes with a few zero runs, then
+ * a content light level one */
+static int make_sei( uint8_t *buf, int size, int vendor )
+{
+    bw_t bw;
+    int i;
+
+    bw_init_nal( &bw, buf, size );
+    bw_write_u( &bw, 16, 0x4e01 );
+    sei_header( &bw, HEVC_SEI_USER_DATA_UNREGISTERED, vendor );
+    for ( i = 0; i < vendor; i++ )
+        bw_write_u( &bw, 8, i & 0xfe ? bench_rand() : 0 );
+    sei_header( &bw, HEVC_SEI_CONTENT_LIGHT_LEVEL, 4 );
+    bw_write_u( &bw, 16, 1000 );
+    bw_write_u( &bw, 16, 400 );
+    bw_write_trailing_bits( &bw );
+    return bw_flush( &bw );
+}
+
+static int lazy_walk( HevcSeiReader *r, const NalUnit *nalu )
+{
+    HevcSeiMessage m;
+    int level = 0;
+
+    hevc_sei_start( r, nalu );
+    while ( hevc_sei_next( r, &m ) > 0 )
+        if ( m.type == HEVC_SEI_CONTENT_LIGHT_LEVEL )
+            level = m.u.content_light.max_content_light_level;
+    return level;
+}
+
+/* what a parser unescaping the NAL unit first does */
+static int rbsp_walk( const NalUnit *nalu, uint8_t *rbsp )
+{
+    int size = hevc_extract_rbsp( nalu->addr, nalu->size, rbsp );
+    int pos = 2, level = 0;
+
+    while ( pos < size - 1 ) {
+        int type = 0, len = 0;
+
+        while ( rbsp[pos] == 0xff )
+            type += rbsp[pos++];
+        type += rbsp[pos++];
+        while ( rbsp[pos] == 0xff )
+            len += rbsp[pos++];
+        len += rbsp[pos++];
+        if ( type == HEVC_SEI_CONTENT_LIGHT_LEVEL ) {
+            bs_t bs;
+
+            bs_init( &bs, rbsp + pos, len );
+            level = bs_read_u( &bs, 16 );
+        }
+        pos += len;
+    }
+    return level;
+}
+
+int bench_sei( int argc, char **argv )
+{
+    int vendor = (argc > 1 ? atoi( argv[1] ) : 16) * 1024;
+    int room = EPB_INSERT_SIZE( vendor + 64 ), count, pass, i, ret = -1;
+    const char *names[] = { "lazy", "rbsp" };
+    uint8_t *pool = NULL, *rbsp = malloc( room );
+    NalUnit *nalu = NULL;
+    HevcSeiReader r;
+    long bytes = 0;
+
+    // more NAL units than the caches hold, like SEIs coming off the network
+    count = vendor > 0 ? POOL_SIZE / room + 1 : 0;
+    if ( !rbsp || !count || !(pool = malloc( (size_t)count * room )) ||
+         !(nalu = malloc( count * sizeof(NalUnit) )) )
+        goto out;
+    for ( i = 0; i < count; i++ ) {
+        nalu[i].nalu_type = HEVC_NAL_SEI_PREFIX;
+        nalu[i].addr = pool + (size_t)i * room;
+        nalu[i].size = make_sei( pool + (size_t)i * room, room, vendor );
+        bytes += nalu[i].size;
+    }
+    hevc_sei_reader_init( &r );
+    hevc_sei_register( &r, HEVC_SEI_CONTENT_LIGHT_LEVEL );
+
+    printf( "%d SEI NAL units of %ld bytes, %d bytes of vendor payload\n", count, bytes / count, vendor );
+    for ( pass = 0; pass < 2; pass++ ) {
+        double start = bench_now(), elapsed;
+        long done = 0;
+
+        do {
+            for ( i = 0; i < count; i++ )
+                if ( (pass ? rbsp_walk( &nalu[i], rbsp ) : lazy_walk( &r, &nalu[i] )) != 1000 ) {
+                    printf( "%s: wrong content light level\n", names[pass] );
+                    goto out;
+                }
+            done++;
+            elapsed = bench_now() - start;
+        } while ( elapsed < BENCH_MIN_SECONDS );
+        printf( "%-6s %10.0f NAL/s %8.2f GB/s\n", names[pass], done * count / elapsed,
+                done * (double)bytes / elapsed / 1e9 );
+    }
+    ret = 0;
+
+out:
+    free( pool );
+    free( nalu );
+    free( rbsp );
+    return ret;
+}
@@ -0,0 +1,69 @@
+// Last Update:2026-10-17 10:40:02
+/**
+ * @file bench_startcode.c
+ * @brief start code scanner throughput per instruction set
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "startcode.h"
+
+#define STREAM_SIZE (64*1024*1024)
+
+static int count_startcodes( StartcodeFinder find, const uint8_t *p, const uint8_t *end )
+{
+    int n = 0;
+
+    while ( (p = find( p, end )) < end ) {
+        p += 3;
+        n++;
+    }
+    return n;
+}
+
+int bench_startcode( int argc, char **argv )
+{
+    uint8_t *buf = malloc( STREAM_SIZE );
+    int i, expect = -1;
+
+    (void)argc; (void)argv;
+    if ( !buf )
+        return -1;
+
+    // 1400 byte NALs is about a 4K P-slice split for RTP, worst case for us
+    bench_make_stream( buf, STREAM_SIZE, 1400, 30 );
+
+    for ( i = 0; i < STARTCODE_IMPL_NB; i++ ) {
+        StartcodeFinder find = startcode_get_impl( i );
+        double start, elapsed;
+        long long bytes = 0;
+        int n = 0;
+
+        if ( !find ) {
+            printf( "%-6s unsupported\n", startcode_impl_name( i ) );
+            continue;
+        }
+
+        start = bench_now();
+        do {
+            n = count_startcodes( find, buf, buf + STREAM_SIZE );
+            bytes += STREAM_SIZE;
+            elapsed = bench_now() - start;
+        } while ( elapsed < BENCH_MIN_SECONDS );
+
+        if ( expect >= 0 && n != expect ) {
+            printf( "%-6s found %d start codes, expected %d\n", startcode_impl_name( i ), n, expect );
+            free( buf );
+            return -1;
+        }
+        expect = n;
+        printf( "%-6s %8.2f GB/s (%d start codes)\n", startcode_impl_name( i ), bytes / elapsed / 1e9, n );
+    }
+
+    free( buf );
+    return 0;
+}
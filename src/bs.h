@@ -31,14 +31,40 @@
 extern "C" {
 #endif
 
+#define BS_EPB_FIFO 8
+
 typedef struct
 {
 	uint8_t* start;
 	uint8_t* p;
 	uint8_t* end;
 	int bits_left;
+	/* emulation prevention, only used after bs_init_nal() */
+	const uint8_t* epb_scan;	/* bytes below this were checked for 00 00 03 */
+	int epb_zeros;				/* zero bytes just before epb_scan */
+	int epb_head;
+	int epb_count;
+	const uint8_t* epb[BS_EPB_FIFO];	/* pending 0x03 positions >= p */
 } bs_t;
 
+/*
+ * Writer with a 64-bit cache: fields are shifted into the cache and go out
+ * 32 bits at a time, so nothing is read back or cleared in the buffer. In
+ * bw_init_nal() mode every byte going out passes the emulation prevention
+ * check, the output is a NAL unit payload ready for Annex-B.
+ */
+typedef struct
+{
+	uint8_t* start;
+	uint8_t* p;
+	uint8_t* end;
+	uint64_t cache;		/* pending bits, the low cache_bits of it */
+	int cache_bits;
+	int epb;			/* insert emulation_prevention_three_byte */
+	int zeros;			/* zero bytes just written, for epb */
+	int overrun;
+} bw_t;
+
 #define _OPTIMIZE_BS_ 1
 
 #if ( _OPTIMIZE_BS_ > 0 )
@@ -52,6 +78,7 @@ static bs_t* bs_new(uint8_t* buf, size_t size);
 static void bs_free(bs_t* b);
 static bs_t* bs_clone( bs_t* dest, const bs_t* src );
 static bs_t*  bs_init(bs_t* b, uint8_t* buf, size_t size);
+static bs_t*  bs_init_nal(bs_t* b, const uint8_t* buf, size_t size);
 static uint32_t bs_byte_aligned(bs_t* b);
 static int bs_eof(bs_t* b);
 static int bs_overrun(bs_t* b);
@@ -60,6 +87,7 @@ static int bs_pos(bs_t* b);
 static uint32_t bs_peek_u1(bs_t* b);
 static uint32_t bs_read_u1(bs_t* b);
 static uint32_t bs_read_u(bs_t* b, int n);
+static uint64_t bs_read_ull(bs_t* b, int n);
 static uint32_t bs_read_f(bs_t* b, int n);
 static uint32_t bs_read_u8(bs_t* b);
 static uint32_t bs_read_ue(bs_t* b);
@@ -72,6 +100,16 @@ static void bs_write_u8(bs_t* b, uint32_t v);
 static void bs_write_ue(bs_t* b, uint32_t v);
 static void bs_write_se(bs_t* b, int32_t v);
 
+static bw_t* bw_init(bw_t* b, uint8_t* buf, size_t size);
+static bw_t* bw_init_nal(bw_t* b, uint8_t* buf, size_t size);
+static void bw_write_u1(bw_t* b, uint32_t v);
+static void bw_write_u(bw_t* b, int n, uint32_t v);
+static void bw_write_ull(bw_t* b, int n, uint64_t v);
+static void bw_write_ue(bw_t* b, uint32_t v);
+static void bw_write_se(bw_t* b, int32_t v);
+static void bw_write_trailing_bits(bw_t* b);
+static int bw_flush(bw_t* b);
+
 static int bs_read_bytes(bs_t* b, uint8_t* buf, int len);
 static int bs_write_bytes(bs_t* b, uint8_t* buf, int len);
 static int bs_skip_bytes(bs_t* b, int len);
@@ -84,9 +122,70 @@ static inline bs_t* bs_init(bs_t* b, uint8_t* buf, size_t size)
     b->p = buf;
     b->end = buf + size;
     b->bits_left = 8;
+    b->epb_scan = NULL;
+    return b;
+}
+
+/*
+ * Read the RBSP straight out of a NAL unit payload (Annex-B or length
+ * prefixed, header already skipped) without copying it first: every
+ * emulation_prevention_three_byte is stepped over as the read position
+ * reaches it. The payload is only scanned a few bytes ahead of the read
+ * position, so parsing the first bits of a large slice touches only those
+ * bytes.
+ */
+static inline bs_t* bs_init_nal(bs_t* b, const uint8_t* buf, size_t size)
+{
+    bs_init(b, (uint8_t*)buf, size);
+    b->epb_scan = buf;
+    b->epb_zeros = 0;
+    b->epb_head = 0;
+    b->epb_count = 0;
     return b;
 }
 
+// note every 00 00 03 below upto, stops early when the fifo is full
+static inline void bs_epb_scan(bs_t* b, const uint8_t* upto)
+{
+    const uint8_t* q = b->epb_scan;
+
+    if (upto > b->end) { upto = b->end; }
+    while (q < upto && b->epb_count < BS_EPB_FIFO)
+    {
+        if (b->epb_zeros >= 2 && *q == 0x03)
+        {
+            b->epb[(b->epb_head + b->epb_count++) & (BS_EPB_FIFO - 1)] = q;
+            b->epb_zeros = 0;
+        }
+        else if (*q == 0)
+        {
+            b->epb_zeros++;
+        }
+        else
+        {
+            b->epb_zeros = 0;
+        }
+        q++;
+    }
+    b->epb_scan = q;
+}
+
+// move p forward by n payload bytes, skipping the 0x03 bytes in between
+static inline void bs_epb_forward(bs_t* b, int n)
+{
+    uint8_t* p = b->p + n;
+
+    for (;;)
+    {
+        bs_epb_scan(b, p + 1);
+        if (b->epb_count == 0 || b->epb[b->epb_head] > p) { break; }
+        b->epb_head = (b->epb_head + 1) & (BS_EPB_FIFO - 1);
+        b->epb_count--;
+        p++;
+    }
+    b->p = p;
+}
+
 static inline bs_t* bs_new(uint8_t* buf, size_t size)
 {
     bs_t* b = (bs_t*)malloc(sizeof(bs_t));
@@ -101,10 +200,8 @@ static inline void bs_free(bs_t* b)
 
 static inline bs_t* bs_clone(bs_t* dest, const bs_t* src)
 {
+    *dest = *src;
     dest->start = src->p;
-    dest->p = src->p;
-    dest->end = src->end;
-    dest->bits_left = src->bits_left;
     return dest;
 }
 
@@ -123,6 +220,93 @@ static inline int bs_bytes_left(bs_t* b) { return (b->end - b->p); }
 
 static inline int bs_bits_left( bs_t *b) { return ((b->end - b->p )*8 + b->bits_left); };
 
+/*
+ * Word-at-a-time reading: every multi-bit read fetches the 64 bits starting at
+ * b->p with one unaligned big-endian load and cuts the field out of that
+ * window, so a read costs a load and two shifts instead of one bs_read_u1()
+ * per bit. The window always holds at least 57 valid bits (64 minus the up
+ * to 7 already consumed bits of *b->p), which covers every u(n) with n <= 32
+ * and every ue(v) whose prefix is shorter than 29 zeros.
+ *
+ * Only the last 7 bytes of a buffer are assembled byte by byte (zero filled
+ * past b->end, same as the old per-bit reader returned 0 at eof), so callers
+ * don't need to pad their buffers. In bs_init_nal() mode the same slow path
+ * is taken when an emulation prevention byte falls inside the window.
+ */
+static inline uint64_t bs_load_be64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t bs_window_epb(bs_t* b)
+{
+    const uint8_t* q = b->p;
+    uint64_t w = 0;
+    int i = 0, k = b->epb_head, n = b->epb_count;
+
+    for (; i < 8 && q < b->end; q++)
+    {
+        if (n && q == b->epb[k])
+        {
+            k = (k + 1) & (BS_EPB_FIFO - 1);
+            n--;
+            continue;
+        }
+        w |= (uint64_t)*q << (56 - 8*i);
+        i++;
+    }
+    return w;
+}
+
+static inline uint64_t bs_window(bs_t* b)
+{
+    uint64_t w = 0;
+    int i;
+
+    if (b->epb_scan)
+    {
+        // 8 payload bytes span at most 12 raw bytes
+        bs_epb_scan(b, b->p + 12);
+        if (b->epb_count && b->epb[b->epb_head] < b->p + 8)
+        {
+            return bs_window_epb(b) << (8 - b->bits_left);
+        }
+    }
+
+    if (b->end - b->p >= 8)
+    {
+        w = bs_load_be64(b->p);
+    }
+    else
+    {
+        for (i = 0; i < 8 && b->p + i < b->end; i++)
+        {
+            w |= (uint64_t)b->p[i] << (56 - 8*i);
+        }
+    }
+    return w << (8 - b->bits_left);
+}
+
+static inline void bs_advance(bs_t* b, int n)
+{
+    int consumed = (8 - b->bits_left) + n;
+
+    if (b->epb_scan)
+    {
+        bs_epb_forward(b, consumed >> 3);
+    }
+    else
+    {
+        b->p += consumed >> 3;
+    }
+    b->bits_left = 8 - (consumed & 7);
+}
+
 static inline uint32_t bs_read_u1(bs_t* b)
 {
     uint32_t r = 0;
@@ -134,7 +318,7 @@ static inline uint32_t bs_read_u1(bs_t* b)
         r = ((*(b->p)) >> b->bits_left) & 0x01;
     }
 
-    if (b->bits_left == 0) { b->p ++; b->bits_left = 8; }
+    if (b->bits_left == 0) { bs_advance(b, 0); }
 
     return r;
 }
@@ -142,7 +326,7 @@ static inline uint32_t bs_read_u1(bs_t* b)
 static inline void bs_skip_u1(bs_t* b)
 {    
     b->bits_left--;
-    if (b->bits_left == 0) { b->p ++; b->bits_left = 8; }
+    if (b->bits_left == 0) { bs_advance(b, 0); }
 }
 
 static inline uint32_t bs_peek_u1(bs_t* b)
@@ -159,22 +343,31 @@ static inline uint32_t bs_peek_u1(bs_t* b)
 
 static inline uint32_t bs_read_u(bs_t* b, int n)
 {
-    uint32_t r = 0;
-    int i;
-    for (i = 0; i < n; i++)
-    {
-        r |= ( bs_read_u1(b) << ( n - i - 1 ) );
-    }
+    uint32_t r;
+
+    if (n <= 0) { return 0; }
+
+    r = (uint32_t)(bs_window(b) >> (64 - n));
+    bs_advance(b, n);
     return r;
 }
 
-static inline void bs_skip_u(bs_t* b, int n)
+// up to 64 bits, e.g. general_constraint_indicator_flags u(48)
+static inline uint64_t bs_read_ull(bs_t* b, int n)
 {
-    int i;
-    for ( i = 0; i < n; i++ ) 
+    uint64_t r = 0;
+
+    if (n > 32)
     {
-        bs_skip_u1( b );
+        r = (uint64_t)bs_read_u(b, n - 32) << 32;
+        n = 32;
     }
+    return r | bs_read_u(b, n);
+}
+
+static inline void bs_skip_u(bs_t* b, int n)
+{
+    if (n > 0) { bs_advance(b, n); }
 }
 
 static inline uint32_t bs_read_f(bs_t* b, int n) { return bs_read_u(b, n); }
@@ -182,7 +375,7 @@ static inline uint32_t bs_read_f(bs_t* b, int n) { return bs_read_u(b, n); }
 static inline uint32_t bs_read_u8(bs_t* b)
 {
 #ifdef FAST_U8
-    if (b->bits_left == 8 && ! bs_eof(b)) // can do fast read
+    if (b->bits_left == 8 && ! bs_eof(b) && ! b->epb_scan) // can do fast read
     {
         uint32_t r = b->p[0];
         b->p++;
@@ -194,16 +387,23 @@ static inline uint32_t bs_read_u8(bs_t* b)
 
 static inline uint32_t bs_read_ue(bs_t* b)
 {
-    int32_t r = 0;
+    uint64_t w = bs_window(b);
     int i = 0;
 
+    // prefix + suffix fit in the window: count the zeros with clz
+    if (w >= (1ULL << 35))
+    {
+        int len = 2 * __builtin_clzll(w) + 1;
+        bs_advance(b, len);
+        return (uint32_t)((w >> (64 - len)) - 1);
+    }
+
+    // 29+ leading zeros, only valid for values >= 2^28 - 1 or corrupt data
     while( (bs_read_u1(b) == 0) && (i < 32) && (!bs_eof(b)) )
     {
         i++;
     }
-    r = bs_read_u(b, i);
-    r += (1 << i) - 1;
-    return r;
+    return bs_read_u(b, i) + (uint32_t)((1ULL << i) - 1);
 }
 
 static inline int32_t bs_read_se(bs_t* b) 
@@ -333,6 +533,13 @@ static inline void bs_write_se(bs_t* b, int32_t v)
 static inline int bs_read_bytes(bs_t* b, uint8_t* buf, int len)
 {
     int actual_len = len;
+    int i;
+
+    if (b->epb_scan)
+    {
+        for (i = 0; i < len && ! bs_eof(b); i++) { buf[i] = bs_read_u8(b); }
+        return i;
+    }
     if (b->end - b->p < actual_len) { actual_len = b->end - b->p; }
     if (actual_len < 0) { actual_len = 0; }
     memcpy(buf, b->p, actual_len);
@@ -358,7 +565,8 @@ static inline int bs_skip_bytes(bs_t* b, int len)
     if (b->end - b->p < actual_len) { actual_len = b->end - b->p; }
     if (actual_len < 0) { actual_len = 0; }
     if (len < 0) { len = 0; }
-    b->p += len;
+    if (b->epb_scan) { bs_epb_forward(b, len); }
+    else { b->p += len; }
     return actual_len;
 }
 
@@ -381,6 +589,144 @@ static inline uint64_t bs_next_bytes(bs_t* bs, int nbytes)
    return val;
 }
 
+static inline bw_t* bw_init(bw_t* b, uint8_t* buf, size_t size)
+{
+    b->start = buf;
+    b->p = buf;
+    b->end = buf + size;
+    b->cache = 0;
+    b->cache_bits = 0;
+    b->epb = 0;
+    b->zeros = 0;
+    b->overrun = 0;
+    return b;
+}
+
+static inline bw_t* bw_init_nal(bw_t* b, uint8_t* buf, size_t size)
+{
+    bw_init(b, buf, size);
+    b->epb = 1;
+    return b;
+}
+
+static inline void bw_put_raw(bw_t* b, uint32_t v)
+{
+    if (b->p < b->end) { *(b->p++) = v; }
+    else { b->overrun = 1; }
+}
+
+static inline void bw_put_byte(bw_t* b, uint32_t v)
+{
+    if (b->epb)
+    {
+        if (b->zeros >= 2 && v <= 3)
+        {
+            bw_put_raw(b, 3);
+            b->zeros = 0;
+        }
+        b->zeros = v ? 0 : b->zeros + 1;
+    }
+    bw_put_raw(b, v);
+}
+
+// the oldest 32 of the pending bits go out, cache_bits > 32
+static inline void bw_put_word(bw_t* b)
+{
+    uint32_t w = (uint32_t)(b->cache >> (b->cache_bits - 32));
+
+    b->cache_bits -= 32;
+    // no zero byte, nor a small first one after two zeros: no 03 to insert
+    if (b->end - b->p >= 4 && (!b->epb ||
+        (!((w - 0x01010101) & ~w & 0x80808080) && (b->zeros < 2 || (w >> 24) > 3))))
+    {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+        w = __builtin_bswap32(w);
+#endif
+        memcpy(b->p, &w, 4);
+        b->p += 4;
+        b->zeros = 0;
+        return;
+    }
+    bw_put_byte(b, (w >> 24) & 0xff);
+    bw_put_byte(b, (w >> 16) & 0xff);
+    bw_put_byte(b, (w >> 8) & 0xff);
+    bw_put_byte(b, w & 0xff);
+}
+
+// n <= 32
+static inline void bw_write_u(bw_t* b, int n, uint32_t v)
+{
+    if (n <= 0) { return; }
+    if (b->cache_bits + n > 64) { bw_put_word(b); }
+    b->cache = (b->cache << n) | (v & (0xffffffffU >> (32 - n)));
+    b->cache_bits += n;
+}
+
+static inline void bw_write_u1(bw_t* b, uint32_t v) { bw_write_u(b, 1, v); }
+
+static inline void bw_write_ull(bw_t* b, int n, uint64_t v)
+{
+    if (n > 32)
+    {
+        bw_write_u(b, n - 32, (uint32_t)(v >> 32));
+        n = 32;
+    }
+    bw_write_u(b, n, (uint32_t)v);
+}
+
+// the whole uint32 range, 0xffffffff is a 65 bit code
+static inline void bw_write_ue(bw_t* b, uint32_t v)
+{
+    uint64_t code = (uint64_t)v + 1;
+    int len = 64 - __builtin_clzll(code);
+
+    bw_write_u(b, len - 1, 0);
+    bw_write_ull(b, len, code);
+}
+
+static inline void bw_write_se(bw_t* b, int32_t v)
+{
+    if (v <= 0)
+    {
+        bw_write_ue(b, -(int64_t)v * 2);
+    }
+    else
+    {
+        bw_write_ue(b, (uint32_t)v * 2 - 1);
+    }
+}
+
+static inline int bw_byte_aligned(bw_t* b) { return !(b->cache_bits & 7); }
+
+// bits written so far, inserted 03 bytes included
+static inline int64_t bw_pos(bw_t* b) { return (int64_t)(b->p - b->start) * 8 + b->cache_bits; }
+
+// rbsp_stop_one_bit and the alignment zero bits
+static inline void bw_write_trailing_bits(bw_t* b)
+{
+    bw_write_u1(b, 1);
+    bw_write_u(b, (8 - (b->cache_bits & 7)) & 7, 0);
+}
+
+/* write out the pending bits, zero padded to a byte; a NAL unit ending in a
+ * zero byte gets an 03 after it. returns the bytes written, -1 if the
+ * buffer was too small */
+static inline int bw_flush(bw_t* b)
+{
+    if (b->cache_bits & 7) { bw_write_u(b, 8 - (b->cache_bits & 7), 0); }
+    while (b->cache_bits > 0)
+    {
+        b->cache_bits -= 8;
+        bw_put_byte(b, (uint32_t)(b->cache >> b->cache_bits) & 0xff);
+    }
+    if (b->epb && b->zeros)
+    {
+        bw_put_raw(b, 3);
+        b->zeros = 0;
+    }
+    return b->overrun ? -1 : (int)(b->p - b->start);
+}
+
 #define bs_print_state(b) fprintf( stderr,  "%s:%d@%s: b->p=0x%02hhX, b->left = %d\n", __FILE__, __LINE__, __FUNCTION__, *b->p, b->bits_left )
 
 #ifdef __cplusplus
@@ -0,0 +1,295 @@
+// Last Update:2026-10-17 21:05:12
+/**
+ * @file epb.c
+ * @brief emulation prevention removal and insertion, one per instruction set
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "epb.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EPB_X86 1
+#include <immintrin.h>
+#endif
+
+static int epb_remove_c( const uint8_t *src, int len, uint8_t *dst )
+{
+    int i = 0, n = 0;
+
+    while ( i + 2 < len )
+        if ( !src[i] && !src[i + 1] && src[i + 2] == 3 ) {
+            dst[n++] = src[i++];
+            dst[n++] = src[i++];
+            i++; // emulation_prevention_three_byte
+        } else
+            dst[n++] = src[i++];
+
+    while ( i < len )
+        dst[n++] = src[i++];
+
+    return n;
+}
+
+static int epb_insert_c( const uint8_t *src, int len, uint8_t *dst )
+{
+    int i, n = 0, zeros = 0;
+
+    for ( i = 0; i < len; i++ ) {
+        if ( zeros >= 2 && src[i] <= 3 ) {
+            dst[n++] = 3;
+            zeros = 0;
+        }
+        dst[n++] = src[i];
+        zeros = src[i] ? 0 : zeros + 1;
+    }
+    // a zero byte can't end a NAL unit, it would read as trailing_zero_8bits
+    if ( zeros )
+        dst[n++] = 3;
+
+    return n;
+}
+
+/* the next 00 00 x, x == 3 to remove and x <= 3 to insert */
+static const uint8_t *epb_find_c( const uint8_t *p, const uint8_t *end, int insert )
+{
+    for ( ; end - p >= 3; p++ )
+        if ( !p[0] && !p[1] && (insert ? p[2] <= 3 : p[2] == 3) )
+            return p;
+    return end;
+}
+
+#ifdef EPB_X86
+
+/*
+ * Both directions look for 00 00 x, with x == 3 to remove and x <= 3 to
+ * insert, like the start code scanners: a block only goes on to the third
+ * compare when it holds a zero pair, which after emulation prevention (or
+ * in entropy coded data) is rare. The runs between matches are copied with
+ * memcpy. Matches to remove can't overlap; an insertion restarts the
+ * search at the byte it was put before, which is where the byte loop
+ * resets its zero count.
+ */
+__attribute__((target("sse2")))
+static inline const uint8_t *epb_find_sse2( const uint8_t *p, const uint8_t *end, int insert )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i three = _mm_set1_epi8( 3 );
+
+    for ( ; end - p >= 18; p += 16 ) {
+        __m128i pair = _mm_and_si128( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)p ), zero ),
+                                      _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)(p + 1) ), zero ) );
+        __m128i x;
+        unsigned mask;
+
+        if ( !_mm_movemask_epi8( pair ) )
+            continue;
+
+        x = _mm_loadu_si128( (const __m128i *)(p + 2) );
+        if ( insert )
+            x = _mm_max_epu8( x, three );
+        mask = _mm_movemask_epi8( _mm_and_si128( pair, _mm_cmpeq_epi8( x, three ) ) );
+        if ( mask )
+            return p + __builtin_ctz( mask );
+    }
+
+    return epb_find_c( p, end, insert );
+}
+
+__attribute__((target("avx2")))
+static inline const uint8_t *epb_find_avx2( const uint8_t *p, const uint8_t *end, int insert )
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i three = _mm256_set1_epi8( 3 );
+
+    for ( ; end - p >= 34; p += 32 ) {
+        __m256i pair = _mm256_and_si256( _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)p ), zero ),
+                                         _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)(p + 1) ), zero ) );
+        __m256i x;
+        unsigned mask;
+
+        if ( _mm256_testz_si256( pair, pair ) )
+            continue;
+
+        x = _mm256_loadu_si256( (const __m256i *)(p + 2) );
+        if ( insert )
+            x = _mm256_max_epu8( x, three );
+        mask = _mm256_movemask_epi8( _mm256_and_si256( pair, _mm256_cmpeq_epi8( x, three ) ) );
+        if ( mask )
+            return p + __builtin_ctz( mask );
+    }
+
+    return epb_find_sse2( p, end, insert );
+}
+
+#define EPB_KERNELS( isa )                                                      \
+__attribute__((target(#isa)))                                                   \
+static int epb_remove_##isa( const uint8_t *src, int len, uint8_t *dst )        \
+{                                                                               \
+    const uint8_t *p = src, *end = src + len, *q;                               \
+    uint8_t *d = dst;                                                           \
+                                                                                \
+    while ( (q = epb_find_##isa( p, end, 0 )) < end ) {                         \
+        memcpy( d, p, q + 2 - p );                                              \
+        d += q + 2 - p;                                                         \
+        p = q + 3;                                                              \
+    }                                                                           \
+    memcpy( d, p, end - p );                                                    \
+    return d + (end - p) - dst;                                                 \
+}                                                                               \
+                                                                                \
+__attribute__((target(#isa)))                                                   \
+static int epb_insert_##isa( const uint8_t *src, int len, uint8_t *dst )        \
+{                                                                               \
+    const uint8_t *p = src, *end = src + len, *q;                               \
+    uint8_t *d = dst;                                                           \
+                                                                                \
+    while ( (q = epb_find_##isa( p, end, 1 )) < end ) {                         \
+        memcpy( d, p, q + 2 - p );                                              \
+        d += q + 2 - p;                                                         \
+        *d++ = 3;                                                               \
+        p = q + 2;                                                              \
+    }                                                                           \
+    memcpy( d, p, end - p );                                                    \
+    d += end - p;                                                               \
+    if ( d > dst && !d[-1] )                                                    \
+        *d++ = 3;                                                               \
+    return d - dst;                                                             \
+}
+
+EPB_KERNELS( sse2 )
+EPB_KERNELS( avx2 )
+
+__attribute__((target("sse2")))
+static const uint8_t *epb_next_sse2( const uint8_t *p, const uint8_t *end )
+{
+    return epb_find_sse2( p, end, 0 );
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *epb_next_avx2( const uint8_t *p, const uint8_t *end )
+{
+    return epb_find_avx2( p, end, 0 );
+}
+
+#endif
+
+EpbFunc epb_get_remove( EpbImpl impl )
+{
+    switch ( impl ) {
+    case EPB_IMPL_C:
+        return epb_remove_c;
+#ifdef EPB_X86
+    case EPB_IMPL_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "sse2" ) ? epb_remove_sse2 : NULL;
+    case EPB_IMPL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) ? epb_remove_avx2 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+EpbFunc epb_get_insert( EpbImpl impl )
+{
+    switch ( impl ) {
+    case EPB_IMPL_C:
+        return epb_insert_c;
+#ifdef EPB_X86
+    case EPB_IMPL_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "sse2" ) ? epb_insert_sse2 : NULL;
+    case EPB_IMPL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) ? epb_insert_avx2 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+const char *epb_impl_name( EpbImpl impl )
+{
+    static const char *names[EPB_IMPL_NB] = { "c", "sse2", "avx2" };
+
+    if ( impl < 0 || impl >= EPB_IMPL_NB )
+        return "unknown";
+    return names[impl];
+}
+
+static EpbFunc epb_resolve( EpbFunc (*get)( EpbImpl ) )
+{
+    int i;
+
+    for ( i = EPB_IMPL_NB - 1; i > EPB_IMPL_C; i-- ) {
+        EpbFunc f = get( i );
+        if ( f )
+            return f;
+    }
+    return get( EPB_IMPL_C );
+}
+
+static int epb_remove_init( const uint8_t *src, int len, uint8_t *dst );
+static int epb_insert_init( const uint8_t *src, int len, uint8_t *dst );
+
+/* every thread resolves to the same function, so the first call racing
+ * with another one is harmless */
+static EpbFunc epb_remover = epb_remove_init;
+static EpbFunc epb_inserter = epb_insert_init;
+
+static int epb_remove_init( const uint8_t *src, int len, uint8_t *dst )
+{
+    epb_remover = epb_resolve( epb_get_remove );
+    return epb_remover( src, len, dst );
+}
+
+static int epb_insert_init( const uint8_t *src, int len, uint8_t *dst )
+{
+    epb_inserter = epb_resolve( epb_get_insert );
+    return epb_inserter( src, len, dst );
+}
+
+int epb_remove( const uint8_t *src, int len, uint8_t *dst )
+{
+    return epb_remover( src, len, dst );
+}
+
+int epb_insert( const uint8_t *src, int len, uint8_t *dst )
+{
+    return epb_inserter( src, len, dst );
+}
+
+typedef const uint8_t *(*EpbNextFunc)( const uint8_t *p, const uint8_t *end );
+
+static const uint8_t *epb_next_c( const uint8_t *p, const uint8_t *end )
+{
+    return epb_find_c( p, end, 0 );
+}
+
+static const uint8_t *epb_next_init( const uint8_t *p, const uint8_t *end );
+
+static EpbNextFunc epb_nexter = epb_next_init;
+
+static const uint8_t *epb_next_init( const uint8_t *p, const uint8_t *end )
+{
+    epb_nexter = epb_next_c;
+#ifdef EPB_X86
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) )
+        epb_nexter = epb_next_avx2;
+    else if ( __builtin_cpu_supports( "sse2" ) )
+        epb_nexter = epb_next_sse2;
+#endif
+    return epb_nexter( p, end );
+}
+
+const uint8_t *epb_next( const uint8_t *p, const uint8_t *end )
+{
+    return epb_nexter( p, end );
+}
@@ -0,0 +1,43 @@
+// Last Update:2026-10-17 21:05:12
+/**
+ * @file epb.h
+ * @brief emulation prevention removal and insertion, one per instruction set
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef EPB_H
+#define EPB_H
+
+#include <stdint.h>
+
+/*
+ * remove: drops the 03 of every 00 00 03 in src, dst must hold len bytes.
+ * insert: the inverse, an 03 before any 00 00 0x (x <= 3) and after a
+ * trailing zero byte; dst must hold EPB_INSERT_SIZE(len) bytes.
+ * Both return the dst length. src and dst can't overlap.
+ */
+typedef int (*EpbFunc)( const uint8_t *src, int len, uint8_t *dst );
+
+#define EPB_INSERT_SIZE( len ) ((len) + (len) / 2 + 1)
+
+typedef enum EpbImpl {
+    EPB_IMPL_C    = 0,
+    EPB_IMPL_SSE2 = 1,
+    EPB_IMPL_AVX2 = 2,
+    EPB_IMPL_NB,
+} EpbImpl;
+
+/* the best variants for this cpu, resolved with cpuid on first use */
+extern int epb_remove( const uint8_t *src, int len, uint8_t *dst );
+extern int epb_insert( const uint8_t *src, int len, uint8_t *dst );
+/* a given variant, NULL if the cpu (or the build) doesn't support it */
+extern EpbFunc epb_get_remove( EpbImpl impl );
+extern EpbFunc epb_get_insert( EpbImpl impl );
+extern const char *epb_impl_name( EpbImpl impl );
+/* the next 00 00 03 starting in [p, end - 3], end if none: for readers
+ * stepping over escaped data without unescaping it */
+extern const uint8_t *epb_next( const uint8_t *p, const uint8_t *end );
+
+#endif  /*EPB_H*/
@@ -8,15 +8,16 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include "bs.h"
 #include "hevc.h"
+#include "startcode.h"
+#include "epb.h"
 
 #define MAX_SPATIAL_SEGMENTATION 4096 // max. value of u(12) field
-#define AV_INPUT_BUFFER_PADDING_SIZE 32
-#define NALU_MAX 16
-#define HEVC_MAX_SUB_LAYERS 7
-#define HEVC_MAX_SHORT_TERM_RPS_COUNT 64
+#define HVCC_MAX_NALUS (HEVC_MAX_VPS_COUNT + HEVC_MAX_SPS_COUNT + HEVC_MAX_PPS_COUNT)
+#define HVCC_HEADER_SIZE 23
 
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 #define MIN(a,b) ((a) > (b) ? (b) : (a))
@@ -32,44 +33,9 @@ typedef struct HVCCProfileTierLevel {
 } HVCCProfileTierLevel;
 
 
-static const uint8_t *hevc_find_startcode_internal(const uint8_t *p, const uint8_t *end)
-{
-    const uint8_t *a = p + 4 - ((intptr_t)p & 3);
-
-    for (end -= 3; p < a && p < end; p++) {
-        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-            return p;
-    }
-
-    for (end -= 3; p < end; p += 4) {
-        uint32_t x = *(const uint32_t*)p;
-        if ((x - 0x01010101) & (~x) & 0x80808080) { // generic
-            if (p[1] == 0) {
-                if (p[0] == 0 && p[2] == 1)
-                    return p;
-                if (p[2] == 0 && p[3] == 1)
-                    return p+1;
-            }
-            if (p[3] == 0) {
-                if (p[2] == 0 && p[4] == 1)
-                    return p+2;
-                if (p[4] == 0 && p[5] == 1)
-                    return p+3;
-            }
-        }
-    }
-
-    for (end += 3; p < end; p++) {
-        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-            return p;
-    }
-
-    return end + 3;
-}
-
 const uint8_t *hevc_find_startcode( const uint8_t *p, const uint8_t *end )
 {
-    const uint8_t *out= hevc_find_startcode_internal(p, end);
+    const uint8_t *out= startcode_find(p, end);
 
     if(p<out && out<end && !out[-1]) out--;
 
@@ -102,7 +68,7 @@ static void hevc_parse_ptl(bs_t *bs, HEVCDecoderConfigurationRecord *config,
     general_ptl.tier_flag                   = bs_read_u1( bs );
     general_ptl.profile_idc                 = bs_read_u( bs, 5 );
     general_ptl.profile_compatibility_flags = bs_read_u( bs, 32 );
-    general_ptl.constraint_indicator_flags  = bs_read_u( bs, 48 );
+    general_ptl.constraint_indicator_flags  = bs_read_ull( bs, 48 );
     general_ptl.level_idc                   = bs_read_u8( bs );
     hevc_update_ptl( config, &general_ptl );
 
@@ -159,30 +125,52 @@ static void skip_scaling_list_data( bs_t *bs )
             }
 }
 
-static void skip_sub_layer_ordering_info(bs_t *bs)
+static int parse_sub_layer_ordering_info(bs_t *bs, HEVCSPS *sps, unsigned int i)
 {
-    bs_read_ue(bs); // max_dec_pic_buffering_minus1
-    bs_read_ue(bs); // max_num_reorder_pics
-    bs_read_ue(bs); // max_latency_increase_plus1
+    unsigned int max_dec_pic_buffering_minus1 = bs_read_ue(bs);
+    unsigned int max_num_reorder_pics         = bs_read_ue(bs);
+
+    if (max_dec_pic_buffering_minus1 >= HEVC_MAX_DPB_SIZE ||
+        max_num_reorder_pics >= HEVC_MAX_DPB_SIZE)
+        return -1;
+    /* some encoders get this wrong, trust the reorder depth */
+    if (max_num_reorder_pics > max_dec_pic_buffering_minus1)
+        max_dec_pic_buffering_minus1 = max_num_reorder_pics;
+
+    sps->max_dec_pic_buffering[i]      = max_dec_pic_buffering_minus1 + 1;
+    sps->max_num_reorder_pics[i]       = max_num_reorder_pics;
+    sps->max_latency_increase_plus1[i] = bs_read_ue(bs);
+    return 0;
 }
 
+/*
+ * st_ref_pic_set( rps_idx ), rps_idx == num_rps is the one coded in a slice
+ * header. num_delta_pocs has a slot for it behind the SPS ones.
+ */
 static int parse_rps(bs_t *bs, unsigned int rps_idx,
                      unsigned int num_rps,
-                     unsigned int num_delta_pocs[HEVC_MAX_SHORT_TERM_RPS_COUNT])
+                     uint8_t num_delta_pocs[HEVC_MAX_SHORT_TERM_RPS_COUNT + 1])
 {
-    unsigned int i;
+    unsigned int i, ref_rps_idx = rps_idx - 1;
 
     if (rps_idx && bs_read_u1(bs)) { // inter_ref_pic_set_prediction_flag
-        /* this should only happen for slice headers, and this isn't one */
-        if (rps_idx >= num_rps)
+        if (rps_idx > num_rps)
             return -1;
 
+        /* only a slice header picks its reference RPS */
+        if (rps_idx == num_rps) {
+            unsigned int delta_idx_minus1 = bs_read_ue(bs);
+            if (delta_idx_minus1 >= rps_idx)
+                return -1;
+            ref_rps_idx = rps_idx - (delta_idx_minus1 + 1);
+        }
+
         bs_skip_u1        (bs); // delta_rps_sign
         bs_read_ue(bs); // abs_delta_rps_minus1
 
         num_delta_pocs[rps_idx] = 0;
 
-        for (i = 0; i <= num_delta_pocs[rps_idx - 1]; i++) {
+        for (i = 0; i <= num_delta_pocs[ref_rps_idx]; i++) {
             uint8_t use_delta_flag = 0;
             uint8_t used_by_curr_pic_flag = bs_read_u1(bs);
             if (!used_by_curr_pic_flag)
@@ -195,7 +183,8 @@ static int parse_rps(bs_t *bs, unsigned int rps_idx,
         unsigned int num_negative_pics = bs_read_ue(bs);
         unsigned int num_positive_pics = bs_read_ue(bs);
 
-        if ((num_positive_pics + (uint64_t)num_negative_pics) * 2 > bs_bits_left(bs))
+        if ((num_positive_pics + (uint64_t)num_negative_pics) * 2 > bs_bits_left(bs) ||
+            num_positive_pics + (uint64_t)num_negative_pics > HEVC_MAX_DPB_SIZE)
             return -1;
 
         num_delta_pocs[rps_idx] = num_negative_pics + num_positive_pics;
@@ -214,10 +203,11 @@ static int parse_rps(bs_t *bs, unsigned int rps_idx,
     return 0;
 }
 
-static void skip_timing_info(bs_t *bs)
+static void parse_timing_info(bs_t *bs, HEVCSPS *sps)
 {
-    bs_skip_bytes(bs, 4); // num_units_in_tick
-    bs_skip_bytes(bs, 32); // time_scale
+    sps->timing_info_present_flag = 1;
+    sps->num_units_in_tick = bs_read_u(bs, 32);
+    sps->time_scale        = bs_read_u(bs, 32);
 
     if (bs_read_u1(bs))          // poc_proportional_to_timing_flag
         bs_read_ue(bs); // num_ticks_poc_diff_one_minus1
@@ -242,8 +232,10 @@ static void skip_sub_layer_hrd_parameters(bs_t *bs,
     }
 }
 
-static int skip_hrd_parameters(bs_t *bs, uint8_t cprms_present_flag,
-                                unsigned int max_sub_layers_minus1)
+/* only fixed_pic_rate of the highest sub-layer is kept */
+static int parse_hrd_parameters(bs_t *bs, uint8_t cprms_present_flag,
+                                unsigned int max_sub_layers_minus1,
+                                uint8_t *fixed_pic_rate)
 {
     unsigned int i;
     uint8_t sub_pic_hrd_params_present_flag = 0;
@@ -279,11 +271,18 @@ static int skip_hrd_parameters(bs_t *bs, uint8_t cprms_present_flag,
         if (!fixed_pic_rate_general_flag)
             fixed_pic_rate_within_cvs_flag = bs_read_u1(bs);
 
+        /* fixed_pic_rate_general_flag implies fixed_pic_rate_within_cvs_flag */
+        if (fixed_pic_rate_general_flag)
+            fixed_pic_rate_within_cvs_flag = 1;
+
         if (fixed_pic_rate_within_cvs_flag)
             bs_read_ue(bs); // elemental_duration_in_tc_minus1
         else
             low_delay_hrd_flag = bs_read_u1(bs);
 
+        if (i == max_sub_layers_minus1)
+            *fixed_pic_rate = fixed_pic_rate_within_cvs_flag;
+
         if (!low_delay_hrd_flag) {
             cpb_cnt_minus1 = bs_read_ue(bs);
             if (cpb_cnt_minus1 > 31)
@@ -302,15 +301,16 @@ static int skip_hrd_parameters(bs_t *bs, uint8_t cprms_present_flag,
     return 0;
 }
 
-static void hevc_parse_vui( bs_t *bs,
+static int hevc_parse_vui( bs_t *bs,
                            HEVCDecoderConfigurationRecord *config,
+                           HEVCSPS *sps,
                            unsigned int max_sub_layers_minus1)
 {
     unsigned int min_spatial_segmentation_idc;
 
     if (bs_read_u1(bs))              // aspect_ratio_info_present_flag
         if (bs_read_u(bs, 8) == 255) // aspect_ratio_idc
-            bs_skip_bytes(bs, 32); // sar_width u(16), sar_height u(16)
+            bs_skip_u(bs, 32); // sar_width u(16), sar_height u(16)
 
     if (bs_read_u1(bs))  // overscan_info_present_flag
         bs_skip_u1(bs); // overscan_appropriate_flag
@@ -337,10 +337,17 @@ static void hevc_parse_vui( bs_t *bs,
     }
 
     if (bs_read_u1(bs)) { // vui_timing_info_present_flag
-        skip_timing_info(bs);
+        parse_timing_info(bs, sps);
+
+        if (bs_read_u1(bs) && // vui_hrd_parameters_present_flag
+            parse_hrd_parameters(bs, 1, max_sub_layers_minus1, &sps->fixed_pic_rate) < 0)
+            return -1;
 
-        if (bs_read_u1(bs)) // vui_hrd_parameters_present_flag
-            skip_hrd_parameters(bs, 1, max_sub_layers_minus1);
+        /* avgFrameRate is in frames per 256 seconds, 0 if unknown */
+        if (sps->num_units_in_tick && sps->time_scale)
+            config->avgFrameRate = MIN(0xffff, (uint64_t)sps->time_scale * 256 /
+                                               sps->num_units_in_tick);
+        config->constantFrameRate = sps->fixed_pic_rate;
     }
 
     if (bs_read_u1(bs)) { // bitstream_restriction_flag
@@ -356,16 +363,41 @@ static void hevc_parse_vui( bs_t *bs,
         bs_read_ue(bs); // log2_max_mv_length_horizontal
         bs_read_ue(bs); // log2_max_mv_length_vertical
     }
+
+    return 0;
+}
+
+/* output size: the decoded picture minus the conformance window, whose
+ * offsets are in chroma sample units. A window larger than the picture is
+ * ignored */
+static void hevc_sps_crop( HEVCSPS *sps )
+{
+    unsigned int sub_width  = (sps->chroma_format_idc == 1 || sps->chroma_format_idc == 2) &&
+                              !sps->separate_colour_plane_flag ? 2 : 1;
+    unsigned int sub_height = sps->chroma_format_idc == 1 && !sps->separate_colour_plane_flag ? 2 : 1;
+    uint64_t crop_w = (uint64_t)sub_width  * (sps->conf_win_left_offset + (uint64_t)sps->conf_win_right_offset);
+    uint64_t crop_h = (uint64_t)sub_height * (sps->conf_win_top_offset + (uint64_t)sps->conf_win_bottom_offset);
+
+    if (crop_w >= sps->pic_width_in_luma_samples || crop_h >= sps->pic_height_in_luma_samples)
+        crop_w = crop_h = 0;
+
+    sps->width  = sps->pic_width_in_luma_samples - crop_w;
+    sps->height = sps->pic_height_in_luma_samples - crop_h;
 }
 
-static int hevc_parse_sps( bs_t *bs, HEVCDecoderConfigurationRecord *config )
+static int hevc_parse_sps( bs_t *bs, HEVCDecoderConfigurationRecord *config, HEVCSPS *sps )
 {
     unsigned int i, sps_max_sub_layers_minus1, log2_max_pic_order_cnt_lsb_minus4;
-    unsigned int num_short_term_ref_pic_sets, num_delta_pocs[HEVC_MAX_SHORT_TERM_RPS_COUNT];
+    unsigned int num_short_term_ref_pic_sets, sps_id;
 
-    bs_skip_u( bs, 4 ); // sps_video_parameter_set_id
+    memset( sps, 0, sizeof(*sps) );
+    sps->vps_id = bs_read_u( bs, 4 ); // sps_video_parameter_set_id
 
     sps_max_sub_layers_minus1 = bs_read_u ( bs, 3 );
+    // 7 is reserved, and one past the per sub-layer arrays
+    if (sps_max_sub_layers_minus1 >= HEVC_MAX_SUB_LAYERS)
+        return -1;
+    sps->max_sub_layers = sps_max_sub_layers_minus1 + 1;
     config->numTemporalLayers = MAX(config->numTemporalLayers,
                                     sps_max_sub_layers_minus1 + 1);
 
@@ -373,34 +405,54 @@ static int hevc_parse_sps( bs_t *bs, HEVCDecoderConfigurationRecord *config )
 
     hevc_parse_ptl( bs, config, sps_max_sub_layers_minus1);
 
-    bs_read_ue( bs );// sps_seq_parameter_set_id
+    sps_id = bs_read_ue( bs );// sps_seq_parameter_set_id
+    if (sps_id >= HEVC_MAX_SPS_COUNT)
+        return -1;
+    sps->sps_id = sps_id;
 
     config->chromaFormat = bs_read_ue( bs );
+    sps->chroma_format_idc = config->chromaFormat;
 
     if (config->chromaFormat == 3)
-        bs_skip_u1( bs ); // separate_colour_plane_flag
+        sps->separate_colour_plane_flag = bs_read_u1( bs );
 
-    bs_read_ue(bs); // pic_width_in_luma_samples
-    bs_read_ue(bs); // pic_height_in_luma_samples
+    sps->pic_width_in_luma_samples  = bs_read_ue(bs);
+    sps->pic_height_in_luma_samples = bs_read_ue(bs);
 
     if (bs_read_u1(bs)) {        // conformance_window_flag
-        bs_read_ue(bs); // conf_win_left_offset
-        bs_read_ue(bs); // conf_win_right_offset
-        bs_read_ue(bs); // conf_win_top_offset
-        bs_read_ue(bs); // conf_win_bottom_offset
+        sps->conf_win_left_offset   = bs_read_ue(bs);
+        sps->conf_win_right_offset  = bs_read_ue(bs);
+        sps->conf_win_top_offset    = bs_read_ue(bs);
+        sps->conf_win_bottom_offset = bs_read_ue(bs);
     }
+    hevc_sps_crop(sps);
 
     config->bitDepthLumaMinus8          = bs_read_ue(bs);
     config->bitDepthChromaMinus8        = bs_read_ue(bs);
     log2_max_pic_order_cnt_lsb_minus4 = bs_read_ue(bs);
+    if (log2_max_pic_order_cnt_lsb_minus4 > 12)
+        return -1;
+    sps->log2_max_pic_order_cnt_lsb = log2_max_pic_order_cnt_lsb_minus4 + 4;
 
-    /* sps_sub_layer_ordering_info_present_flag */
+    /* sps_sub_layer_ordering_info_present_flag, the lower sub-layers
+     * take the values of the highest one when it's 0 */
     i = bs_read_u1(bs) ? 0 : sps_max_sub_layers_minus1;
     for (; i <= sps_max_sub_layers_minus1; i++)
-        skip_sub_layer_ordering_info(bs);
+        if (parse_sub_layer_ordering_info(bs, sps, i) < 0)
+            return -1;
+    for (i = 0; i < sps_max_sub_layers_minus1; i++) {
+        if (sps->max_dec_pic_buffering[i])
+            continue;
+        sps->max_dec_pic_buffering[i]      = sps->max_dec_pic_buffering[sps_max_sub_layers_minus1];
+        sps->max_num_reorder_pics[i]       = sps->max_num_reorder_pics[sps_max_sub_layers_minus1];
+        sps->max_latency_increase_plus1[i] = sps->max_latency_increase_plus1[sps_max_sub_layers_minus1];
+    }
 
-    bs_read_ue(bs); // log2_min_luma_coding_block_size_minus3
-    bs_read_ue(bs); // log2_diff_max_min_luma_coding_block_size
+    sps->log2_min_cb_size = bs_read_ue(bs) + 3; // log2_min_luma_coding_block_size_minus3
+    sps->log2_ctb_size    = sps->log2_min_cb_size +
+                            bs_read_ue(bs);     // log2_diff_max_min_luma_coding_block_size
+    if (sps->log2_ctb_size > 6 || !sps->pic_width_in_luma_samples || !sps->pic_height_in_luma_samples)
+        return -1;
     bs_read_ue(bs); // log2_min_transform_block_size_minus2
     bs_read_ue(bs); // log2_diff_max_min_transform_block_size
     bs_read_ue(bs); // max_transform_hierarchy_depth_inter
@@ -411,7 +463,7 @@ static int hevc_parse_sps( bs_t *bs, HEVCDecoderConfigurationRecord *config )
         skip_scaling_list_data(bs);
 
     bs_skip_u1(bs); // amp_enabled_flag
-    bs_skip_u1(bs); // sample_adaptive_offset_enabled_flag
+    sps->sample_adaptive_offset_enabled_flag = bs_read_u1(bs);
 
     if (bs_read_u1(bs)) {           // pcm_enabled_flag
         bs_skip_u         (bs, 4); // pcm_sample_bit_depth_luma_minus1
@@ -424,17 +476,20 @@ static int hevc_parse_sps( bs_t *bs, HEVCDecoderConfigurationRecord *config )
     num_short_term_ref_pic_sets = bs_read_ue(bs);
     if (num_short_term_ref_pic_sets > HEVC_MAX_SHORT_TERM_RPS_COUNT)
         return -1;
+    sps->num_short_term_ref_pic_sets = num_short_term_ref_pic_sets;
 
     for (i = 0; i < num_short_term_ref_pic_sets; i++) {
-        int ret = parse_rps(bs, i, num_short_term_ref_pic_sets, num_delta_pocs);
+        int ret = parse_rps(bs, i, num_short_term_ref_pic_sets, sps->num_delta_pocs);
         if (ret < 0)
             return ret;
     }
 
-    if (bs_read_u1(bs)) {                               // long_term_ref_pics_present_flag
+    sps->long_term_ref_pics_present_flag = bs_read_u1(bs);
+    if (sps->long_term_ref_pics_present_flag) {
         unsigned num_long_term_ref_pics_sps = bs_read_ue(bs);
         if (num_long_term_ref_pics_sps > 31U)
             return -1;
+        sps->num_long_term_ref_pics_sps = num_long_term_ref_pics_sps;
         for (i = 0; i < num_long_term_ref_pics_sps; i++) { // num_long_term_ref_pics_sps
             int len = MIN(log2_max_pic_order_cnt_lsb_minus4 + 4, 16);
             bs_skip_u (bs, len); // lt_ref_pic_poc_lsb_sps[i]
@@ -442,80 +497,388 @@ static int hevc_parse_sps( bs_t *bs, HEVCDecoderConfigurationRecord *config )
         }
     }
 
-    bs_skip_u1(bs); // sps_temporal_mvp_enabled_flag
+    sps->sps_temporal_mvp_enabled_flag = bs_read_u1(bs);
     bs_skip_u1(bs); // strong_intra_smoothing_enabled_flag
 
-    if (bs_read_u1(bs)) // vui_parameters_present_flag
-        hevc_parse_vui(bs, config, sps_max_sub_layers_minus1);
+    if (bs_read_u1(bs) && // vui_parameters_present_flag
+        hevc_parse_vui(bs, config, sps, sps_max_sub_layers_minus1) < 0)
+        return -1;
 
-    /* nothing useful for config past this point */
+    /* nothing useful for config or slice headers past this point */
     return 0;
 }
 
-int hevc_parse_nalu( const uint8_t *data_in, int size, NalUnit *nalu_list )
+void hevc_sps_patch_init( HevcSpsPatch *patch )
+{
+    memset( patch, 0, sizeof(*patch) );
+    patch->max_num_reorder_pics = -1;
+    patch->max_latency_increase_plus1 = -1;
+}
+
+/*
+ * The SPS is parsed from its RBSP while a second reader trails behind it:
+ * the bits between the two are copied out as they are, except where a
+ * field is replaced, then the trailing reader skips them instead.
+ */
+typedef struct SpsRewriter {
+    bs_t in;
+    bs_t copy;  // first bit not written out yet
+    bw_t out;
+} SpsRewriter;
+
+static int64_t rw_pos( bs_t *b )
+{
+    return (int64_t)(b->p - b->start) * 8 + 8 - b->bits_left;
+}
+
+static void rw_copy_to( SpsRewriter *rw, int64_t end )
+{
+    int64_t n = end - rw_pos( &rw->copy );
+
+    for (; n > 0; n -= 32) {
+        int k = MIN(n, 32);
+        bw_write_u( &rw->out, k, bs_read_u( &rw->copy, k ) );
+    }
+}
+
+/* write out the bits parsed so far */
+static void rw_sync( SpsRewriter *rw )
+{
+    rw_copy_to( rw, rw_pos( &rw->in ) );
+}
+
+/* the bits parsed since the last sync were replaced */
+static void rw_drop( SpsRewriter *rw )
+{
+    bs_skip_u( &rw->copy, rw_pos( &rw->in ) - rw_pos( &rw->copy ) );
+}
+
+static void rw_write_timing( bw_t *out, const HevcSpsPatch *patch )
+{
+    bw_write_u1( out, 1 ); // vui_timing_info_present_flag
+    bw_write_u ( out, 32, patch->num_units_in_tick );
+    bw_write_u ( out, 32, patch->time_scale );
+}
+
+/* with the values inferred when it is absent */
+static void rw_write_restriction( bw_t *out )
+{
+    bw_write_u1( out, 1 ); // bitstream_restriction_flag
+    bw_write_u ( out, 3, 2 ); // tiles_fixed_structure, motion_vectors_over_pic_boundaries, restricted_ref_pic_lists
+    bw_write_ue( out, 0 ); // min_spatial_segmentation_idc
+    bw_write_ue( out, 2 ); // max_bytes_per_pic_denom
+    bw_write_ue( out, 1 ); // max_bits_per_min_cu_denom
+    bw_write_ue( out, 15 ); // log2_max_mv_length_horizontal
+    bw_write_ue( out, 15 ); // log2_max_mv_length_vertical
+}
+
+static int rw_vui( SpsRewriter *rw, const HevcSpsPatch *patch, unsigned int max_sub_layers_minus1 )
+{
+    bs_t *bs = &rw->in;
+    int timing = patch->num_units_in_tick && patch->time_scale;
+    uint8_t fixed_pic_rate;
+
+    if (bs_read_u1(bs))              // aspect_ratio_info_present_flag
+        if (bs_read_u(bs, 8) == 255) // aspect_ratio_idc
+            bs_skip_u(bs, 32);
+
+    if (bs_read_u1(bs))  // overscan_info_present_flag
+        bs_skip_u1(bs);
+
+    if (bs_read_u1(bs)) {  // video_signal_type_present_flag
+        bs_skip_u(bs, 4);
+        if (bs_read_u1(bs)) // colour_description_present_flag
+            bs_skip_u(bs, 24);
+    }
+
+    if (bs_read_u1(bs)) {        // chroma_loc_info_present_flag
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+    }
+
+    bs_skip_u(bs, 3);
+
+    if (bs_read_u1(bs)) {        // default_display_window_flag
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+    }
+
+    rw_sync( rw );
+    if (bs_read_u1(bs)) { // vui_timing_info_present_flag
+        bs_skip_u(bs, 64);
+        if (timing) {
+            rw_drop( rw );
+            rw_write_timing( &rw->out, patch );
+        }
+        if (bs_read_u1(bs))          // poc_proportional_to_timing_flag
+            bs_read_ue(bs);
+        if (bs_read_u1(bs) && // vui_hrd_parameters_present_flag
+            parse_hrd_parameters(bs, 1, max_sub_layers_minus1, &fixed_pic_rate) < 0)
+            return -1;
+    } else if (timing) {
+        rw_drop( rw );
+        rw_write_timing( &rw->out, patch );
+        bw_write_u( &rw->out, 2, 0 ); // poc_proportional_to_timing_flag, vui_hrd_parameters_present_flag
+    }
+
+    rw_sync( rw );
+    if (bs_read_u1(bs)) { // bitstream_restriction_flag
+        bs_skip_u(bs, 3);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+    } else if (patch->bitstream_restriction) {
+        rw_drop( rw );
+        rw_write_restriction( &rw->out );
+    }
+
+    return 0;
+}
+
+/* a VUI with nothing but what the patch adds */
+static void rw_write_vui( bw_t *out, const HevcSpsPatch *patch )
+{
+    // aspect ratio, overscan, video signal, chroma loc, neutral_chroma,
+    // field_seq, frame_field_info, default display window
+    bw_write_u( out, 8, 0 );
+    if (patch->num_units_in_tick && patch->time_scale) {
+        rw_write_timing( out, patch );
+        bw_write_u( out, 2, 0 );
+    } else {
+        bw_write_u1( out, 0 );
+    }
+    if (patch->bitstream_restriction)
+        rw_write_restriction( out );
+    else
+        bw_write_u1( out, 0 );
+}
+
+int hevc_rewrite_sps( const uint8_t *nal, int size, const HevcSpsPatch *patch, uint8_t *out, int out_size )
+{
+    HEVCDecoderConfigurationRecord config; // scratch for the ptl parser
+    uint8_t num_delta_pocs[HEVC_MAX_SHORT_TERM_RPS_COUNT + 1];
+    unsigned int i, n, max_sub_layers_minus1, log2_max_poc_lsb;
+    SpsRewriter rw;
+    bs_t *bs = &rw.in;
+    int64_t payload_bits;
+    uint8_t *rbsp;
+    int len, ret = -1;
+
+    if (!nal || size <= 2 || !patch || !out || ((nal[0] >> 1) & 0x3f) != HEVC_NAL_SPS)
+        return -1;
+    if (!(rbsp = malloc(size)))
+        return -1;
+
+    // the payload ends before the rbsp_stop_one_bit
+    len = hevc_extract_rbsp( nal, size, rbsp );
+    while (len > 2 && !rbsp[len - 1])
+        len--;
+    if (len <= 2)
+        goto out;
+    payload_bits = (int64_t)(len - 2) * 8 - __builtin_ctz(rbsp[len - 1]) - 1;
+
+    bs_init( &rw.in, rbsp + 2, len - 2 );
+    bs_init( &rw.copy, rbsp + 2, len - 2 );
+    bw_init_nal( &rw.out, out, out_size );
+    bw_write_u( &rw.out, 16, (nal[0] << 8) | nal[1] );
+
+    bs_skip_u(bs, 4); // sps_video_parameter_set_id
+    max_sub_layers_minus1 = bs_read_u(bs, 3);
+    bs_skip_u1(bs); // sps_temporal_id_nesting_flag
+    memset( &config, 0, sizeof(config) );
+    hevc_parse_ptl( bs, &config, max_sub_layers_minus1 );
+    bs_read_ue(bs); // sps_seq_parameter_set_id
+    if (bs_read_ue(bs) == 3) // chroma_format_idc
+        bs_skip_u1(bs);
+    bs_read_ue(bs); // pic_width_in_luma_samples
+    bs_read_ue(bs); // pic_height_in_luma_samples
+    if (bs_read_u1(bs)) { // conformance_window_flag
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+    }
+    bs_read_ue(bs); // bit_depth_luma_minus8
+    bs_read_ue(bs); // bit_depth_chroma_minus8
+    log2_max_poc_lsb = bs_read_ue(bs) + 4;
+    if (log2_max_poc_lsb > 16)
+        goto out;
+
+    i = bs_read_u1(bs) ? 0 : max_sub_layers_minus1;
+    for (; i <= max_sub_layers_minus1; i++) {
+        unsigned int max_dec_pic_buffering_minus1, max_num_reorder_pics, max_latency_increase_plus1;
+
+        rw_sync( &rw );
+        max_dec_pic_buffering_minus1 = bs_read_ue(bs);
+        max_num_reorder_pics         = bs_read_ue(bs);
+        max_latency_increase_plus1   = bs_read_ue(bs);
+        rw_drop( &rw );
+        // the reorder depth can't exceed the DPB
+        if (patch->max_num_reorder_pics >= 0)
+            max_num_reorder_pics = MIN((unsigned)patch->max_num_reorder_pics, max_dec_pic_buffering_minus1);
+        if (patch->max_latency_increase_plus1 >= 0)
+            max_latency_increase_plus1 = patch->max_latency_increase_plus1;
+        bw_write_ue( &rw.out, max_dec_pic_buffering_minus1 );
+        bw_write_ue( &rw.out, max_num_reorder_pics );
+        bw_write_ue( &rw.out, max_latency_increase_plus1 );
+    }
+
+    for (i = 0; i < 6; i++)
+        bs_read_ue(bs); // coding and transform block sizes, hierarchy depths
+    if (bs_read_u1(bs) && // scaling_list_enabled_flag
+        bs_read_u1(bs))   // sps_scaling_list_data_present_flag
+        skip_scaling_list_data(bs);
+    bs_skip_u(bs, 2); // amp_enabled_flag, sample_adaptive_offset_enabled_flag
+    if (bs_read_u1(bs)) { // pcm_enabled_flag
+        bs_skip_u(bs, 8);
+        bs_read_ue(bs);
+        bs_read_ue(bs);
+        bs_skip_u1(bs);
+    }
+
+    n = bs_read_ue(bs); // num_short_term_ref_pic_sets
+    if (n > HEVC_MAX_SHORT_TERM_RPS_COUNT)
+        goto out;
+    for (i = 0; i < n; i++)
+        if (parse_rps(bs, i, n, num_delta_pocs) < 0)
+            goto out;
+    if (bs_read_u1(bs)) { // long_term_ref_pics_present_flag
+        n = bs_read_ue(bs);
+        if (n > 31)
+            goto out;
+        bs_skip_u(bs, n * (log2_max_poc_lsb + 1));
+    }
+    bs_skip_u(bs, 2); // sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
+
+    rw_sync( &rw );
+    if (bs_read_u1(bs)) { // vui_parameters_present_flag
+        if (rw_vui( &rw, patch, max_sub_layers_minus1 ) < 0)
+            goto out;
+    } else if ((patch->num_units_in_tick && patch->time_scale) || patch->bitstream_restriction) {
+        rw_drop( &rw );
+        bw_write_u1( &rw.out, 1 );
+        rw_write_vui( &rw.out, patch );
+    }
+    if (rw_pos( bs ) > payload_bits)
+        goto out;
+
+    // the extensions go as they are
+    rw_copy_to( &rw, payload_bits );
+    bw_write_trailing_bits( &rw.out );
+    ret = bw_flush( &rw.out );
+
+out:
+    free( rbsp );
+    return ret;
+}
+
+int hevc_next_nalu( const uint8_t **pos, const uint8_t *end, NalUnit *nalu )
+{
+    const uint8_t *nal_start = *pos, *nal_end = NULL;
+
+    while (nal_start < end && !*(nal_start++));
+    if (nal_start == end)
+        return 0;
+
+    nal_end = hevc_find_startcode(nal_start, end);
+    nalu->nalu_type = (nal_start[0] >> 1) & 0x3f;
+    nalu->size = nal_end - nal_start;
+    nalu->addr = nal_start;
+    *pos = nal_end;
+    return 1;
+}
+
+int hevc_parse_nalu( const uint8_t *data_in, int size, NalUnit *nalu_list, int max_nalu )
 {
     int i = 0;
     const uint8_t *p = data_in;
     const uint8_t *end = p + size;
-    const uint8_t *nal_start = NULL, *nal_end = NULL;
-    uint8_t nalu_type = 0;
+    NalUnit nalu;
 
-    nal_start = hevc_find_startcode(p, end);
-    for (;;) {
-        while (nal_start < end && !*(nal_start++));
-        if (nal_start == end)
-            break;
+    if ( !data_in || size <= 0 )
+        return 0;
 
-        nal_end = hevc_find_startcode(nal_start, end);
-        nalu_type = (nal_start[4] >> 1) & 0x3f;
-        nalu_list[i].nalu_type = nalu_type;
-        nalu_list[i].size = nal_end - nal_start;
-        nalu_list[i++].addr = nal_start;
-        nal_start = nal_end;
+    p = hevc_find_startcode(p, end);
+    while ( hevc_next_nalu( &p, end, &nalu ) ) {
+        if ( i < max_nalu )
+            nalu_list[i] = nalu;
+        i++;
     }
 
     return i;
 }
 
-static uint8_t *nalu_extract_rbsp(const uint8_t *src, uint32_t src_len,
-                                      uint32_t *dst_len)
+void hevc_nalu_list_init( NalUnitList *list )
 {
-    uint8_t *dst;
-    uint32_t i, len;
+    memset( list, 0, sizeof(*list) );
+}
 
-    dst = malloc(src_len + AV_INPUT_BUFFER_PADDING_SIZE);
-    if (!dst)
-        return NULL;
+void hevc_nalu_list_free( NalUnitList *list )
+{
+    free( list->nalu );
+    hevc_nalu_list_init( list );
+}
 
-    /* NAL unit header (2 bytes) */
-    i = len = 0;
-    while (i < 2 && i < src_len)
-        dst[len++] = src[i++];
+int hevc_nalu_list_parse( NalUnitList *list, const uint8_t *data_in, int size )
+{
+    int ret = hevc_parse_nalu( data_in, size, list->nalu, list->capacity );
+
+    if ( ret > list->capacity ) {
+        // grow with headroom so a slightly busier buffer doesn't rescan again
+        int capacity = MAX( ret + ret / 2, 64 );
+        NalUnit *nalu = realloc( list->nalu, capacity * sizeof(NalUnit) );
+
+        if ( !nalu )
+            return -1;
+        list->nalu = nalu;
+        list->capacity = capacity;
+        ret = hevc_parse_nalu( data_in, size, list->nalu, list->capacity );
+    }
 
-    while (i + 2 < src_len)
-        if (!src[i] && !src[i + 1] && src[i + 2] == 3) {
-            dst[len++] = src[i++];
-            dst[len++] = src[i++];
-            i++; // remove emulation_prevention_three_byte
-        } else
-            dst[len++] = src[i++];
+    list->count = ret;
+    return ret;
+}
+
+int hevc_extract_rbsp( const uint8_t *src, int src_len, uint8_t *dst )
+{
+    int len;
+
+    /* NAL unit header (2 bytes) */
+    for (len = 0; len < 2 && len < src_len; len++)
+        dst[len] = src[len];
 
-    while (i < src_len)
-        dst[len++] = src[i++];
+    return len + epb_remove( src + len, src_len - len, dst + len );
+}
 
-    *dst_len = len;
-    return dst;
+int hevc_insert_epb( const uint8_t *rbsp, int rbsp_len, uint8_t *dst )
+{
+    return epb_insert( rbsp, rbsp_len, dst );
 }
 
 static int hevc_parse_pps(bs_t *bs,
-                          HEVCDecoderConfigurationRecord *config)
+                          HEVCDecoderConfigurationRecord *config,
+                          HEVCPPS *pps)
 {
     uint8_t tiles_enabled_flag, entropy_coding_sync_enabled_flag;
+    unsigned int pps_id, sps_id;
 
-    bs_read_ue(bs); // pps_pic_parameter_set_id
-    bs_read_ue(bs); // pps_seq_parameter_set_id
+    memset( pps, 0, sizeof(*pps) );
+    pps_id = bs_read_ue(bs); // pps_pic_parameter_set_id
+    sps_id = bs_read_ue(bs); // pps_seq_parameter_set_id
+    if (pps_id >= HEVC_MAX_PPS_COUNT || sps_id >= HEVC_MAX_SPS_COUNT)
+        return -1;
+    pps->pps_id = pps_id;
+    pps->sps_id = sps_id;
 
-    bs_skip_u(bs, 7);
+    pps->dependent_slice_segments_enabled_flag = bs_read_u1(bs);
+    pps->output_flag_present_flag              = bs_read_u1(bs);
+    pps->num_extra_slice_header_bits           = bs_read_u(bs, 3);
+    pps->sign_data_hiding_enabled_flag         = bs_read_u1(bs);
+    pps->cabac_init_present_flag               = bs_read_u1(bs);
 
     bs_read_ue(bs); // num_ref_idx_l0_default_active_minus1
     bs_read_ue(bs); // num_ref_idx_l1_default_active_minus1
@@ -533,6 +896,8 @@ static int hevc_parse_pps(bs_t *bs,
 
     tiles_enabled_flag               = bs_read_u1(bs);
     entropy_coding_sync_enabled_flag = bs_read_u1(bs);
+    pps->tiles_enabled_flag               = tiles_enabled_flag;
+    pps->entropy_coding_sync_enabled_flag = entropy_coding_sync_enabled_flag;
 
     if (entropy_coding_sync_enabled_flag && tiles_enabled_flag)
         config->parallelismType = 0; // mixed-type parallel decoding
@@ -547,77 +912,653 @@ static int hevc_parse_pps(bs_t *bs,
     return 0;
 }
 
+static void hvcc_init( HEVCDecoderConfigurationRecord *config )
+{
+    memset( config, 0, sizeof(*config) );
+    config->configurationVersion = 1;
+    config->lengthSizeMinusOne   = 3; // 4 bytes
+
+    /*
+     * The following fields have all their valid bits set by default,
+     * the ProfileTierLevel parsing code will unset them when needed.
+     */
+    config->general_profile_compatibility_flags = 0xffffffff;
+    config->general_constraint_indicator_flags  = 0xffffffffffff;
+
+    /*
+     * Initialize this field with an invalid value which can be used to detect
+     * whether we didn't see any VUI (in which case it should be reset to zero).
+     */
+    config->min_spatial_segmentation_idc = MAX_SPATIAL_SEGMENTATION + 1;
+}
+
+static void hvcc_finish( HEVCDecoderConfigurationRecord *config )
+{
+    /*
+     * We need at least one of each: VPS, SPS and PPS to get a record that
+     * means anything, the caller checks numOfArrays.
+     */
+    if ( config->min_spatial_segmentation_idc > MAX_SPATIAL_SEGMENTATION )
+        config->min_spatial_segmentation_idc = 0;
+
+    /*
+     * parallelismType indicates the type of parallelism that is used to meet
+     * the restrictions imposed by min_spatial_segmentation_idc when the value
+     * of min_spatial_segmentation_idc is greater than 0.
+     */
+    if ( !config->min_spatial_segmentation_idc )
+        config->parallelismType = 0;
+}
+
+/*
+ * Reference a parameter set NAL from the record, the bytes stay where they
+ * are. The array table is allocated once, sized for the most parameter sets
+ * a stream can have; repeats of an identical NAL are only referenced once.
+ */
+static int hvcc_add_nal( HEVCDecoderConfigurationRecord *config, const uint8_t *nal, int size, uint8_t type )
+{
+    HVCCNALUnitArray *array = NULL;
+    int i, j, used = 0;
+
+    if ( size > 0xffff )
+        return -1;
+
+    if ( !config->array ) {
+        // arrays, then one length and one pointer per NAL unit
+        size_t bytes = 3 * sizeof(HVCCNALUnitArray) +
+                       HVCC_MAX_NALUS * (sizeof(uint8_t *) + sizeof(uint16_t));
+        config->array = calloc( 1, bytes );
+        if ( !config->array )
+            return -1;
+    }
+
+    for ( i = 0; i < config->numOfArrays; i++ ) {
+        for ( j = 0; j < config->array[i].numNalus; j++ ) {
+            if ( config->array[i].nalUnitLength[j] == size &&
+                 !memcmp( config->array[i].nalUnit[j], nal, size ) )
+                return 0;
+        }
+        if ( config->array[i].NAL_unit_type == type )
+            array = &config->array[i];
+        used += config->array[i].numNalus;
+    }
+
+    if ( used >= HVCC_MAX_NALUS )
+        return -1;
+
+    if ( !array ) {
+        uint8_t **nalus = (uint8_t **)(config->array + 3);
+
+        if ( config->numOfArrays >= 3 )
+            return -1;
+
+        /* each array gets a slice of the pointer and length tables big enough
+         * for its type, VPS, SPS then PPS in the order first seen */
+        array = &config->array[config->numOfArrays++];
+        array->NAL_unit_type      = type;
+        array->array_completeness = 1;
+        for ( i = 0, j = 0; i < config->numOfArrays - 1; i++ )
+            j += config->array[i].NAL_unit_type == HEVC_NAL_PPS ? HEVC_MAX_PPS_COUNT : HEVC_MAX_VPS_COUNT;
+        array->nalUnit       = nalus + j;
+        array->nalUnitLength = (uint16_t *)(nalus + HVCC_MAX_NALUS) + j;
+    }
+
+    if ( array->numNalus >= (type == HEVC_NAL_PPS ? HEVC_MAX_PPS_COUNT : HEVC_MAX_VPS_COUNT) )
+        return -1;
+
+    array->nalUnit[array->numNalus]       = (uint8_t *)nal;
+    array->nalUnitLength[array->numNalus] = size;
+    array->numNalus++;
+    return 0;
+}
+
+void hevc_config_free( HEVCDecoderConfigurationRecord *config )
+{
+    if ( !config )
+        return;
+
+    free( config->array );
+    config->array = NULL;
+    config->numOfArrays = 0;
+}
+
+/* parse one VPS/SPS/PPS into config and list it, other types are ignored */
+static int hvcc_add_param_set( HEVCDecoderConfigurationRecord *config, const NalUnit *nalu )
+{
+    HEVCSPS sps;
+    HEVCPPS pps;
+    bs_t bs;
+    int res = 0;
+
+    if ( nalu->nalu_type != HEVC_NAL_VPS &&
+         nalu->nalu_type != HEVC_NAL_SPS &&
+         nalu->nalu_type != HEVC_NAL_PPS ) {
+        return 0;
+    }
+
+    if ( nalu->size <= 2 ) {
+        return -1;
+    }
+
+    // skip nal unit header,2bytes, emulation prevention is handled by the reader
+    bs_init_nal( &bs, nalu->addr + 2, nalu->size - 2 );
+
+    switch( nalu->nalu_type ) {
+    case HEVC_NAL_VPS:
+        res = hevc_parse_vps( &bs, config );
+        break;
+    case HEVC_NAL_SPS:
+        res = hevc_parse_sps( &bs, config, &sps );
+        break;
+    case HEVC_NAL_PPS:
+        res = hevc_parse_pps( &bs, config, &pps );
+        break;
+    default:
+        break;
+    }
+
+    if ( res < 0 ) {
+        return -1;
+    }
+    return hvcc_add_nal( config, nalu->addr, nalu->size, nalu->nalu_type );
+}
+
 int hevc_get_config( const uint8_t *data_in, int size, HEVCDecoderConfigurationRecord *config )
 {
-    int ret = 0, i = 0;
-    NalUnit nalu_list[NALU_MAX];
+    const uint8_t *p = NULL, *end = NULL;
+    NalUnit nalu;
+    int found = 0;
+
+    if ( !config ) {
+        return -1;
+    }
+    // the error path frees the arrays, they have to be there first
+    hvcc_init( config );
+    if ( !data_in || size <= 0 ) {
+        goto err;
+    }
+
+    end = data_in + size;
+    p = hevc_find_startcode( data_in, end );
+    while ( hevc_next_nalu( &p, end, &nalu ) ) {
+        found++;
+        if ( hvcc_add_param_set( config, &nalu ) < 0 ) {
+            goto err;
+        }
+    }
 
-    if ( !data_in || !config ) {
+    if ( !found ) {
         goto err;
     }
-    
-    memset( nalu_list, 0, sizeof(nalu_list) );
-    ret = hevc_parse_nalu( data_in, size, nalu_list );
-    if ( ret <= 0 ) {
-        goto err; 
+
+    hvcc_finish( config );
+    return 0;
+
+err:
+    hevc_config_free( config );
+    return -1;
+}
+
+#define PUT_U8( p, v )  do { *(p)++ = (uint8_t)(v); } while (0)
+#define PUT_BE16( p, v ) do { PUT_U8( p, (v) >> 8 ); PUT_U8( p, v ); } while (0)
+#define PUT_BE32( p, v ) do { PUT_BE16( p, (v) >> 16 ); PUT_BE16( p, v ); } while (0)
+#define GET_BE16( p )   (((p)[0] << 8) | (p)[1])
+#define GET_BE32( p )   (((uint32_t)GET_BE16( p ) << 16) | GET_BE16( (p) + 2 ))
+
+int hevc_config_size( const HEVCDecoderConfigurationRecord *config )
+{
+    int i, j, size = HVCC_HEADER_SIZE;
+
+    for ( i = 0; i < config->numOfArrays; i++ ) {
+        size += 3;
+        for ( j = 0; j < config->array[i].numNalus; j++ )
+            size += 2 + config->array[i].nalUnitLength[j];
     }
+    return size;
+}
 
-    for ( i=0; i<ret; i++ ) {
-        uint32_t rbsp_size = 0;
-        uint8_t *rbsp_buf = NULL;
-        bs_t *bs = NULL;
+int hevc_config_write( const HEVCDecoderConfigurationRecord *config, uint8_t *out, int size )
+{
+    uint8_t *p = out;
+    int i, j;
 
-        if ( nalu_list[i].nalu_type != HEVC_NAL_VPS &&
-             nalu_list[i].nalu_type != HEVC_NAL_SPS &&
-             nalu_list[i].nalu_type != HEVC_NAL_PPS ) {
-            continue;
-        }
+    if ( !config || !out || size < hevc_config_size( config ) )
+        return -1;
 
-        rbsp_buf = nalu_extract_rbsp( nalu_list[i].addr, nalu_list[i].size, &rbsp_size );
-        if ( !rbsp_buf || rbsp_size <= 0 ) {
-            goto err;
+    PUT_U8( p, config->configurationVersion );
+    PUT_U8( p, config->general_profile_space << 6 |
+               config->general_tier_flag     << 5 |
+               config->general_profile_idc );
+    PUT_BE32( p, config->general_profile_compatibility_flags );
+    PUT_BE32( p, (uint32_t)(config->general_constraint_indicator_flags >> 16) );
+    PUT_BE16( p, (uint16_t)config->general_constraint_indicator_flags );
+    PUT_U8( p, config->general_level_idc );
+    PUT_BE16( p, 0xf000 | config->min_spatial_segmentation_idc );  // reserved '1111'b
+    PUT_U8( p, 0xfc | config->parallelismType );                   // reserved '111111'b
+    PUT_U8( p, 0xfc | config->chromaFormat );
+    PUT_U8( p, 0xf8 | config->bitDepthLumaMinus8 );                // reserved '11111'b
+    PUT_U8( p, 0xf8 | config->bitDepthChromaMinus8 );
+    PUT_BE16( p, config->avgFrameRate );
+    PUT_U8( p, config->constantFrameRate << 6 |
+               config->numTemporalLayers << 3 |
+               config->temporalIdNested  << 2 |
+               config->lengthSizeMinusOne );
+    PUT_U8( p, config->numOfArrays );
+
+    for ( i = 0; i < config->numOfArrays; i++ ) {
+        const HVCCNALUnitArray *array = &config->array[i];
+
+        PUT_U8( p, array->array_completeness << 7 | (array->NAL_unit_type & 0x3f) );
+        PUT_BE16( p, array->numNalus );
+        for ( j = 0; j < array->numNalus; j++ ) {
+            PUT_BE16( p, array->nalUnitLength[j] );
+            memcpy( p, array->nalUnit[j], array->nalUnitLength[j] );
+            p += array->nalUnitLength[j];
         }
+    }
+
+    return p - out;
+}
 
-        rbsp_buf += 2;// skip nal unit header,2bytes
-        bs = bs_new( rbsp_buf, rbsp_size );
-        if ( !bs ) {
+int hevc_config_parse( const uint8_t *data, int size, HEVCDecoderConfigurationRecord *config )
+{
+    const uint8_t *p = data, *end = data + size;
+    int i, j, num_arrays;
+
+    if ( !data || !config || size < HVCC_HEADER_SIZE )
+        return -1;
+
+    memset( config, 0, sizeof(*config) );
+    config->configurationVersion                = p[0];
+    config->general_profile_space               = p[1] >> 6;
+    config->general_tier_flag                   = (p[1] >> 5) & 0x01;
+    config->general_profile_idc                 = p[1] & 0x1f;
+    config->general_profile_compatibility_flags = GET_BE32( p + 2 );
+    config->general_constraint_indicator_flags  = (uint64_t)GET_BE32( p + 6 ) << 16 | GET_BE16( p + 10 );
+    config->general_level_idc                   = p[12];
+    config->min_spatial_segmentation_idc        = GET_BE16( p + 13 ) & 0x0fff;
+    config->parallelismType                     = p[15] & 0x03;
+    config->chromaFormat                        = p[16] & 0x03;
+    config->bitDepthLumaMinus8                  = p[17] & 0x07;
+    config->bitDepthChromaMinus8                = p[18] & 0x07;
+    config->avgFrameRate                        = GET_BE16( p + 19 );
+    config->constantFrameRate                   = p[21] >> 6;
+    config->numTemporalLayers                   = (p[21] >> 3) & 0x07;
+    config->temporalIdNested                    = (p[21] >> 2) & 0x01;
+    config->lengthSizeMinusOne                  = p[21] & 0x03;
+    num_arrays                                  = p[22];
+    p += HVCC_HEADER_SIZE;
+
+    if ( config->configurationVersion != 1 )
+        return -1;
+
+    for ( i = 0; i < num_arrays; i++ ) {
+        uint8_t type;
+        int num_nalus;
+
+        if ( end - p < 3 )
             goto err;
-        }
+        type      = p[0] & 0x3f;
+        num_nalus = GET_BE16( p + 1 );
+        p += 3;
+
+        for ( j = 0; j < num_nalus; j++ ) {
+            int len;
 
-        switch( nalu_list[i].nalu_type ) {
-        case HEVC_NAL_VPS:
-            ret = hevc_parse_vps( bs, config );
-            if ( ret < 0 ) {
-                free( rbsp_buf );
+            if ( end - p < 2 )
                 goto err;
-            }
-            free( rbsp_buf );
-            break;
-        case HEVC_NAL_SPS:
-            ret = hevc_parse_sps( bs, config );
-            if ( ret < 0 ) {
-                free( rbsp_buf );
+            len = GET_BE16( p );
+            p += 2;
+            if ( end - p < len )
                 goto err;
-            }
-            free( rbsp_buf );
-            break;
-        case HEVC_NAL_PPS:
-            ret = hevc_parse_pps( bs, config );
-            if ( ret < 0 ) {
-                free( rbsp_buf );
+            // only parameter sets are kept, anything else is skipped
+            if ( (type == HEVC_NAL_VPS || type == HEVC_NAL_SPS || type == HEVC_NAL_PPS) &&
+                 hvcc_add_nal( config, p, len, type ) < 0 )
                 goto err;
-            }
-            free( rbsp_buf );
-            break;
-        default:
-            free( rbsp_buf );
-            break;
+            p += len;
         }
     }
 
-    return 0;
+    return p - data;
 
 err:
+    hevc_config_free( config );
     return -1;
 }
 
+
+void hevc_ps_init( HEVCParamSets *ps )
+{
+    memset( ps, 0, sizeof(*ps) );
+}
+
+void hevc_ps_free( HEVCParamSets *ps )
+{
+    int i;
+
+    for ( i = 0; i < HEVC_MAX_VPS_COUNT; i++ )
+        free( ps->vps_nal[i].data );
+    for ( i = 0; i < HEVC_MAX_SPS_COUNT; i++ ) {
+        free( ps->sps[i] );
+        free( ps->sps_nal[i].data );
+    }
+    for ( i = 0; i < HEVC_MAX_PPS_COUNT; i++ ) {
+        free( ps->pps[i] );
+        free( ps->pps_nal[i].data );
+    }
+    hevc_ps_init( ps );
+}
+
+static int ps_nal_equal( const HEVCParamSetNal *slot, const NalUnit *nalu )
+{
+    return slot->size == nalu->size && !memcmp( slot->data, nalu->addr, nalu->size );
+}
+
+static int ps_nal_store( HEVCParamSetNal *slot, const NalUnit *nalu )
+{
+    if ( nalu->size > slot->capacity ) {
+        uint8_t *data = realloc( slot->data, nalu->size );
+
+        if ( !data )
+            return -1;
+        slot->data = data;
+        slot->capacity = nalu->size;
+    }
+    memcpy( slot->data, nalu->addr, nalu->size );
+    slot->size = nalu->size;
+    return 0;
+}
+
+/* the id isn't at a fixed place in an SPS, look for the same bytes instead */
+static int ps_nal_cached( const HEVCParamSetNal *slots, int count, const NalUnit *nalu )
+{
+    int i;
+
+    for ( i = 0; i < count; i++ )
+        if ( ps_nal_equal( &slots[i], nalu ) )
+            return 1;
+    return 0;
+}
+
+static int sps_format_differs( const HEVCSPS *a, const HEVCSPS *b )
+{
+    return a->pic_width_in_luma_samples != b->pic_width_in_luma_samples ||
+           a->pic_height_in_luma_samples != b->pic_height_in_luma_samples ||
+           a->chroma_format_idc != b->chroma_format_idc ||
+           a->bit_depth_luma != b->bit_depth_luma ||
+           a->bit_depth_chroma != b->bit_depth_chroma ||
+           a->general_profile_idc != b->general_profile_idc ||
+           a->general_tier_flag != b->general_tier_flag ||
+           a->general_level_idc != b->general_level_idc;
+}
+
+int hevc_ps_parse( HEVCParamSets *ps, const NalUnit *nalu )
+{
+    HEVCDecoderConfigurationRecord config;
+    HEVCSPS sps;
+    HEVCPPS pps;
+    bs_t bs;
+    int id;
+
+    if ( !ps || !nalu || nalu->size <= 2 )
+        return -1;
+
+    switch ( nalu->nalu_type ) {
+    case HEVC_NAL_VPS:
+        // only kept as is, nothing later depends on its fields
+        id = nalu->addr[2] >> 4;
+        if ( ps_nal_equal( &ps->vps_nal[id], nalu ) )
+            return 0;
+        return ps_nal_store( &ps->vps_nal[id], nalu ) < 0 ? -1 : 1;
+    case HEVC_NAL_SPS:
+        if ( ps_nal_cached( ps->sps_nal, HEVC_MAX_SPS_COUNT, nalu ) )
+            return 0;
+        // the record is only scratch here
+        hvcc_init( &config );
+        bs_init_nal( &bs, nalu->addr + 2, nalu->size - 2 );
+        if ( hevc_parse_sps( &bs, &config, &sps ) < 0 )
+            return -1;
+        sps.general_profile_idc = config.general_profile_idc;
+        sps.general_tier_flag   = config.general_tier_flag;
+        sps.general_level_idc   = config.general_level_idc;
+        sps.bit_depth_luma      = config.bitDepthLumaMinus8 + 8;
+        sps.bit_depth_chroma    = config.bitDepthChromaMinus8 + 8;
+
+        id = sps.sps_id;
+        if ( !ps->sps[id] && !(ps->sps[id] = malloc( sizeof(sps) )) )
+            return -1;
+        if ( !ps->sps_nal[id].size || sps_format_differs( ps->sps[id], &sps ) )
+            ps->config_changed = 1;
+        if ( ps_nal_store( &ps->sps_nal[id], nalu ) < 0 ) {
+            free( ps->sps[id] );
+            ps->sps[id] = NULL;
+            ps->sps_nal[id].size = 0;
+            return -1;
+        }
+        *ps->sps[id] = sps;
+        return 1;
+    case HEVC_NAL_PPS:
+        if ( ps_nal_cached( ps->pps_nal, HEVC_MAX_PPS_COUNT, nalu ) )
+            return 0;
+        hvcc_init( &config );
+        bs_init_nal( &bs, nalu->addr + 2, nalu->size - 2 );
+        if ( hevc_parse_pps( &bs, &config, &pps ) < 0 )
+            return -1;
+
+        id = pps.pps_id;
+        if ( !ps->pps[id] && !(ps->pps[id] = malloc( sizeof(pps) )) )
+            return -1;
+        if ( ps_nal_store( &ps->pps_nal[id], nalu ) < 0 ) {
+            free( ps->pps[id] );
+            ps->pps[id] = NULL;
+            ps->pps_nal[id].size = 0;
+            return -1;
+        }
+        *ps->pps[id] = pps;
+        return 1;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+int hevc_ps_config_changed( HEVCParamSets *ps )
+{
+    int changed = ps->config_changed;
+
+    ps->config_changed = 0;
+    return changed;
+}
+
+static int ceil_log2( uint32_t v )
+{
+    return v > 1 ? 32 - __builtin_clz( v - 1 ) : 0;
+}
+
+int hevc_parse_slice_header( const HEVCParamSets *ps, const NalUnit *nalu, HEVCSliceHeader *sh )
+{
+    const HEVCSPS *sps;
+    const HEVCPPS *pps;
+    unsigned int pps_id;
+    bs_t bs;
+
+    if ( !ps || !nalu || !sh || nalu->size <= 2 || !HEVC_NAL_IS_VCL( nalu->nalu_type ) )
+        return -1;
+
+    memset( sh, 0, sizeof(*sh) );
+    sh->nal_unit_type = nalu->nalu_type;
+    sh->temporal_id   = (nalu->addr[1] & 0x07) - 1;
+
+    bs_init_nal( &bs, nalu->addr + 2, nalu->size - 2 );
+    sh->first_slice_segment_in_pic_flag = bs_read_u1( &bs );
+    if ( HEVC_NAL_IS_IRAP( nalu->nalu_type ) )
+        sh->no_output_of_prior_pics_flag = bs_read_u1( &bs );
+
+    pps_id = bs_read_ue( &bs ); // slice_pic_parameter_set_id
+    if ( pps_id >= HEVC_MAX_PPS_COUNT || !(pps = ps->pps[pps_id]) || !(sps = ps->sps[pps->sps_id]) )
+        return -1;
+    sh->pps_id = pps_id;
+
+    if ( !sh->first_slice_segment_in_pic_flag ) {
+        uint32_t ctb_size = 1 << sps->log2_ctb_size;
+        uint32_t pic_size_in_ctbs = ((sps->pic_width_in_luma_samples + ctb_size - 1) >> sps->log2_ctb_size) *
+                                    ((sps->pic_height_in_luma_samples + ctb_size - 1) >> sps->log2_ctb_size);
+
+        if ( pps->dependent_slice_segments_enabled_flag )
+            sh->dependent_slice_segment_flag = bs_read_u1( &bs );
+        sh->slice_segment_address = bs_read_u( &bs, ceil_log2( pic_size_in_ctbs ) );
+        if ( sh->slice_segment_address >= pic_size_in_ctbs )
+            return -1;
+    }
+
+    /* a dependent slice segment takes the rest from the previous segment */
+    if ( sh->dependent_slice_segment_flag )
+        return 0;
+
+    bs_skip_u( &bs, pps->num_extra_slice_header_bits ); // slice_reserved_flag[i]
+    sh->slice_type = bs_read_ue( &bs );
+    if ( sh->slice_type > HEVC_SLICE_I )
+        return -1;
+
+    sh->pic_output_flag = 1;
+    if ( pps->output_flag_present_flag )
+        sh->pic_output_flag = bs_read_u1( &bs );
+    if ( sps->separate_colour_plane_flag )
+        sh->colour_plane_id = bs_read_u( &bs, 2 );
+
+    if ( nalu->nalu_type != HEVC_NAL_IDR_W_RADL && nalu->nalu_type != HEVC_NAL_IDR_N_LP ) {
+        sh->pic_order_cnt_lsb = bs_read_u( &bs, sps->log2_max_pic_order_cnt_lsb );
+        sh->short_term_ref_pic_set_sps_flag = bs_read_u1( &bs );
+
+        if ( !sh->short_term_ref_pic_set_sps_flag ) {
+            uint8_t num_delta_pocs[HEVC_MAX_SHORT_TERM_RPS_COUNT + 1];
+
+            memcpy( num_delta_pocs, sps->num_delta_pocs, sizeof(num_delta_pocs) );
+            if ( parse_rps( &bs, sps->num_short_term_ref_pic_sets,
+                            sps->num_short_term_ref_pic_sets, num_delta_pocs ) < 0 )
+                return -1;
+            sh->short_term_ref_pic_set_idx = sps->num_short_term_ref_pic_sets;
+            sh->num_delta_pocs = num_delta_pocs[sps->num_short_term_ref_pic_sets];
+        } else {
+            if ( !sps->num_short_term_ref_pic_sets )
+                return -1;
+            sh->short_term_ref_pic_set_idx = bs_read_u( &bs, ceil_log2( sps->num_short_term_ref_pic_sets ) );
+            if ( sh->short_term_ref_pic_set_idx >= sps->num_short_term_ref_pic_sets )
+                return -1;
+            sh->num_delta_pocs = sps->num_delta_pocs[sh->short_term_ref_pic_set_idx];
+        }
+    }
+
+    /* long-term refs, weights, QP ... aren't needed to find pictures */
+    return bs_overrun( &bs ) ? -1 : 0;
+}
+
+void hevc_au_init( HevcAuDetector *au )
+{
+    memset( au, 0, sizeof(*au) );
+}
+
+int hevc_au_starts( HevcAuDetector *au, const NalUnit *nalu )
+{
+    uint8_t type = nalu->nalu_type;
+    int first = !au->au_open;
+
+    if ( HEVC_NAL_IS_VCL( type ) ) {
+        // first_slice_segment_in_pic_flag is the first payload bit
+        if ( nalu->size > 2 && (nalu->addr[2] & 0x80) && au->au_has_vcl )
+            first = 1;
+        au->au_has_vcl = 1;
+    } else if ( type == HEVC_NAL_AUD || type == HEVC_NAL_VPS || type == HEVC_NAL_SPS ||
+                type == HEVC_NAL_PPS || type == HEVC_NAL_SEI_PREFIX ||
+                (type >= 41 && type <= 44) || (type >= 48 && type <= 55) ) {
+        // these can only come before the first VCL NAL of an access unit
+        if ( au->au_has_vcl )
+            first = 1;
+        if ( first )
+            au->au_has_vcl = 0;
+    }
+
+    au->au_open = 1;
+    return first;
+}
+
+void hevc_poc_init( HevcPocState *s )
+{
+    s->prev_tid0_poc = 0;
+    s->no_rasl_output = 1;
+}
+
+void hevc_poc_eos( HevcPocState *s )
+{
+    s->no_rasl_output = 1;
+}
+
+int32_t hevc_poc_compute( HevcPocState *s, const HEVCSPS *sps, const HEVCSliceHeader *sh )
+{
+    int32_t max_lsb = 1 << sps->log2_max_pic_order_cnt_lsb;
+    int32_t lsb = sh->pic_order_cnt_lsb;
+    int32_t prev_lsb = s->prev_tid0_poc & (max_lsb - 1);
+    int32_t prev_msb = s->prev_tid0_poc - prev_lsb;
+    int32_t msb, poc;
+    uint8_t type = sh->nal_unit_type;
+
+    if ( HEVC_NAL_IS_IRAP( type ) && (s->no_rasl_output || type < HEVC_NAL_CRA_NUT) )
+        msb = 0;
+    else if ( lsb < prev_lsb && prev_lsb - lsb >= max_lsb / 2 )
+        msb = prev_msb + max_lsb;
+    else if ( lsb > prev_lsb && lsb - prev_lsb > max_lsb / 2 )
+        msb = prev_msb - max_lsb;
+    else
+        msb = prev_msb;
+    poc = msb + lsb;
+
+    if ( HEVC_NAL_IS_IRAP( type ) )
+        s->no_rasl_output = 0;
+    // RADL/RASL and sub-layer non-reference pictures (even types up to 14)
+    if ( sh->temporal_id == 0 && !(type >= HEVC_NAL_RADL_N && type <= HEVC_NAL_RASL_R) &&
+         !(type <= 14 && !(type & 1)) )
+        s->prev_tid0_poc = poc;
+
+    return poc;
+}
+
+static int hvcc_add_stored( HEVCDecoderConfigurationRecord *config,
+                            const HEVCParamSetNal *slots, int count, int *found )
+{
+    int i;
+
+    for ( i = 0; i < count; i++ ) {
+        NalUnit nalu;
+
+        if ( !slots[i].size )
+            continue;
+        nalu.addr = slots[i].data;
+        nalu.size = slots[i].size;
+        nalu.nalu_type = (nalu.addr[0] >> 1) & 0x3f;
+        if ( hvcc_add_param_set( config, &nalu ) < 0 )
+            return -1;
+        (*found)++;
+    }
+    return 0;
+}
+
+int hevc_ps_get_config( const HEVCParamSets *ps, HEVCDecoderConfigurationRecord *config )
+{
+    int found = 0;
+
+    if ( !ps || !config )
+        return -1;
+
+    hvcc_init( config );
+    if ( hvcc_add_stored( config, ps->vps_nal, HEVC_MAX_VPS_COUNT, &found ) < 0 ||
+         hvcc_add_stored( config, ps->sps_nal, HEVC_MAX_SPS_COUNT, &found ) < 0 ||
+         hvcc_add_stored( config, ps->pps_nal, HEVC_MAX_PPS_COUNT, &found ) < 0 ||
+         !found ) {
+        hevc_config_free( config );
+        return -1;
+    }
+
+    hvcc_finish( config );
+    return 0;
+}
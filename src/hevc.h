@@ -11,6 +11,7 @@
 #define HEVC_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef enum HEVCNALUnitType {
     HEVC_NAL_TRAIL_N    = 0,
@@ -40,6 +41,22 @@ typedef enum HEVCNALUnitType {
     HEVC_NAL_SEI_SUFFIX = 40,
 } HEVCNALUnitType;
 
+#define HEVC_NAL_IS_VCL(type)  ((type) < 32)
+#define HEVC_NAL_IS_IRAP(type) ((type) >= 16 && (type) <= 23)
+
+typedef enum HEVCSliceType {
+    HEVC_SLICE_B = 0,
+    HEVC_SLICE_P = 1,
+    HEVC_SLICE_I = 2,
+} HEVCSliceType;
+
+#define HEVC_MAX_SUB_LAYERS 7
+#define HEVC_MAX_VPS_COUNT 16
+#define HEVC_MAX_SPS_COUNT 16
+#define HEVC_MAX_PPS_COUNT 64
+#define HEVC_MAX_SHORT_TERM_RPS_COUNT 64
+#define HEVC_MAX_DPB_SIZE 16
+
 typedef struct HVCCNALUnitArray {
     uint8_t  array_completeness;
     uint8_t  NAL_unit_type;
@@ -76,8 +93,360 @@ typedef struct NalUnit {
     int size;
 } NalUnit;
 
+/* first start code in [p, end), pointing at its leading zero_byte when it
+ * is a 4 byte one; end if there is none */
+extern const uint8_t *hevc_find_startcode( const uint8_t *p, const uint8_t *end );
+/*
+ * Incremental NAL splitter for Annex-B data that arrives in pieces (socket
+ * reads, TS payloads ...). Every NAL unit is handed to cb as soon as the
+ * start code after it has been fed, hevc_splitter_flush() hands out the
+ * last one at the end of the stream. NalUnit.addr points into the chunk
+ * passed to hevc_splitter_feed() when the NAL lies entirely in it; only a
+ * NAL spanning chunks is copied into the splitter. Either way it is only
+ * valid during the callback. NAL boundaries are the same as
+ * hevc_parse_nalu() finds on the concatenated stream.
+ */
+typedef void (*HevcNalCallback)( const NalUnit *nalu, void *opaque );
+typedef struct HevcNalSplitter HevcNalSplitter;
+
+extern HevcNalSplitter *hevc_splitter_new( HevcNalCallback cb, void *opaque );
+extern void hevc_splitter_free( HevcNalSplitter *s );
+/* returns the number of NAL units emitted, -1 on error */
+extern int hevc_splitter_feed( HevcNalSplitter *s, const uint8_t *data, int size );
+extern int hevc_splitter_flush( HevcNalSplitter *s );
+
+/*
+ * NAL framing conversion for muxing (Annex-B -> 4 byte length prefix, MP4
+ * and FLV samples) and replay (length prefix -> Annex-B). The output is a
+ * list of spans for writev() that sum up to the converted access unit; no
+ * payload byte is copied:
+ *  - a 4 byte start code / 4 byte length is overwritten in place, so data is
+ *    modified, and consecutive NALs come out as one span
+ *  - a 3 byte start code gets its length written into scratch (4 bytes per
+ *    such NAL), a 1 or 2 byte length gets a shared static start code
+ * HEVC_CONVERT_DROP_PS leaves in-band VPS/SPS/PPS out of the output.
+ * returns the number of spans, -1 if iov or scratch is too small or the
+ * input is malformed.
+ */
+#define HEVC_CONVERT_DROP_PS 0x01
+
+struct iovec;
+extern int hevc_annexb_to_mp4( uint8_t *data, int size, int flags,
+                               struct iovec *iov, int iov_max, uint8_t *scratch, int scratch_size );
+extern int hevc_mp4_to_annexb( uint8_t *data, int size, int length_size, int flags,
+                               struct iovec *iov, int iov_max );
+
+/*
+ * Build the decoder configuration record from the VPS/SPS/PPS found in an
+ * Annex-B buffer. config is initialized from scratch; its arrays reference
+ * the parameter set NALs inside data_in (no copy), so data_in must outlive
+ * the record. Release it with hevc_config_free().
+ */
 extern int hevc_get_config( const uint8_t *data_in, int size, HEVCDecoderConfigurationRecord *config );
-extern int hevc_parse_nalu( const uint8_t *data_in, int size, NalUnit *nalu_list );
+extern void hevc_config_free( HEVCDecoderConfigurationRecord *config );
+/* size of the ISO/IEC 14496-15 hvcC box payload for config */
+extern int hevc_config_size( const HEVCDecoderConfigurationRecord *config );
+/* write the hvcC box payload into out, returns bytes written or -1 */
+extern int hevc_config_write( const HEVCDecoderConfigurationRecord *config, uint8_t *out, int size );
+/* parse an hvcC box payload, the arrays reference the NALs inside data.
+ * returns bytes consumed or -1 */
+extern int hevc_config_parse( const uint8_t *data, int size, HEVCDecoderConfigurationRecord *config );
+/*
+ * NAL unit following the start code at *pos (start it at
+ * hevc_find_startcode( data, end )), *pos moves on to the next start code.
+ * returns 0 when there is no further NAL unit
+ */
+extern int hevc_next_nalu( const uint8_t **pos, const uint8_t *end, NalUnit *nalu );
+
+/*
+ * Index the NAL units of an Annex-B buffer into nalu_list, storing at most
+ * max_nalu of them. Returns the number of NAL units in the buffer; a value
+ * above max_nalu means the list was too small and only the first max_nalu
+ * entries are set.
+ */
+extern int hevc_parse_nalu( const uint8_t *data_in, int size, NalUnit *nalu_list, int max_nalu );
+
+/*
+ * Growable NAL index, reusable across buffers: it only reallocates when a
+ * buffer holds more NAL units than any before, so steady state parsing does
+ * no allocation. Starts empty (hevc_nalu_list_init() or zeroed).
+ */
+typedef struct NalUnitList {
+    NalUnit *nalu;
+    int count;
+    int capacity;
+} NalUnitList;
+
+extern void hevc_nalu_list_init( NalUnitList *list );
+extern void hevc_nalu_list_free( NalUnitList *list );
+/* returns list->count, -1 when growing the list failed */
+extern int hevc_nalu_list_parse( NalUnitList *list, const uint8_t *data_in, int size );
+/*
+ * Same list for buffers of any size, scanned in chunks by worker threads
+ * (threads 0 is one per online CPU, fewer for small buffers). Start codes
+ * across chunk borders are found by the chunk they start in, so the list
+ * does not depend on the number of threads. returns list->count, -1 on
+ * error
+ */
+extern int hevc_nalu_list_parse_mt( NalUnitList *list, const uint8_t *data_in, size_t size, int threads );
+/* copy a NAL unit with its emulation prevention bytes removed, dst must hold
+ * src_len bytes. The parsers read NAL payloads in place, this is only for
+ * consumers that need a real RBSP buffer. returns the RBSP length */
+extern int hevc_extract_rbsp( const uint8_t *src, int src_len, uint8_t *dst );
+/* the inverse, for NAL units written back out: dst must hold
+ * rbsp_len + rbsp_len / 2 + 1 bytes. returns the NAL unit length */
+extern int hevc_insert_epb( const uint8_t *rbsp, int rbsp_len, uint8_t *dst );
+
+/* the decoded SPS fields slice headers and consumers depend on */
+typedef struct HEVCSPS {
+    uint8_t  vps_id;
+    uint8_t  sps_id;
+    uint8_t  max_sub_layers;
+    uint8_t  chroma_format_idc;
+    uint8_t  separate_colour_plane_flag;
+    uint32_t pic_width_in_luma_samples;
+    uint32_t pic_height_in_luma_samples;
+    uint32_t conf_win_left_offset;
+    uint32_t conf_win_right_offset;
+    uint32_t conf_win_top_offset;
+    uint32_t conf_win_bottom_offset;
+    /* output size, the conformance window applied */
+    uint32_t width;
+    uint32_t height;
+    /* by HighestTid, filled in for all sub-layers */
+    uint8_t  max_dec_pic_buffering[HEVC_MAX_SUB_LAYERS];
+    uint8_t  max_num_reorder_pics[HEVC_MAX_SUB_LAYERS];
+    uint32_t max_latency_increase_plus1[HEVC_MAX_SUB_LAYERS];
+    /* VUI timing, a picture lasts num_units_in_tick / time_scale seconds */
+    uint8_t  timing_info_present_flag;
+    uint32_t num_units_in_tick;
+    uint32_t time_scale;
+    /* fixed_pic_rate_within_cvs_flag of the highest sub-layer HRD */
+    uint8_t  fixed_pic_rate;
+    uint8_t  log2_max_pic_order_cnt_lsb;
+    uint8_t  log2_min_cb_size;
+    uint8_t  log2_ctb_size;
+    uint8_t  num_short_term_ref_pic_sets;
+    uint8_t  long_term_ref_pics_present_flag;
+    uint8_t  num_long_term_ref_pics_sps;
+    uint8_t  sps_temporal_mvp_enabled_flag;
+    uint8_t  sample_adaptive_offset_enabled_flag;
+    uint8_t  general_profile_idc;
+    uint8_t  general_tier_flag;
+    uint8_t  general_level_idc;
+    uint8_t  bit_depth_luma;
+    uint8_t  bit_depth_chroma;
+    /* per st_ref_pic_set(), the extra slot is scratch for slice headers */
+    uint8_t  num_delta_pocs[HEVC_MAX_SHORT_TERM_RPS_COUNT + 1];
+} HEVCSPS;
+
+typedef struct HEVCPPS {
+    uint8_t pps_id;
+    uint8_t sps_id;
+    uint8_t dependent_slice_segments_enabled_flag;
+    uint8_t output_flag_present_flag;
+    uint8_t num_extra_slice_header_bits;
+    uint8_t sign_data_hiding_enabled_flag;
+    uint8_t cabac_init_present_flag;
+    uint8_t tiles_enabled_flag;
+    uint8_t entropy_coding_sync_enabled_flag;
+} HEVCPPS;
+
+/* raw copy of a stored parameter set NAL unit, header included */
+typedef struct HEVCParamSetNal {
+    uint8_t *data;
+    int size;
+    int capacity;
+} HEVCParamSetNal;
+
+/*
+ * Per stream parameter set store by id, filled in by hevc_ps_parse(). A
+ * parameter set is only parsed when its bytes differ from the stored ones,
+ * so the copies resent before every IDR cost a compare.
+ */
+typedef struct HEVCParamSets {
+    HEVCSPS *sps[HEVC_MAX_SPS_COUNT];
+    HEVCPPS *pps[HEVC_MAX_PPS_COUNT];
+    HEVCParamSetNal vps_nal[HEVC_MAX_VPS_COUNT];
+    HEVCParamSetNal sps_nal[HEVC_MAX_SPS_COUNT];
+    HEVCParamSetNal pps_nal[HEVC_MAX_PPS_COUNT];
+    /* set when an SPS appears or changes resolution, chroma format, bit
+     * depth or profile/tier/level */
+    int config_changed;
+} HEVCParamSets;
+
+extern void hevc_ps_init( HEVCParamSets *ps );
+extern void hevc_ps_free( HEVCParamSets *ps );
+/*
+ * store a VPS, SPS or PPS NAL unit, other types are ignored. returns 1 when
+ * it was new or changed, 0 when it was already stored (or ignored), -1 on
+ * error
+ */
+extern int hevc_ps_parse( HEVCParamSets *ps, const NalUnit *nalu );
+/* returns and clears config_changed */
+extern int hevc_ps_config_changed( HEVCParamSets *ps );
+/*
+ * hevc_get_config() from the stored parameter sets, for NAL units that
+ * didn't come as one Annex-B buffer (RTP, TS ...). The arrays reference the
+ * copies in ps, which must outlive the record.
+ */
+extern int hevc_ps_get_config( const HEVCParamSets *ps, HEVCDecoderConfigurationRecord *config );
+
+/*
+ * Fields an SPS rewrite forces. Cameras often leave the reorder depth at
+ * the DPB size and the timing out, which makes decoders hold back frames
+ * they could output; in HEVC the reorder depth is sps_max_num_reorder_pics
+ * (the VUI bitstream_restriction has no such field, unlike H.264).
+ */
+typedef struct HevcSpsPatch {
+    int      max_num_reorder_pics;          // every sub-layer, -1 keeps
+    int      max_latency_increase_plus1;    // -1 keeps
+    uint32_t num_units_in_tick;             // both set: VUI timing info, added if missing
+    uint32_t time_scale;
+    int      bitstream_restriction;         // add one with the inferred values if missing
+} HevcSpsPatch;
+
+/* keeps everything */
+extern void hevc_sps_patch_init( HevcSpsPatch *patch );
+/*
+ * re-encode an SPS NAL unit (header included, no start code) with patch
+ * applied; the bits not patched are copied as they are. out needs room for
+ * size + 32 bytes. returns the new size, -1 on error or if out is too small
+ */
+extern int hevc_rewrite_sps( const uint8_t *nal, int size, const HevcSpsPatch *patch,
+                             uint8_t *out, int out_size );
+
+/* slice segment header up to the short-term RPS */
+typedef struct HEVCSliceHeader {
+    uint8_t  nal_unit_type;
+    uint8_t  temporal_id;
+    uint8_t  first_slice_segment_in_pic_flag;
+    uint8_t  no_output_of_prior_pics_flag;
+    uint8_t  pps_id;
+    uint8_t  dependent_slice_segment_flag;
+    uint32_t slice_segment_address;
+    uint8_t  slice_type;
+    uint8_t  pic_output_flag;
+    uint8_t  colour_plane_id;
+    uint16_t pic_order_cnt_lsb;
+    uint8_t  short_term_ref_pic_set_sps_flag;
+    /* == num_short_term_ref_pic_sets when the RPS is coded in the slice */
+    uint8_t  short_term_ref_pic_set_idx;
+    uint8_t  num_delta_pocs;
+} HEVCSliceHeader;
+
+/*
+ * Parse the header of a VCL NAL unit against the parameter sets seen so far.
+ * A dependent slice segment stops after slice_segment_address, the rest is
+ * inherited from the segment before it. returns 0, or -1 when the header is
+ * malformed or refers to a missing PPS/SPS.
+ */
+extern int hevc_parse_slice_header( const HEVCParamSets *ps, const NalUnit *nalu, HEVCSliceHeader *sh );
+
+/*
+ * Access unit boundaries (7.4.2.4.4) for a stream handed in NAL by NAL: a
+ * new AU starts at the first of AUD/VPS/SPS/PPS/prefix SEI/reserved prefix
+ * types following a VCL NAL, or at a VCL NAL with
+ * first_slice_segment_in_pic_flag set. Only the NAL header and the first
+ * payload bit are read, no parameter sets are needed.
+ */
+typedef struct HevcAuDetector {
+    int au_open;
+    int au_has_vcl;
+} HevcAuDetector;
+
+extern void hevc_au_init( HevcAuDetector *au );
+/* returns 1 when nalu is the first NAL unit of a new access unit */
+extern int hevc_au_starts( HevcAuDetector *au, const NalUnit *nalu );
+
+/*
+ * Sub-bitstream extraction for trick play: keeps the NAL units with a
+ * TemporalId up to a target (8.6.1 / C.1, no re-encoding needed), or with
+ * HEVC_SUBLAYER_IRAP_ONLY the IRAP access units plus the parameter sets.
+ * The output list references the input bytes, nothing is copied.
+ *
+ * Lowering the target applies from the next access unit; raising it waits
+ * for a picture the decoder can switch up at: an IRAP, a TSA one sub-layer
+ * above (to the target) or an STSA one above (to that sub-layer). Leaving
+ * IRAP only mode waits for an IRAP, without the RASL pictures of a CRA.
+ * A CRA or BLA picture kept after dropped pictures, in IRAP only mode or
+ * leaving it, gets an end of sequence NAL unit ahead of its access unit so
+ * the decoder restarts the POC there; that entry points to static bytes.
+ */
+#define HEVC_SUBLAYER_IRAP_ONLY (-1)
+
+typedef struct HevcSubLayerFilter {
+    int target;
+    int current;        // highest TemporalId passed on
+    int decided;        // the first VCL NAL of the current AU was seen
+    int keep_au;        // the current AU goes out
+    int skip_rasl;      // since a CRA ending IRAP only mode
+    int eos;            // an EOS NAL unit goes ahead of the current AU
+    int sent;           // a picture went out
+    HevcAuDetector au;
+} HevcSubLayerFilter;
+
+/* the stream is expected to start with an IRAP */
+extern void hevc_sublayer_init( HevcSubLayerFilter *f, int target );
+extern void hevc_sublayer_set_target( HevcSubLayerFilter *f, int target );
+/*
+ * filter the next NAL units of the stream into out, which may be in. An
+ * access unit split across two lists may lose the AUD and SEI ahead of its
+ * first slice in IRAP only mode. The EOS NAL units can make out longer
+ * than in, past its capacity out->nalu is grown with realloc() (in place
+ * too). returns out->count, -1 on error
+ */
+extern int hevc_sublayer_filter( HevcSubLayerFilter *f, NalUnitList *out, const NalUnitList *in );
+
+/*
+ * Parameter set filter: VPS/SPS/PPS NAL units byte-identical to the copy
+ * already sent are dropped, new or changed ones go through. After
+ * hevc_psfilter_request() (segment start, new RTP subscriber) the next IRAP
+ * access unit gets every current set ahead of its first slice, in place of
+ * the ones it carried. A VPS/SPS change sends the next PPSs again even when
+ * unchanged, decoders may have dropped them with the old SPS. A set that
+ * can't be parsed is not stored and always goes through as it is, ahead of
+ * injected sets.
+ */
+typedef struct HevcPsFilter {
+    HEVCParamSets ps;           // what was sent last
+    int pending;                // inject at the next IRAP
+    int inject_au;              // the current AU is that IRAP
+    int au_vcl;                 // the first VCL NAL of the current AU was seen
+    uint64_t pps_resend;        // bit per PPS id
+    uint8_t *inject;
+    size_t inject_capacity;
+    uint64_t bytes_dropped;
+    uint64_t bytes_injected;
+    HevcAuDetector au;
+} HevcPsFilter;
+
+extern void hevc_psfilter_init( HevcPsFilter *f );
+extern void hevc_psfilter_free( HevcPsFilter *f );
+extern void hevc_psfilter_request( HevcPsFilter *f );
+/*
+ * filter the next NAL units of the stream into out, which can't be in.
+ * Kept NAL units reference the input, injected ones reference f and stay
+ * valid until the next call. returns out->count, -1 on error
+ */
+extern int hevc_psfilter_run( HevcPsFilter *f, NalUnitList *out, const NalUnitList *in );
+
+/*
+ * PicOrderCntVal (8.3.1) of the pictures of a stream, in decoding order.
+ * The MSB is carried over from the previous TemporalId 0 picture that is
+ * not a RASL/RADL/sub-layer non-reference one, and restarts at 0 on IDR/BLA
+ * pictures and on the first IRAP after hevc_poc_init() or an end of
+ * sequence NAL (hevc_poc_eos()).
+ */
+typedef struct HevcPocState {
+    int32_t prev_tid0_poc;
+    int no_rasl_output;     // the next IRAP starts a coded video sequence
+} HevcPocState;
+
+extern void hevc_poc_init( HevcPocState *s );
+extern void hevc_poc_eos( HevcPocState *s );
+/* call once per picture, with the header of its first slice segment */
+extern int32_t hevc_poc_compute( HevcPocState *s, const HEVCSPS *sps, const HEVCSliceHeader *sh );
 
 
 #endif  /*HEVC_H*/
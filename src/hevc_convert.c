@@ -0,0 +1,125 @@
+// Last Update:2026-10-17 14:05:12
+/**
+ * @file hevc_convert.c
+ * @brief Annex-B <-> length prefixed NAL units, without copying payload
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "hevc.h"
+
+static const uint8_t start_code[4] = { 0x00, 0x00, 0x00, 0x01 };
+
+static int is_parameter_set( uint8_t nalu_type )
+{
+    return nalu_type == HEVC_NAL_VPS || nalu_type == HEVC_NAL_SPS || nalu_type == HEVC_NAL_PPS;
+}
+
+/* append a span, extending the previous one when it continues it */
+static int iov_push( struct iovec *iov, int *count, int iov_max, const uint8_t *base, int len )
+{
+    if ( *count > 0 && (uint8_t *)iov[*count-1].iov_base + iov[*count-1].iov_len == base ) {
+        iov[*count-1].iov_len += len;
+        return 0;
+    }
+
+    if ( *count >= iov_max )
+        return -1;
+
+    iov[*count].iov_base = (void *)base;
+    iov[*count].iov_len  = len;
+    (*count)++;
+    return 0;
+}
+
+int hevc_annexb_to_mp4( uint8_t *data, int size, int flags,
+                        struct iovec *iov, int iov_max, uint8_t *scratch, int scratch_size )
+{
+    const uint8_t *p, *end = data + size;
+    NalUnit nalu;
+    int count = 0, used = 0;
+
+    if ( !data || size <= 0 || !iov )
+        return -1;
+
+    p = hevc_find_startcode( data, end );
+    while ( hevc_next_nalu( &p, end, &nalu ) ) {
+        uint8_t *addr = (uint8_t *)nalu.addr;
+        int len = nalu.size;
+
+        if ( (flags & HEVC_CONVERT_DROP_PS) && is_parameter_set( nalu.nalu_type ) )
+            continue;
+
+        // trailing_zero_8bits belong to the byte stream, not to the NAL
+        while ( len > 0 && !addr[len-1] )
+            len--;
+        if ( !len )
+            continue;
+
+        if ( addr - data >= 4 && !memcmp( addr - 4, start_code, 4 ) ) {
+            // the 4 byte start code becomes the length field
+            addr[-4] = len >> 24;
+            addr[-3] = len >> 16;
+            addr[-2] = len >> 8;
+            addr[-1] = len;
+            if ( iov_push( iov, &count, iov_max, addr - 4, len + 4 ) < 0 )
+                return -1;
+        } else {
+            uint8_t *hdr = scratch + used;
+
+            if ( !scratch || scratch_size - used < 4 )
+                return -1;
+            hdr[0] = len >> 24;
+            hdr[1] = len >> 16;
+            hdr[2] = len >> 8;
+            hdr[3] = len;
+            used += 4;
+            if ( iov_push( iov, &count, iov_max, hdr, 4 ) < 0 ||
+                 iov_push( iov, &count, iov_max, addr, len ) < 0 )
+                return -1;
+        }
+    }
+
+    return count;
+}
+
+int hevc_mp4_to_annexb( uint8_t *data, int size, int length_size, int flags,
+                        struct iovec *iov, int iov_max )
+{
+    uint8_t *p = data, *end = data + size;
+    int count = 0;
+
+    if ( !data || size < 0 || !iov || length_size < 1 || length_size > 4 || length_size == 3 )
+        return -1;
+
+    while ( p < end ) {
+        uint32_t len = 0;
+        int i;
+
+        if ( end - p < length_size )
+            return -1;
+        for ( i = 0; i < length_size; i++ )
+            len = len << 8 | p[i];
+        if ( len < 2 || len > (uint32_t)(end - p - length_size) )
+            return -1;
+
+        if ( !((flags & HEVC_CONVERT_DROP_PS) && is_parameter_set( (p[length_size] >> 1) & 0x3f )) ) {
+            if ( length_size == 4 ) {
+                memcpy( p, start_code, 4 );
+                if ( iov_push( iov, &count, iov_max, p, len + 4 ) < 0 )
+                    return -1;
+            } else {
+                if ( iov_push( iov, &count, iov_max, start_code, 4 ) < 0 ||
+                     iov_push( iov, &count, iov_max, p + length_size, len ) < 0 )
+                    return -1;
+            }
+        }
+        p += length_size + len;
+    }
+
+    return count;
+}
@@ -0,0 +1,562 @@
+// Last Update:2026-10-17 20:02:37
+/**
+ * @file hevc_engine.c
+ * @brief many streams parsed by a fixed work-stealing thread pool
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hevc_engine.h"
+
+#define ENGINE_MAX_THREADS 256
+#define DEQUE_SIZE         4096     // streams a worker can have up for stealing
+#define STREAM_BUDGET      16       // chunks run before a stream yields its worker
+#define PARK_TIMEOUT_NS    (10*1000*1000)
+
+/*
+ * Intrusive multi-producer single-consumer queue (Vyukov): producers only
+ * swap the head, the consumer follows the next links from the tail. Used
+ * for the chunks fed to a stream and for the streams sent to a worker.
+ */
+typedef struct MpscNode {
+    _Atomic(struct MpscNode *) next;
+} MpscNode;
+
+typedef struct MpscQueue {
+    _Atomic(MpscNode *) head;
+    MpscNode *tail;     // consumer only
+    MpscNode stub;
+} MpscQueue;
+
+static void mpsc_init( MpscQueue *q )
+{
+    atomic_init( &q->stub.next, NULL );
+    atomic_init( &q->head, &q->stub );
+    q->tail = &q->stub;
+}
+
+static void mpsc_push( MpscQueue *q, MpscNode *n )
+{
+    MpscNode *prev;
+
+    atomic_store_explicit( &n->next, NULL, memory_order_relaxed );
+    prev = atomic_exchange_explicit( &q->head, n, memory_order_seq_cst );
+    atomic_store_explicit( &prev->next, n, memory_order_release );
+}
+
+/* NULL when empty, or while a producer is between its two steps */
+static MpscNode *mpsc_pop( MpscQueue *q )
+{
+    MpscNode *tail = q->tail;
+    MpscNode *next = atomic_load_explicit( &tail->next, memory_order_acquire );
+
+    if ( tail == &q->stub ) {
+        if ( !next )
+            return NULL;
+        q->tail = tail = next;
+        next = atomic_load_explicit( &tail->next, memory_order_acquire );
+    }
+    if ( next ) {
+        q->tail = next;
+        return tail;
+    }
+    if ( tail != atomic_load_explicit( &q->head, memory_order_seq_cst ) )
+        return NULL;
+    mpsc_push( q, &q->stub );
+    next = atomic_load_explicit( &tail->next, memory_order_acquire );
+    if ( next ) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/* consumer side; counts a push still in progress as not empty */
+static int mpsc_empty( MpscQueue *q )
+{
+    return q->tail == &q->stub && atomic_load_explicit( &q->head, memory_order_seq_cst ) == &q->stub;
+}
+
+/*
+ * Chase-Lev deque (in the C11 form of Le et al.): the owning worker pushes
+ * and takes at the bottom, thieves take from the top.
+ */
+typedef struct Deque {
+    _Atomic int64_t top;
+    char pad[64];
+    _Atomic int64_t bottom;
+    _Atomic(HevcStream *) buf[DEQUE_SIZE];
+} Deque;
+
+static int deque_push( Deque *d, HevcStream *s )
+{
+    int64_t b = atomic_load_explicit( &d->bottom, memory_order_relaxed );
+    int64_t t = atomic_load_explicit( &d->top, memory_order_acquire );
+
+    if ( b - t >= DEQUE_SIZE )
+        return -1;
+    atomic_store_explicit( &d->buf[b & (DEQUE_SIZE - 1)], s, memory_order_relaxed );
+    atomic_store_explicit( &d->bottom, b + 1, memory_order_release );
+    return 0;
+}
+
+static HevcStream *deque_take( Deque *d )
+{
+    int64_t b = atomic_load_explicit( &d->bottom, memory_order_relaxed ) - 1;
+    int64_t t;
+    HevcStream *s = NULL;
+
+    atomic_store_explicit( &d->bottom, b, memory_order_relaxed );
+    atomic_thread_fence( memory_order_seq_cst );
+    t = atomic_load_explicit( &d->top, memory_order_relaxed );
+    if ( t <= b ) {
+        s = atomic_load_explicit( &d->buf[b & (DEQUE_SIZE - 1)], memory_order_relaxed );
+        if ( t == b ) {
+            // the last one, a thief may be after it too
+            if ( !atomic_compare_exchange_strong_explicit( &d->top, &t, t + 1,
+                                                           memory_order_seq_cst, memory_order_relaxed ) )
+                s = NULL;
+            atomic_store_explicit( &d->bottom, b + 1, memory_order_relaxed );
+        }
+    } else {
+        atomic_store_explicit( &d->bottom, b + 1, memory_order_relaxed );
+    }
+    return s;
+}
+
+static HevcStream *deque_steal( Deque *d )
+{
+    int64_t t = atomic_load_explicit( &d->top, memory_order_acquire );
+    int64_t b;
+    HevcStream *s;
+
+    atomic_thread_fence( memory_order_seq_cst );
+    b = atomic_load_explicit( &d->bottom, memory_order_acquire );
+    if ( t >= b )
+        return NULL;
+    s = atomic_load_explicit( &d->buf[t & (DEQUE_SIZE - 1)], memory_order_relaxed );
+    if ( !atomic_compare_exchange_strong_explicit( &d->top, &t, t + 1,
+                                                   memory_order_seq_cst, memory_order_relaxed ) )
+        return NULL;
+    return s;
+}
+
+enum {
+    CHUNK_DATA,
+    CHUNK_FLUSH,
+    CHUNK_CLOSE,
+};
+
+typedef struct EngineChunk {
+    MpscNode node;
+    int kind;
+    int size;
+    uint8_t data[];
+} EngineChunk;
+
+typedef struct Worker {
+    HevcEngine *engine;
+    int index;
+    Deque deque;
+    MpscQueue inbox;            // streams scheduled on this worker
+    atomic_int sleeping;
+    pthread_mutex_t lock;       // only to park and wake
+    pthread_cond_t wake;
+    pthread_t thread;
+    uint32_t rand;              // victim selection
+} Worker;
+
+struct HevcStream {
+    MpscNode node;              // in a worker inbox while scheduled
+    HevcEngine *engine;
+    int home;
+    MpscQueue inbox;            // EngineChunk
+    _Atomic int64_t pending;    // chunks queued and not run yet, scheduled while > 0
+    HevcNalSplitter *splitter;
+    HEVCParamSets ps;
+    int config_pending;         // a parameter set changed since the last slice
+    HevcNalCallback nal_cb;
+    HevcConfigCallback config_cb;
+    void *opaque;
+    HevcStream *prev;           // registry, under engine->lock
+    HevcStream *next;
+};
+
+struct HevcEngine {
+    Worker *workers;
+    int threads;
+    atomic_int stop;
+    pthread_mutex_t lock;       // the registry, never taken on the data path
+    HevcStream *streams;
+    int next_home;
+};
+
+static void worker_wake( Worker *w )
+{
+    if ( atomic_load_explicit( &w->sleeping, memory_order_seq_cst ) ) {
+        pthread_mutex_lock( &w->lock );
+        pthread_cond_signal( &w->wake );
+        pthread_mutex_unlock( &w->lock );
+    }
+}
+
+/* the stream has pending chunks and nobody running it: queue it on w */
+static void stream_schedule( HevcStream *s, Worker *w )
+{
+    mpsc_push( &w->inbox, &s->node );
+    worker_wake( w );
+}
+
+static void on_stream_nalu( const NalUnit *nalu, void *opaque )
+{
+    HevcStream *s = opaque;
+
+    if ( hevc_ps_parse( &s->ps, nalu ) > 0 )
+        s->config_pending = 1;
+    // the parameter sets ahead of a picture come as one record
+    if ( s->config_pending && nalu->nalu_type < 32 ) {
+        HEVCDecoderConfigurationRecord config;
+
+        s->config_pending = 0;
+        if ( s->config_cb && hevc_ps_get_config( &s->ps, &config ) == 0 ) {
+            s->config_cb( &config, s->opaque );
+            hevc_config_free( &config );
+        }
+    }
+    s->nal_cb( nalu, s->opaque );
+}
+
+static void stream_free( HevcStream *s )
+{
+    EngineChunk *c;
+
+    while ( (c = (EngineChunk *)mpsc_pop( &s->inbox )) )
+        free( c );
+    hevc_splitter_free( s->splitter );
+    hevc_ps_free( &s->ps );
+    free( s );
+}
+
+static void stream_close( HevcStream *s )
+{
+    HevcEngine *e = s->engine;
+
+    pthread_mutex_lock( &e->lock );
+    if ( s->prev )
+        s->prev->next = s->next;
+    else
+        e->streams = s->next;
+    if ( s->next )
+        s->next->prev = s->prev;
+    pthread_mutex_unlock( &e->lock );
+    stream_free( s );
+}
+
+/* run up to STREAM_BUDGET chunks of s, on worker w */
+static void stream_run( Worker *w, HevcStream *s )
+{
+    int budget;
+
+    for ( budget = 0; budget < STREAM_BUDGET; budget++ ) {
+        EngineChunk *c = (EngineChunk *)mpsc_pop( &s->inbox );
+
+        // only when a second thread feeds s and is between its two steps
+        if ( !c )
+            break;
+        if ( c->kind == CHUNK_DATA )
+            hevc_splitter_feed( s->splitter, c->data, c->size );
+        else
+            hevc_splitter_flush( s->splitter );
+        if ( c->kind == CHUNK_CLOSE ) {
+            // nothing can be fed after the close, no one else has s
+            free( c );
+            stream_close( s );
+            return;
+        }
+        free( c );
+        // the feeder bringing pending back up schedules s again, which
+        // may run and free it right away: s is not ours anymore
+        if ( atomic_fetch_sub_explicit( &s->pending, 1, memory_order_acq_rel ) == 1 )
+            return;
+    }
+
+    // out of budget or waiting for a link: back in line behind the streams here
+    mpsc_push( &w->inbox, &s->node );
+}
+
+static Worker *sleeping_peer( Worker *w )
+{
+    HevcEngine *e = w->engine;
+    int i;
+
+    for ( i = 1; i < e->threads; i++ ) {
+        Worker *peer = &e->workers[(w->index + i) % e->threads];
+
+        if ( atomic_load_explicit( &peer->sleeping, memory_order_relaxed ) )
+            return peer;
+    }
+    return NULL;
+}
+
+static HevcStream *worker_next( Worker *w )
+{
+    HevcEngine *e = w->engine;
+    HevcStream *s;
+    int i, n = 0;
+
+    if ( (s = deque_take( &w->deque )) )
+        return s;
+
+    // a new batch from the inbox, up for stealing while we run it
+    while ( n < DEQUE_SIZE && (s = (HevcStream *)mpsc_pop( &w->inbox )) ) {
+        deque_push( &w->deque, s );
+        n++;
+    }
+    if ( n > 1 ) {
+        Worker *peer = sleeping_peer( w );
+
+        if ( peer )
+            worker_wake( peer );
+    }
+    if ( n )
+        return deque_take( &w->deque );
+
+    for ( i = 0; i < e->threads - 1; i++ ) {
+        Worker *victim;
+
+        w->rand = w->rand * 1103515245 + 12345;
+        victim = &e->workers[(w->index + 1 + (w->rand >> 16) % (e->threads - 1)) % e->threads];
+        if ( (s = deque_steal( &victim->deque )) )
+            return s;
+    }
+    return NULL;
+}
+
+static void worker_park( Worker *w )
+{
+    struct timespec ts;
+
+    pthread_mutex_lock( &w->lock );
+    atomic_store_explicit( &w->sleeping, 1, memory_order_seq_cst );
+    if ( mpsc_empty( &w->inbox ) && !atomic_load( &w->engine->stop ) ) {
+        // woken for our inbox; the timeout is for stealing
+        clock_gettime( CLOCK_REALTIME, &ts );
+        ts.tv_nsec += PARK_TIMEOUT_NS;
+        if ( ts.tv_nsec >= 1000000000 ) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait( &w->wake, &w->lock, &ts );
+    }
+    atomic_store_explicit( &w->sleeping, 0, memory_order_relaxed );
+    pthread_mutex_unlock( &w->lock );
+}
+
+static void *worker_main( void *arg )
+{
+    Worker *w = arg;
+    int idle = 0;
+
+    while ( !atomic_load_explicit( &w->engine->stop, memory_order_acquire ) ) {
+        HevcStream *s = worker_next( w );
+
+        if ( s ) {
+            stream_run( w, s );
+            idle = 0;
+        } else if ( ++idle < 64 ) {
+            sched_yield();
+        } else {
+            worker_park( w );
+        }
+    }
+    return NULL;
+}
+
+/* stop and join the first started workers, free what is left */
+static void engine_destroy( HevcEngine *e, int started )
+{
+    HevcStream *s, *next;
+    int i;
+
+    atomic_store( &e->stop, 1 );
+    for ( i = 0; i < started; i++ ) {
+        Worker *w = &e->workers[i];
+
+        pthread_mutex_lock( &w->lock );
+        pthread_cond_signal( &w->wake );
+        pthread_mutex_unlock( &w->lock );
+        pthread_join( w->thread, NULL );
+    }
+    for ( s = e->streams; s; s = next ) {
+        next = s->next;
+        stream_free( s );
+    }
+    for ( i = 0; i < e->threads; i++ ) {
+        pthread_mutex_destroy( &e->workers[i].lock );
+        pthread_cond_destroy( &e->workers[i].wake );
+    }
+    pthread_mutex_destroy( &e->lock );
+    free( e->workers );
+    free( e );
+}
+
+HevcEngine *hevc_engine_new( int threads )
+{
+    HevcEngine *e;
+    int i;
+
+    if ( threads <= 0 ) {
+        long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+
+        threads = cpus > 0 ? cpus : 1;
+    }
+    if ( threads > ENGINE_MAX_THREADS )
+        threads = ENGINE_MAX_THREADS;
+
+    e = calloc( 1, sizeof(*e) );
+    if ( !e )
+        return NULL;
+    e->workers = calloc( threads, sizeof(Worker) );
+    if ( !e->workers ) {
+        free( e );
+        return NULL;
+    }
+    pthread_mutex_init( &e->lock, NULL );
+
+    for ( i = 0; i < threads; i++ ) {
+        Worker *w = &e->workers[i];
+
+        w->engine = e;
+        w->index = i;
+        w->rand = i + 1;
+        mpsc_init( &w->inbox );
+        pthread_mutex_init( &w->lock, NULL );
+        pthread_cond_init( &w->wake, NULL );
+    }
+    // the workers read threads when stealing, it is set before they start
+    e->threads = threads;
+    for ( i = 0; i < threads; i++ )
+        if ( pthread_create( &e->workers[i].thread, NULL, worker_main, &e->workers[i] ) ) {
+            engine_destroy( e, i );
+            return NULL;
+        }
+    return e;
+}
+
+static int engine_busy( HevcEngine *e )
+{
+    HevcStream *s;
+    int busy = 0;
+
+    pthread_mutex_lock( &e->lock );
+    for ( s = e->streams; s && !busy; s = s->next )
+        busy = atomic_load_explicit( &s->pending, memory_order_acquire ) != 0;
+    pthread_mutex_unlock( &e->lock );
+    return busy;
+}
+
+void hevc_engine_wait( HevcEngine *e )
+{
+    if ( !e )
+        return;
+    while ( engine_busy( e ) ) {
+        struct timespec ts = { 0, 100000 };
+
+        nanosleep( &ts, NULL );
+    }
+}
+
+void hevc_engine_free( HevcEngine *e )
+{
+    if ( !e )
+        return;
+    hevc_engine_wait( e );
+    engine_destroy( e, e->threads );
+}
+
+int hevc_engine_threads( const HevcEngine *e )
+{
+    return e ? e->threads : 0;
+}
+
+HevcStream *hevc_engine_add_stream( HevcEngine *e, HevcNalCallback nal_cb,
+                                    HevcConfigCallback config_cb, void *opaque )
+{
+    HevcStream *s;
+
+    if ( !e || !nal_cb )
+        return NULL;
+
+    s = calloc( 1, sizeof(*s) );
+    if ( !s )
+        return NULL;
+    s->splitter = hevc_splitter_new( on_stream_nalu, s );
+    if ( !s->splitter ) {
+        free( s );
+        return NULL;
+    }
+    s->engine = e;
+    s->nal_cb = nal_cb;
+    s->config_cb = config_cb;
+    s->opaque = opaque;
+    hevc_ps_init( &s->ps );
+    mpsc_init( &s->inbox );
+
+    pthread_mutex_lock( &e->lock );
+    s->home = e->next_home++ % e->threads;
+    s->next = e->streams;
+    if ( e->streams )
+        e->streams->prev = s;
+    e->streams = s;
+    pthread_mutex_unlock( &e->lock );
+    return s;
+}
+
+static int stream_queue( HevcStream *s, int kind, const uint8_t *data, int size )
+{
+    EngineChunk *c;
+
+    if ( !s || size < 0 || (size && !data) )
+        return -1;
+
+    c = malloc( sizeof(*c) + size );
+    if ( !c )
+        return -1;
+    c->kind = kind;
+    c->size = size;
+    if ( size )
+        memcpy( c->data, data, size );
+
+    // a close stays pending, the stream leaves the registry instead
+    mpsc_push( &s->inbox, &c->node );
+    if ( atomic_fetch_add_explicit( &s->pending, 1, memory_order_acq_rel ) == 0 )
+        stream_schedule( s, &s->engine->workers[s->home] );
+    return 0;
+}
+
+int hevc_engine_feed( HevcStream *s, const uint8_t *data, int size )
+{
+    if ( size == 0 )
+        return 0;
+    return stream_queue( s, CHUNK_DATA, data, size );
+}
+
+int hevc_engine_flush( HevcStream *s )
+{
+    return stream_queue( s, CHUNK_FLUSH, NULL, 0 );
+}
+
+int hevc_engine_remove_stream( HevcStream *s )
+{
+    return stream_queue( s, CHUNK_CLOSE, NULL, 0 );
+}
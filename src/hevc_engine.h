@@ -0,0 +1,54 @@
+// Last Update:2026-10-17 20:02:37
+/**
+ * @file hevc_engine.h
+ * @brief many streams parsed by a fixed work-stealing thread pool
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_ENGINE_H
+#define HEVC_ENGINE_H
+
+#include <stdint.h>
+#include "hevc.h"
+
+/*
+ * Ingest engine: each registered stream has its own NAL splitter and
+ * parameter set state, and the data fed to it is parsed by a fixed pool of
+ * worker threads instead of one thread per stream. A stream is processed
+ * by one worker at a time, in feed order, so its callbacks never run
+ * concurrently and need no locking; different streams run in parallel.
+ *
+ * Feeding copies the data into a chunk and queues it on the stream
+ * (lock-free, one feeding thread per stream); a stream with pending data
+ * goes to its home worker, idle workers steal from busy ones.
+ */
+typedef struct HevcEngine HevcEngine;
+typedef struct HevcStream HevcStream;
+
+/* the parameter sets changed, called ahead of the first picture NAL unit
+ * using them; config is valid during the call */
+typedef void (*HevcConfigCallback)( const HEVCDecoderConfigurationRecord *config, void *opaque );
+
+/* threads 0 is one per online CPU */
+extern HevcEngine *hevc_engine_new( int threads );
+/* processes what was fed, then stops the workers and frees the streams */
+extern void hevc_engine_free( HevcEngine *e );
+extern int hevc_engine_threads( const HevcEngine *e );
+
+/* the callbacks run on worker threads, config_cb may be NULL */
+extern HevcStream *hevc_engine_add_stream( HevcEngine *e, HevcNalCallback nal_cb,
+                                           HevcConfigCallback config_cb, void *opaque );
+/* hand out the last NAL unit and free the stream once everything fed to
+ * it is processed; s can't be fed anymore */
+extern int hevc_engine_remove_stream( HevcStream *s );
+
+/* returns 0, -1 when out of memory */
+extern int hevc_engine_feed( HevcStream *s, const uint8_t *data, int size );
+/* the last NAL unit fed goes out without waiting for the next start code */
+extern int hevc_engine_flush( HevcStream *s );
+/* wait until all the data fed so far is processed */
+extern void hevc_engine_wait( HevcEngine *e );
+
+#endif  /*HEVC_ENGINE_H*/
@@ -0,0 +1,169 @@
+// Last Update:2026-10-17 18:40:26
+/**
+ * @file hevc_file.c
+ * @brief memory-mapped Annex-B file source
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hevc_file.h"
+
+struct HevcFileSource {
+    const uint8_t *map;
+    uint64_t size;
+    size_t window;          // whole pages
+    size_t page;
+    const uint8_t *pos;     // next start code
+    uint64_t advised;       // MADV_WILLNEED issued up to here
+    uint64_t dropped;       // MADV_DONTNEED issued below here
+};
+
+HevcFileSource *hevc_file_open( const char *path, size_t window )
+{
+    HevcFileSource *src;
+    struct stat st;
+    int fd;
+
+    if ( !path || (fd = open( path, O_RDONLY )) < 0 )
+        return NULL;
+
+    src = calloc( 1, sizeof(*src) );
+    if ( !src || fstat( fd, &st ) < 0 )
+        goto err;
+
+    src->page = sysconf( _SC_PAGESIZE );
+    if ( !window )
+        window = HEVC_FILE_WINDOW;
+    src->window = (window + src->page - 1) & ~(src->page - 1);
+    src->size = st.st_size;
+    if ( src->size ) {
+        void *map = mmap( NULL, src->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+        if ( map == MAP_FAILED )
+            goto err;
+        src->map = map;
+        madvise( map, src->size, MADV_SEQUENTIAL );
+    }
+    // the mapping keeps the file
+    close( fd );
+
+    hevc_file_seek( src, 0 );
+    return src;
+
+err:
+    free( src );
+    close( fd );
+    return NULL;
+}
+
+void hevc_file_close( HevcFileSource *src )
+{
+    if ( !src )
+        return;
+    if ( src->map )
+        munmap( (void *)src->map, src->size );
+    free( src );
+}
+
+const uint8_t *hevc_file_data( const HevcFileSource *src )
+{
+    return src ? src->map : NULL;
+}
+
+uint64_t hevc_file_size( const HevcFileSource *src )
+{
+    return src ? src->size : 0;
+}
+
+/* keep two windows requested ahead of the cursor and one resident behind */
+static void file_advise( HevcFileSource *src, uint64_t cursor )
+{
+    if ( src->advised < src->size && cursor + src->window >= src->advised ) {
+        uint64_t len = src->size - src->advised;
+
+        if ( len > 2 * src->window )
+            len = 2 * src->window;
+        madvise( (void *)(src->map + src->advised), len, MADV_WILLNEED );
+        src->advised += len;
+    }
+
+    if ( cursor >= src->dropped + 2 * src->window ) {
+        uint64_t len = (cursor - src->window - src->dropped) & ~(uint64_t)(src->page - 1);
+
+        madvise( (void *)(src->map + src->dropped), len, MADV_DONTNEED );
+        src->dropped += len;
+    }
+}
+
+int hevc_file_seek( HevcFileSource *src, uint64_t offset )
+{
+    const uint8_t *end;
+
+    if ( !src || offset > src->size )
+        return -1;
+
+    end = src->map + src->size;
+    src->pos = src->map ? hevc_find_startcode( src->map + offset, end ) : NULL;
+    src->advised = src->dropped = offset & ~(uint64_t)(src->page - 1);
+    return 0;
+}
+
+int hevc_file_next_nalu( HevcFileSource *src, NalUnit *nalu, uint64_t *offset )
+{
+    const uint8_t *end;
+
+    if ( !src || !nalu || !src->map )
+        return 0;
+
+    end = src->map + src->size;
+    if ( src->pos >= end )
+        return 0;
+    if ( offset )
+        *offset = src->pos - src->map;
+    file_advise( src, src->pos - src->map );
+    return hevc_next_nalu( &src->pos, end, nalu );
+}
+
+int hevc_file_parse( HevcFileSource *src, NalUnitList *list, int max_bytes )
+{
+    const uint8_t *start, *end, *stop;
+    int n;
+
+    if ( !src || !list )
+        return -1;
+    list->count = 0;
+    if ( !src->map || src->pos >= src->map + src->size )
+        return 0;
+
+    start = src->pos;
+    end = src->map + src->size;
+    if ( max_bytes < 4 )
+        max_bytes = 4;
+    // the span ends at the first start code past max_bytes; scanning from
+    // the head of a zero run finds it where a scan of the whole file does
+    stop = end;
+    if ( (uint64_t)(end - start) > (uint64_t)max_bytes ) {
+        const uint8_t *p = start + max_bytes;
+
+        while ( p > start + 4 && !p[-1] )
+            p--;
+        stop = hevc_find_startcode( p, end );
+    }
+    if ( stop - start > INT_MAX )
+        return -1;
+
+    file_advise( src, start - src->map );
+    // a span that could not be listed is tried again by the next call
+    n = hevc_nalu_list_parse( list, start, stop - start );
+    if ( n >= 0 )
+        src->pos = stop;
+    return n;
+}
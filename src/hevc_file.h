@@ -0,0 +1,50 @@
+// Last Update:2026-10-17 18:40:26
+/**
+ * @file hevc_file.h
+ * @brief memory-mapped Annex-B file source
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_FILE_H
+#define HEVC_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hevc.h"
+
+/*
+ * Reads a raw .265 file through a read-only mapping: NalUnit.addr points
+ * into the mapping and stays valid until hevc_file_close(), nothing is
+ * copied. As the scan moves on, the next windows are requested with
+ * MADV_WILLNEED and the pages more than a window behind are given back
+ * with MADV_DONTNEED, so the resident size does not grow with the file.
+ * A NAL unit behind the cursor can still be read, its pages just fault
+ * in again.
+ */
+typedef struct HevcFileSource HevcFileSource;
+
+#define HEVC_FILE_WINDOW (8*1024*1024)
+
+/* window 0 is HEVC_FILE_WINDOW; it is rounded up to whole pages */
+extern HevcFileSource *hevc_file_open( const char *path, size_t window );
+extern void hevc_file_close( HevcFileSource *src );
+extern const uint8_t *hevc_file_data( const HevcFileSource *src );
+extern uint64_t hevc_file_size( const HevcFileSource *src );
+
+/* continue the scan at the first start code at or after offset */
+extern int hevc_file_seek( HevcFileSource *src, uint64_t offset );
+/*
+ * next NAL unit, offset (may be NULL) gets the file offset of its start
+ * code; returns 0 at the end of the file
+ */
+extern int hevc_file_next_nalu( HevcFileSource *src, NalUnit *nalu, uint64_t *offset );
+/*
+ * Index the next span of about max_bytes (at least one NAL unit, ending
+ * on a start code) into list, see hevc_nalu_list_parse(). Returns the
+ * number of NAL units, 0 at the end of the file, -1 on error.
+ */
+extern int hevc_file_parse( HevcFileSource *src, NalUnitList *list, int max_bytes );
+
+#endif  /*HEVC_FILE_H*/
@@ -0,0 +1,393 @@
+// Last Update:2026-10-17 16:48:20
+/**
+ * @file hevc_fmp4.c
+ * @brief fragmented MP4 (CMAF) writer for one HEVC track
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "hevc_fmp4.h"
+
+#define FMP4_SAMPLE_SYNC     0x02000000  // sample_depends_on 2
+#define FMP4_SAMPLE_NON_SYNC 0x01010000  // sample_depends_on 1, sample_is_non_sync_sample
+
+/* the trun fields written for every sample */
+#define FMP4_TRUN_FLAGS      0x000f01
+
+typedef struct BoxWriter {
+    uint8_t *start;
+    uint8_t *p;
+    uint8_t *end;
+    int error;
+} BoxWriter;
+
+static void put_bytes( BoxWriter *b, const void *data, int size )
+{
+    if ( b->error || b->end - b->p < size ) {
+        b->error = 1;
+        return;
+    }
+    memcpy( b->p, data, size );
+    b->p += size;
+}
+
+static void put8( BoxWriter *b, uint8_t v )
+{
+    put_bytes( b, &v, 1 );
+}
+
+static void put16( BoxWriter *b, uint16_t v )
+{
+    uint8_t be[2] = { v >> 8, v };
+
+    put_bytes( b, be, 2 );
+}
+
+static void put32( BoxWriter *b, uint32_t v )
+{
+    uint8_t be[4] = { v >> 24, v >> 16, v >> 8, v };
+
+    put_bytes( b, be, 4 );
+}
+
+static void put64( BoxWriter *b, uint64_t v )
+{
+    put32( b, v >> 32 );
+    put32( b, v );
+}
+
+static void put_zeros( BoxWriter *b, int n )
+{
+    while ( n-- > 0 )
+        put8( b, 0 );
+}
+
+/* returns where the box starts, its size is patched by box_close() */
+static int box_open( BoxWriter *b, const char *type )
+{
+    int off = b->p - b->start;
+
+    put32( b, 0 );
+    put_bytes( b, type, 4 );
+    return off;
+}
+
+static int full_box_open( BoxWriter *b, const char *type, uint8_t version, uint32_t flags )
+{
+    int off = box_open( b, type );
+
+    put32( b, (uint32_t)version << 24 | (flags & 0xffffff) );
+    return off;
+}
+
+static void patch32( BoxWriter *b, int off, uint32_t v )
+{
+    uint8_t *p = b->start + off;
+
+    if ( b->error )
+        return;
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void box_close( BoxWriter *b, int off )
+{
+    patch32( b, off, (b->p - b->start) - off );
+}
+
+static void put_matrix( BoxWriter *b )
+{
+    static const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    int i;
+
+    for ( i = 0; i < 9; i++ )
+        put32( b, unity[i] );
+}
+
+void hevc_fmp4_init( HevcFmp4Writer *w, const HEVCSPS *sps )
+{
+    memset( w, 0, sizeof(*w) );
+    w->track_id = 1;
+    w->sequence_number = 1;
+    w->timescale = 90000;
+    w->default_duration = 3600;
+    if ( !sps )
+        return;
+
+    w->width = sps->width;
+    w->height = sps->height;
+    if ( sps->timing_info_present_flag && sps->time_scale && sps->num_units_in_tick ) {
+        w->timescale = sps->time_scale;
+        w->default_duration = sps->num_units_in_tick;
+    }
+}
+
+static void write_sample_entry( BoxWriter *b, const HevcFmp4Writer *w,
+                                const HEVCDecoderConfigurationRecord *config )
+{
+    int hvc1, hvcc, size;
+
+    hvc1 = box_open( b, "hvc1" );
+    put_zeros( b, 6 );
+    put16( b, 1 );                  // data_reference_index
+    put_zeros( b, 16 );             // pre_defined, reserved
+    put16( b, w->width );
+    put16( b, w->height );
+    put32( b, 0x00480000 );         // 72 dpi
+    put32( b, 0x00480000 );
+    put32( b, 0 );
+    put16( b, 1 );                  // frame_count
+    put_zeros( b, 32 );             // compressorname
+    put16( b, 0x0018 );             // depth
+    put16( b, 0xffff );             // pre_defined = -1
+
+    hvcc = box_open( b, "hvcC" );
+    size = hevc_config_size( config );
+    if ( !b->error && b->end - b->p >= size && hevc_config_write( config, b->p, size ) == size )
+        b->p += size;
+    else
+        b->error = 1;
+    box_close( b, hvcc );
+    box_close( b, hvc1 );
+}
+
+int hevc_fmp4_init_segment( const HevcFmp4Writer *w, const HEVCDecoderConfigurationRecord *config,
+                            uint8_t *out, int size )
+{
+    BoxWriter b = { out, out, out + size, 0 };
+    int ftyp, moov, box, trak, mdia, minf, dinf, dref, stbl, stsd, mvex;
+
+    if ( !w || !config || !out || size <= 0 )
+        return -1;
+
+    ftyp = box_open( &b, "ftyp" );
+    put_bytes( &b, "iso6", 4 );
+    put32( &b, 0 );
+    put_bytes( &b, "iso6cmfc", 8 );
+    box_close( &b, ftyp );
+
+    moov = box_open( &b, "moov" );
+
+    box = full_box_open( &b, "mvhd", 0, 0 );
+    put32( &b, 0 );                 // creation_time
+    put32( &b, 0 );                 // modification_time
+    put32( &b, w->timescale );
+    put32( &b, 0 );                 // duration, fragmented
+    put32( &b, 0x00010000 );        // rate
+    put16( &b, 0x0100 );            // volume
+    put_zeros( &b, 10 );
+    put_matrix( &b );
+    put_zeros( &b, 24 );
+    put32( &b, w->track_id + 1 );   // next_track_ID
+    box_close( &b, box );
+
+    trak = box_open( &b, "trak" );
+    box = full_box_open( &b, "tkhd", 0, 0x000003 );   // enabled, in movie
+    put32( &b, 0 );
+    put32( &b, 0 );
+    put32( &b, w->track_id );
+    put32( &b, 0 );
+    put32( &b, 0 );                 // duration
+    put_zeros( &b, 8 );
+    put16( &b, 0 );                 // layer
+    put16( &b, 0 );                 // alternate_group
+    put16( &b, 0 );                 // volume
+    put16( &b, 0 );
+    put_matrix( &b );
+    put32( &b, w->width << 16 );
+    put32( &b, w->height << 16 );
+    box_close( &b, box );
+
+    mdia = box_open( &b, "mdia" );
+    box = full_box_open( &b, "mdhd", 0, 0 );
+    put32( &b, 0 );
+    put32( &b, 0 );
+    put32( &b, w->timescale );
+    put32( &b, 0 );
+    put16( &b, 0x55c4 );            // 'und'
+    put16( &b, 0 );
+    box_close( &b, box );
+
+    box = full_box_open( &b, "hdlr", 0, 0 );
+    put32( &b, 0 );
+    put_bytes( &b, "vide", 4 );
+    put_zeros( &b, 12 );
+    put_bytes( &b, "VideoHandler", 13 );
+    box_close( &b, box );
+
+    minf = box_open( &b, "minf" );
+    box = full_box_open( &b, "vmhd", 0, 0x000001 );
+    put_zeros( &b, 8 );             // graphicsmode, opcolor
+    box_close( &b, box );
+
+    dinf = box_open( &b, "dinf" );
+    dref = full_box_open( &b, "dref", 0, 0 );
+    put32( &b, 1 );
+    box = full_box_open( &b, "url ", 0, 0x000001 );   // media in this file
+    box_close( &b, box );
+    box_close( &b, dref );
+    box_close( &b, dinf );
+
+    // the sample tables are empty, samples come in the fragments
+    stbl = box_open( &b, "stbl" );
+    stsd = full_box_open( &b, "stsd", 0, 0 );
+    put32( &b, 1 );
+    write_sample_entry( &b, w, config );
+    box_close( &b, stsd );
+    box = full_box_open( &b, "stts", 0, 0 );
+    put32( &b, 0 );
+    box_close( &b, box );
+    box = full_box_open( &b, "stsc", 0, 0 );
+    put32( &b, 0 );
+    box_close( &b, box );
+    box = full_box_open( &b, "stsz", 0, 0 );
+    put32( &b, 0 );
+    put32( &b, 0 );
+    box_close( &b, box );
+    box = full_box_open( &b, "stco", 0, 0 );
+    put32( &b, 0 );
+    box_close( &b, box );
+    box_close( &b, stbl );
+
+    box_close( &b, minf );
+    box_close( &b, mdia );
+    box_close( &b, trak );
+
+    mvex = box_open( &b, "mvex" );
+    box = full_box_open( &b, "trex", 0, 0 );
+    put32( &b, w->track_id );
+    put32( &b, 1 );                 // default_sample_description_index
+    put32( &b, w->default_duration );
+    put32( &b, 0 );
+    put32( &b, 0 );
+    box_close( &b, box );
+    box_close( &b, mvex );
+
+    box_close( &b, moov );
+
+    return b.error ? -1 : (int)(b.p - out);
+}
+
+int hevc_fmp4_header_size( int sample_count, int nalu_count )
+{
+    // moof/mfhd/traf/tfhd/tfdt/trun headers, 16 bytes per sample, mdat header
+    return 8 + 16 + 8 + 16 + 20 + 20 + 16 * sample_count + 8 + 4 * nalu_count;
+}
+
+static int sample_nal_used( const NalUnit *nalu )
+{
+    return nalu->size > 0 &&
+           nalu->nalu_type != HEVC_NAL_VPS &&
+           nalu->nalu_type != HEVC_NAL_SPS &&
+           nalu->nalu_type != HEVC_NAL_PPS;
+}
+
+static int iov_add( struct iovec *iov, int n, int iov_max, const void *base, int len )
+{
+    if ( n > 0 && (const uint8_t *)iov[n-1].iov_base + iov[n-1].iov_len == base ) {
+        iov[n-1].iov_len += len;
+        return n;
+    }
+    if ( n >= iov_max )
+        return -1;
+    iov[n].iov_base = (void *)base;
+    iov[n].iov_len = len;
+    return n + 1;
+}
+
+int hevc_fmp4_media_segment( HevcFmp4Writer *w, const HevcFmp4Sample *samples, int count,
+                             uint8_t *header, int header_size, struct iovec *iov, int iov_max )
+{
+    BoxWriter b = { header, header, header + header_size, 0 };
+    int moof, traf, box, data_offset, mdat, i, j, n = 0;
+    uint64_t duration = 0, mdat_size = 8;
+    uint8_t *lengths;
+
+    if ( !w || !samples || count <= 0 || !header || !iov )
+        return -1;
+
+    moof = box_open( &b, "moof" );
+    box = full_box_open( &b, "mfhd", 0, 0 );
+    put32( &b, w->sequence_number );
+    box_close( &b, box );
+
+    traf = box_open( &b, "traf" );
+    box = full_box_open( &b, "tfhd", 0, 0x020000 );   // default-base-is-moof
+    put32( &b, w->track_id );
+    box_close( &b, box );
+
+    box = full_box_open( &b, "tfdt", 1, 0 );
+    put64( &b, w->decode_time );
+    box_close( &b, box );
+
+    // version 1: signed composition offsets
+    box = full_box_open( &b, "trun", 1, FMP4_TRUN_FLAGS );
+    put32( &b, count );
+    data_offset = b.p - b.start;
+    put32( &b, 0 );
+    for ( i = 0; i < count; i++ ) {
+        const HevcFmp4Sample *s = &samples[i];
+        uint32_t size = 0, flags = FMP4_SAMPLE_NON_SYNC;
+
+        for ( j = 0; j < s->nalu_count; j++ ) {
+            if ( !sample_nal_used( &s->nalu[j] ) )
+                continue;
+            size += 4 + s->nalu[j].size;
+            if ( HEVC_NAL_IS_IRAP( s->nalu[j].nalu_type ) )
+                flags = FMP4_SAMPLE_SYNC;
+        }
+
+        put32( &b, s->duration ? s->duration : w->default_duration );
+        put32( &b, size );
+        put32( &b, flags );
+        put32( &b, (uint32_t)s->cts_offset );
+        duration += s->duration ? s->duration : w->default_duration;
+        mdat_size += size;
+    }
+    box_close( &b, box );
+    box_close( &b, traf );
+    box_close( &b, moof );
+
+    if ( mdat_size > UINT32_MAX )
+        return -1;
+    patch32( &b, data_offset, (b.p - b.start) - moof + 8 );
+    mdat = box_open( &b, "mdat" );
+    patch32( &b, mdat, mdat_size );
+    if ( b.error )
+        return -1;
+
+    // the length prefixes follow the mdat header in header, the payload
+    // stays where it is
+    lengths = b.p;
+    n = iov_add( iov, n, iov_max, header, b.p - header );
+    for ( i = 0; i < count && n >= 0; i++ ) {
+        for ( j = 0; j < samples[i].nalu_count && n >= 0; j++ ) {
+            const NalUnit *nalu = &samples[i].nalu[j];
+
+            if ( !sample_nal_used( nalu ) )
+                continue;
+            if ( header + header_size - lengths < 4 )
+                return -1;
+            lengths[0] = nalu->size >> 24;
+            lengths[1] = nalu->size >> 16;
+            lengths[2] = nalu->size >> 8;
+            lengths[3] = nalu->size;
+            n = iov_add( iov, n, iov_max, lengths, 4 );
+            if ( n >= 0 )
+                n = iov_add( iov, n, iov_max, nalu->addr, nalu->size );
+            lengths += 4;
+        }
+    }
+    if ( n < 0 )
+        return -1;
+
+    w->sequence_number++;
+    w->decode_time += duration;
+    return n;
+}
@@ -0,0 +1,56 @@
+// Last Update:2026-10-17 16:48:20
+/**
+ * @file hevc_fmp4.h
+ * @brief fragmented MP4 (CMAF) writer for one HEVC track
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_FMP4_H
+#define HEVC_FMP4_H
+
+#include <stdint.h>
+#include "hevc.h"
+
+struct iovec;
+
+typedef struct HevcFmp4Writer {
+    uint32_t track_id;
+    uint32_t timescale;
+    uint32_t default_duration;  // of a sample, in timescale units
+    uint32_t width;
+    uint32_t height;
+    uint32_t sequence_number;   // of the next moof
+    uint64_t decode_time;       // baseMediaDecodeTime of the next fragment
+} HevcFmp4Writer;
+
+/* one access unit, as Annex-B NAL units */
+typedef struct HevcFmp4Sample {
+    const NalUnit *nalu;
+    int nalu_count;
+    uint32_t duration;          // 0 for default_duration
+    int32_t cts_offset;         // PTS - DTS
+} HevcFmp4Sample;
+
+/*
+ * Size, timescale and sample duration from the SPS: the VUI timing when it
+ * is there, 90kHz at 25 fps otherwise.
+ */
+extern void hevc_fmp4_init( HevcFmp4Writer *w, const HEVCSPS *sps );
+/* ftyp + moov with an hvc1 sample entry, returns bytes written or -1 */
+extern int hevc_fmp4_init_segment( const HevcFmp4Writer *w, const HEVCDecoderConfigurationRecord *config,
+                                   uint8_t *out, int size );
+/* header bytes hevc_fmp4_media_segment() needs at most */
+extern int hevc_fmp4_header_size( int sample_count, int nalu_count );
+/*
+ * moof + mdat for the samples, as spans for writev(): moof, the mdat header
+ * and the 4 byte NAL lengths are written into header, the NAL payloads are
+ * referenced where they are. VPS/SPS/PPS are left out of the samples, they
+ * are in the hvcC. An access unit with an IRAP picture is a sync sample.
+ * Returns the number of spans, -1 if header or iov is too small.
+ */
+extern int hevc_fmp4_media_segment( HevcFmp4Writer *w, const HevcFmp4Sample *samples, int count,
+                                    uint8_t *header, int header_size, struct iovec *iov, int iov_max );
+
+#endif  /*HEVC_FMP4_H*/
@@ -0,0 +1,174 @@
+// Last Update:2026-10-17 17:20:45
+/**
+ * @file hevc_gop.c
+ * @brief per stream ring of the current GOP, shared by many readers
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "hevc_gop.h"
+
+/*
+ * A slot's state is the sequence number of the NAL it holds in the upper 32
+ * bits and the readers taking a reference on it in the lower ones. Readers
+ * pin a slot with a CAS that also checks the sequence number, so they never
+ * touch a NAL the writer has released; the writer sets SLOT_CLOSING before
+ * replacing a NAL and waits for the pins already in flight, a few
+ * instructions each.
+ */
+#define SLOT_CLOSING 0x80000000u
+#define SLOT_PINS    0x7fffffffu
+
+#define JOIN_VALID   (1ULL << 32)
+
+typedef struct GopSlot {
+    _Atomic uint64_t state;
+    HevcGopNal *nal;
+} GopSlot;
+
+struct HevcGopRing {
+    GopSlot *slots;
+    uint32_t capacity;      // a power of 2
+    _Atomic uint32_t head;  // sequence number of the next NAL
+    _Atomic uint64_t join;  // JOIN_VALID | first NAL of the latest IRAP access unit
+    HevcAuDetector au;      // writer only, like au_start
+    uint32_t au_start;
+};
+
+void hevc_gop_nal_unref( HevcGopNal *nal )
+{
+    if ( nal && atomic_fetch_sub_explicit( &nal->refs, 1, memory_order_acq_rel ) == 1 )
+        free( nal );
+}
+
+HevcGopRing *hevc_gop_ring_new( int capacity )
+{
+    HevcGopRing *r;
+    uint32_t size = 2;
+
+    if ( capacity <= 0 || capacity > (1 << 30) )
+        return NULL;
+    while ( size < (uint32_t)capacity )
+        size *= 2;
+
+    r = calloc( 1, sizeof(*r) );
+    if ( !r )
+        return NULL;
+    r->slots = calloc( size, sizeof(GopSlot) );
+    if ( !r->slots ) {
+        free( r );
+        return NULL;
+    }
+
+    r->capacity = size;
+    hevc_au_init( &r->au );
+    return r;
+}
+
+void hevc_gop_ring_free( HevcGopRing *r )
+{
+    uint32_t i;
+
+    if ( !r )
+        return;
+
+    for ( i = 0; i < r->capacity; i++ )
+        hevc_gop_nal_unref( r->slots[i].nal );
+    free( r->slots );
+    free( r );
+}
+
+int hevc_gop_push( HevcGopRing *r, const NalUnit *nalu, int64_t timestamp )
+{
+    uint32_t seq, join_seq;
+    uint64_t join;
+    HevcGopNal *nal;
+    GopSlot *slot;
+
+    if ( !r || !nalu || nalu->size < 0 )
+        return -1;
+
+    nal = malloc( sizeof(*nal) + nalu->size );
+    if ( !nal )
+        return -1;
+    atomic_init( &nal->refs, 1 );   // the ring's
+    nal->nalu_type = nalu->nalu_type;
+    nal->size = nalu->size;
+    nal->timestamp = timestamp;
+    memcpy( nal->data, nalu->addr, nalu->size );
+
+    seq = atomic_load_explicit( &r->head, memory_order_relaxed );
+    slot = &r->slots[seq & (r->capacity - 1)];
+
+    // the GOP outgrew the ring, no join point until the next IRAP
+    join = atomic_load_explicit( &r->join, memory_order_relaxed );
+    join_seq = (uint32_t)join;
+    if ( (join & JOIN_VALID) && seq - join_seq >= r->capacity )
+        atomic_store_explicit( &r->join, 0, memory_order_release );
+
+    atomic_fetch_or_explicit( &slot->state, SLOT_CLOSING, memory_order_acquire );
+    while ( atomic_load_explicit( &slot->state, memory_order_acquire ) & SLOT_PINS )
+        sched_yield();
+    hevc_gop_nal_unref( slot->nal );
+    slot->nal = nal;
+    atomic_store_explicit( &slot->state, (uint64_t)seq << 32, memory_order_release );
+    atomic_store_explicit( &r->head, seq + 1, memory_order_release );
+
+    if ( hevc_au_starts( &r->au, nalu ) )
+        r->au_start = seq;
+    if ( HEVC_NAL_IS_IRAP( nalu->nalu_type ) && seq - r->au_start < r->capacity )
+        atomic_store_explicit( &r->join, JOIN_VALID | r->au_start, memory_order_release );
+
+    return 0;
+}
+
+int hevc_gop_join( HevcGopRing *r, uint32_t *cursor )
+{
+    uint64_t join;
+
+    if ( !r || !cursor )
+        return -1;
+
+    join = atomic_load_explicit( &r->join, memory_order_acquire );
+    if ( !(join & JOIN_VALID) )
+        return -1;
+    *cursor = (uint32_t)join;
+    return 0;
+}
+
+int hevc_gop_read( HevcGopRing *r, uint32_t *cursor, HevcGopNal **nal )
+{
+    uint32_t seq, head;
+    uint64_t state;
+    GopSlot *slot;
+
+    if ( !r || !cursor || !nal )
+        return -1;
+
+    seq = *cursor;
+    head = atomic_load_explicit( &r->head, memory_order_acquire );
+    if ( (int32_t)(head - seq) <= 0 )
+        return 0;
+    if ( head - seq > r->capacity )
+        return -1;
+
+    slot = &r->slots[seq & (r->capacity - 1)];
+    state = atomic_load_explicit( &slot->state, memory_order_acquire );
+    do {
+        if ( (uint32_t)(state >> 32) != seq || (state & SLOT_CLOSING) )
+            return -1;
+    } while ( !atomic_compare_exchange_weak_explicit( &slot->state, &state, state + 1,
+                                                      memory_order_acquire, memory_order_acquire ) );
+
+    *nal = slot->nal;
+    atomic_fetch_add_explicit( &(*nal)->refs, 1, memory_order_relaxed );
+    atomic_fetch_sub_explicit( &slot->state, 1, memory_order_release );
+
+    *cursor = seq + 1;
+    return 1;
+}
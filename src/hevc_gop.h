@@ -0,0 +1,57 @@
+// Last Update:2026-10-17 17:20:45
+/**
+ * @file hevc_gop.h
+ * @brief per stream ring of the current GOP, shared by many readers
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_GOP_H
+#define HEVC_GOP_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "hevc.h"
+
+/* one NAL unit, shared by every reader holding a reference */
+typedef struct HevcGopNal {
+    atomic_int refs;
+    uint8_t nalu_type;
+    int size;
+    int64_t timestamp;
+    uint8_t data[];
+} HevcGopNal;
+
+extern void hevc_gop_nal_unref( HevcGopNal *nal );
+
+/*
+ * One writer pushes the NAL units of a live stream, each copied once into a
+ * refcounted HevcGopNal. The ring remembers where the access unit of the
+ * latest IRAP picture starts (AUD/parameter sets included), the point a new
+ * reader joins at; everything before it is dropped by moving that index,
+ * the buffers are released as the writer reuses their slots.
+ *
+ * Readers are lock-free and only keep a cursor, any number of them can
+ * read concurrently with the writer. A reader that falls a whole ring
+ * behind gets -1 and joins again. capacity (in NAL units) has to hold the
+ * largest GOP, or there is no join point until the next IRAP.
+ */
+typedef struct HevcGopRing HevcGopRing;
+
+extern HevcGopRing *hevc_gop_ring_new( int capacity );
+/* only once no reader uses the ring anymore */
+extern void hevc_gop_ring_free( HevcGopRing *r );
+/* writer side, returns 0 or -1 when out of memory */
+extern int hevc_gop_push( HevcGopRing *r, const NalUnit *nalu, int64_t timestamp );
+
+/* set *cursor to the start of the latest IRAP access unit, -1 if there is none */
+extern int hevc_gop_join( HevcGopRing *r, uint32_t *cursor );
+/*
+ * returns 1 with *nal referenced (release it with hevc_gop_nal_unref())
+ * and *cursor moved on, 0 when there is nothing new, -1 when the NAL at
+ * *cursor was overwritten
+ */
+extern int hevc_gop_read( HevcGopRing *r, uint32_t *cursor, HevcGopNal **nal );
+
+#endif  /*HEVC_GOP_H*/
@@ -0,0 +1,425 @@
+// Last Update:2026-10-17 18:02:11
+/**
+ * @file hevc_index.c
+ * @brief seek index sidecar for raw Annex-B recordings
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hevc_file.h"
+#include "hevc_index.h"
+
+#define INDEX_MAGIC    "HEVCIDX1"
+#define INDEX_VERSION  2
+#define INDEX_BATCH    4096        // records written per fwrite()
+
+struct HevcIndex {
+    const uint8_t *map;
+    size_t map_size;
+    int64_t count;
+    uint64_t media_size;
+};
+
+static uint32_t get_le32( const uint8_t *p )
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64( const uint8_t *p )
+{
+    return get_le32( p ) | (uint64_t)get_le32( p + 4 ) << 32;
+}
+
+static void put_le32( uint8_t *p, uint32_t v )
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put_le64( uint8_t *p, uint64_t v )
+{
+    put_le32( p, v );
+    put_le32( p + 4, v >> 32 );
+}
+
+static void entry_read( const uint8_t *p, HevcIndexEntry *e )
+{
+    e->offset      = get_le64( p );
+    e->poc         = (int32_t)get_le32( p + 8 );
+    e->irap        = get_le32( p + 12 );
+    e->nalu_type   = p[16];
+    e->temporal_id = p[17];
+    e->vps_id      = p[18];
+    e->sps_id      = p[19];
+    e->pps_id      = p[20];
+}
+
+static void entry_write( uint8_t *p, const HevcIndexEntry *e )
+{
+    put_le64( p, e->offset );
+    put_le32( p + 8, (uint32_t)e->poc );
+    put_le32( p + 12, e->irap );
+    p[16] = e->nalu_type;
+    p[17] = e->temporal_id;
+    p[18] = e->vps_id;
+    p[19] = e->sps_id;
+    p[20] = e->pps_id;
+    p[21] = p[22] = p[23] = 0;
+}
+
+/* records past the count are not published yet, an update may be writing them */
+static int header_valid( const uint8_t *h, uint64_t file_size )
+{
+    return !memcmp( h, INDEX_MAGIC, 8 ) && get_le32( h + 8 ) == INDEX_VERSION &&
+           get_le32( h + 12 ) == HEVC_INDEX_ENTRY_SIZE &&
+           file_size >= HEVC_INDEX_HEADER_SIZE &&
+           get_le64( h + 24 ) <= (file_size - HEVC_INDEX_HEADER_SIZE) / HEVC_INDEX_ENTRY_SIZE;
+}
+
+static int header_write( FILE *f, uint64_t media_size, int64_t count )
+{
+    uint8_t h[HEVC_INDEX_HEADER_SIZE];
+
+    memcpy( h, INDEX_MAGIC, 8 );
+    put_le32( h + 8, INDEX_VERSION );
+    put_le32( h + 12, HEVC_INDEX_ENTRY_SIZE );
+    put_le64( h + 16, media_size );
+    put_le64( h + 24, count );
+    if ( fseek( f, 0, SEEK_SET ) || fwrite( h, sizeof(h), 1, f ) != 1 || fflush( f ) )
+        return -1;
+    return 0;
+}
+
+typedef struct IndexWriter {
+    FILE *f;
+    int64_t count;          // records scanned
+    int64_t kept;           // of them, the ones the sidecar already has
+    uint64_t indexed;       // bytes of the recording the records cover
+    uint8_t batch[INDEX_BATCH * HEVC_INDEX_ENTRY_SIZE];
+    int pending;
+} IndexWriter;
+
+static int writer_flush( IndexWriter *w )
+{
+    if ( w->pending &&
+         fwrite( w->batch, HEVC_INDEX_ENTRY_SIZE, w->pending, w->f ) != (size_t)w->pending )
+        return -1;
+    w->pending = 0;
+    return 0;
+}
+
+static int writer_add( IndexWriter *w, const HevcIndexEntry *e )
+{
+    if ( w->count++ < w->kept )
+        return 0;
+    entry_write( w->batch + w->pending * HEVC_INDEX_ENTRY_SIZE, e );
+    if ( ++w->pending == INDEX_BATCH )
+        return writer_flush( w );
+    return 0;
+}
+
+/*
+ * Where the scan picks up: the last random access point of a sidecar
+ * indexing at most media_size bytes, with the POC state it had there.
+ * kept gets the number of records the sidecar has, 0 if it is of no use.
+ */
+static uint64_t index_resume( FILE *f, uint64_t media_size, int64_t *count, int64_t *kept,
+                              HevcPocState *poc )
+{
+    uint8_t h[HEVC_INDEX_HEADER_SIZE], p[HEVC_INDEX_ENTRY_SIZE];
+    HevcIndexEntry e;
+    struct stat st;
+    int64_t n;
+
+    *count = *kept = 0;
+    hevc_poc_init( poc );
+
+    if ( fstat( fileno( f ), &st ) < 0 || fseek( f, 0, SEEK_SET ) ||
+         fread( h, sizeof(h), 1, f ) != 1 || !header_valid( h, st.st_size ) ||
+         get_le64( h + 16 ) > media_size )
+        return 0;
+
+    n = get_le64( h + 24 );
+    if ( !n || fseek( f, HEVC_INDEX_HEADER_SIZE + (n - 1) * HEVC_INDEX_ENTRY_SIZE, SEEK_SET ) ||
+         fread( p, sizeof(p), 1, f ) != 1 )
+        return 0;
+    entry_read( p, &e );
+    if ( e.irap == HEVC_INDEX_NO_IRAP || e.irap >= n ||
+         fseek( f, HEVC_INDEX_HEADER_SIZE + (int64_t)e.irap * HEVC_INDEX_ENTRY_SIZE, SEEK_SET ) ||
+         fread( p, sizeof(p), 1, f ) != 1 )
+        return 0;
+    entry_read( p, &e );
+    if ( e.offset >= media_size )
+        return 0;
+
+    // the IRAP gets the POC it had when the scan went through it
+    if ( e.poc != HEVC_INDEX_NO_POC ) {
+        poc->prev_tid0_poc = e.poc;
+        poc->no_rasl_output = 0;
+    }
+    *count = e.irap;
+    *kept = n;
+    return e.offset;
+}
+
+static int have_pps( const HEVCParamSets *ps )
+{
+    int i;
+
+    for ( i = 0; i < HEVC_MAX_PPS_COUNT; i++ )
+        if ( ps->pps[i] )
+            return 1;
+    return 0;
+}
+
+/* returns 0, 1 when a resumed scan has to start over, -1 on error */
+static int index_scan( IndexWriter *w, HevcFileSource *src, uint64_t start,
+                       HevcPocState *poc, int resumed )
+{
+    const uint8_t *end = hevc_file_data( src ) + hevc_file_size( src );
+    uint32_t irap = HEVC_INDEX_NO_IRAP;
+    uint64_t au_offset = start, offset;
+    int au_indexed = 1, ret = 0;
+    HevcAuDetector au;
+    HEVCParamSets ps;
+    NalUnit nalu;
+
+    if ( hevc_file_seek( src, start ) < 0 )
+        return 0;
+    hevc_au_init( &au );
+    hevc_ps_init( &ps );
+
+    while ( hevc_file_next_nalu( src, &nalu, &offset ) ) {
+        HEVCSliceHeader sh;
+        HevcIndexEntry e;
+
+        if ( hevc_au_starts( &au, &nalu ) ) {
+            au_offset = offset;
+            au_indexed = 0;
+        }
+
+        if ( nalu.nalu_type == HEVC_NAL_VPS || nalu.nalu_type == HEVC_NAL_SPS ||
+             nalu.nalu_type == HEVC_NAL_PPS ) {
+            hevc_ps_parse( &ps, &nalu );
+            continue;
+        }
+        if ( nalu.nalu_type == HEVC_NAL_EOS_NUT )
+            hevc_poc_eos( poc );
+        if ( !HEVC_NAL_IS_VCL( nalu.nalu_type ) || au_indexed || nalu.size < 2 )
+            continue;
+
+        au_indexed = 1;
+        if ( HEVC_NAL_IS_IRAP( nalu.nalu_type ) )
+            irap = w->count;
+        e.offset = au_offset;
+        e.poc = HEVC_INDEX_NO_POC;
+        e.irap = irap;
+        e.nalu_type = nalu.nalu_type;
+        e.temporal_id = (nalu.addr[1] & 0x07) - 1;
+        e.vps_id = e.sps_id = e.pps_id = 0xff;
+
+        if ( hevc_parse_slice_header( &ps, &nalu, &sh ) == 0 ) {
+            const HEVCSPS *sps = ps.sps[ps.pps[sh.pps_id]->sps_id];
+
+            e.pps_id = sh.pps_id;
+            e.sps_id = sps->sps_id;
+            e.vps_id = sps->vps_id;
+            e.poc = hevc_poc_compute( poc, sps, &sh );
+        } else if ( resumed && !have_pps( &ps ) ) {
+            ret = 1;    // parameter sets only at the start of the file
+            goto out;
+        } else if ( nalu.addr + nalu.size == end ) {
+            // still being written: records are never rewritten, this one waits
+            w->indexed = au_offset;
+            goto out;
+        }
+
+        if ( writer_add( w, &e ) < 0 ) {
+            ret = -1;
+            goto out;
+        }
+    }
+
+out:
+    hevc_ps_free( &ps );
+    return ret;
+}
+
+int64_t hevc_index_update( const char *media, const char *sidecar )
+{
+    HevcFileSource *src;
+    IndexWriter *w = NULL;
+    HevcPocState poc;
+    uint64_t size, start = 0;
+    int64_t ret = -1;
+    char *tmp = NULL;
+    int resumed;
+
+    if ( !media || !sidecar || !(src = hevc_file_open( media, 0 )) )
+        return -1;
+    size = hevc_file_size( src );
+
+    w = calloc( 1, sizeof(*w) );
+    if ( !w )
+        goto out;
+    if ( (w->f = fopen( sidecar, "r+b" )) )
+        start = index_resume( w->f, size, &w->count, &w->kept, &poc );
+
+    // nothing to append to: a new sidecar replaces the old one with rename()
+    if ( !w->kept ) {
+        if ( w->f )
+            fclose( w->f );
+        if ( !(tmp = malloc( strlen( sidecar ) + 5 )) )
+            goto out;
+        sprintf( tmp, "%s.tmp", sidecar );
+        if ( !(w->f = fopen( tmp, "w+b" )) )
+            goto out;
+        start = 0;
+        w->count = 0;
+        hevc_poc_init( &poc );
+    }
+
+    // the records the sidecar has are scanned again, not written
+    resumed = w->kept > 0;
+    for ( ;; ) {
+        int scan;
+
+        if ( fseek( w->f, HEVC_INDEX_HEADER_SIZE + w->kept * HEVC_INDEX_ENTRY_SIZE, SEEK_SET ) )
+            goto out;
+        w->pending = 0;
+        w->indexed = size;
+        scan = index_scan( w, src, start, &poc, resumed );
+        if ( scan < 0 )
+            goto out;
+        if ( !scan )
+            break;
+        w->count = 0;
+        start = 0;
+        resumed = 0;
+        hevc_poc_init( &poc );
+    }
+
+    // the header publishes the records, it goes last
+    if ( w->count < w->kept || writer_flush( w ) < 0 || fflush( w->f ) ||
+         header_write( w->f, w->indexed, w->count ) < 0 )
+        goto out;
+    ret = w->count;
+
+out:
+    if ( w && w->f && fclose( w->f ) )
+        ret = -1;
+    if ( tmp ) {
+        if ( ret >= 0 && rename( tmp, sidecar ) < 0 )
+            ret = -1;
+        if ( ret < 0 )
+            unlink( tmp );
+        free( tmp );
+    }
+    free( w );
+    hevc_file_close( src );
+    return ret;
+}
+
+HevcIndex *hevc_index_open( const char *sidecar )
+{
+    HevcIndex *idx = NULL;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if ( !sidecar || (fd = open( sidecar, O_RDONLY )) < 0 )
+        return NULL;
+    if ( fstat( fd, &st ) < 0 || st.st_size < HEVC_INDEX_HEADER_SIZE )
+        goto out;
+
+    map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    if ( map == MAP_FAILED )
+        goto out;
+    if ( !header_valid( map, st.st_size ) || !(idx = calloc( 1, sizeof(*idx) )) ) {
+        munmap( map, st.st_size );
+        goto out;
+    }
+
+    idx->map = map;
+    idx->map_size = st.st_size;
+    idx->count = get_le64( idx->map + 24 );
+    idx->media_size = get_le64( idx->map + 16 );
+
+out:
+    close( fd );
+    return idx;
+}
+
+void hevc_index_close( HevcIndex *idx )
+{
+    if ( !idx )
+        return;
+    munmap( (void *)idx->map, idx->map_size );
+    free( idx );
+}
+
+int64_t hevc_index_count( const HevcIndex *idx )
+{
+    return idx ? idx->count : 0;
+}
+
+uint64_t hevc_index_media_size( const HevcIndex *idx )
+{
+    return idx ? idx->media_size : 0;
+}
+
+static const uint8_t *entry_at( const HevcIndex *idx, int64_t i )
+{
+    return idx->map + HEVC_INDEX_HEADER_SIZE + i * HEVC_INDEX_ENTRY_SIZE;
+}
+
+int hevc_index_get( const HevcIndex *idx, int64_t i, HevcIndexEntry *e )
+{
+    if ( !idx || !e || i < 0 || i >= idx->count )
+        return -1;
+    entry_read( entry_at( idx, i ), e );
+    return 0;
+}
+
+int64_t hevc_index_find( const HevcIndex *idx, uint64_t offset )
+{
+    int64_t lo = 0, hi;
+
+    if ( !idx )
+        return -1;
+
+    // first record starting after offset
+    hi = idx->count;
+    while ( lo < hi ) {
+        int64_t mid = lo + (hi - lo) / 2;
+
+        if ( get_le64( entry_at( idx, mid ) ) <= offset )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+int64_t hevc_index_seek( const HevcIndex *idx, int64_t i )
+{
+    uint32_t irap;
+
+    if ( !idx || i < 0 || i >= idx->count )
+        return -1;
+    irap = get_le32( entry_at( idx, i ) + 12 );
+    if ( irap == HEVC_INDEX_NO_IRAP )
+        return -1;
+    return irap;
+}
@@ -0,0 +1,67 @@
+// Last Update:2026-10-17 18:02:11
+/**
+ * @file hevc_index.h
+ * @brief seek index sidecar for raw Annex-B recordings
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_INDEX_H
+#define HEVC_INDEX_H
+
+#include <stdint.h>
+#include "hevc.h"
+
+/*
+ * The sidecar holds one fixed size little-endian record per access unit,
+ * behind a 32 byte header ("HEVCIDX1", version, record size, bytes of the
+ * recording indexed so far, number of records), so it is looked up
+ * straight from a mapping. Records are in file order; the n-th one is the
+ * n-th picture. Records past the number in the header are ignored.
+ */
+#define HEVC_INDEX_HEADER_SIZE 32
+#define HEVC_INDEX_ENTRY_SIZE  24
+#define HEVC_INDEX_NO_POC      INT32_MIN
+#define HEVC_INDEX_NO_IRAP     0xffffffffu
+
+typedef struct HevcIndexEntry {
+    uint64_t offset;        // of the start code opening the access unit
+    int32_t  poc;           // HEVC_INDEX_NO_POC if the slice header could not be parsed
+    uint32_t irap;          // record of the random access point decoding starts at
+    uint8_t  nalu_type;     // of the first VCL NAL unit
+    uint8_t  temporal_id;
+    uint8_t  vps_id;        // 0xff when unknown, like sps_id and pps_id
+    uint8_t  sps_id;
+    uint8_t  pps_id;
+} HevcIndexEntry;
+
+/*
+ * Create or bring up to date the sidecar of a recording that may still be
+ * growing. Records of an existing sidecar are never rewritten: the
+ * recording is scanned again from the last random access point, to get
+ * the parameter sets and the POC back, and only the records after the
+ * last one are appended, the header counting them is written after them.
+ * Parameter sets are expected to be repeated at IRAP pictures (the whole
+ * file is scanned again when they are not). A picture whose slice header
+ * is cut by the end of the recording is left for the next update. A
+ * sidecar that can't be appended to is replaced with rename(), so one
+ * mapped by hevc_index_open() stays valid. Returns the number of records,
+ * -1 on error.
+ */
+extern int64_t hevc_index_update( const char *media, const char *sidecar );
+
+typedef struct HevcIndex HevcIndex;
+
+extern HevcIndex *hevc_index_open( const char *sidecar );
+extern void hevc_index_close( HevcIndex *idx );
+extern int64_t hevc_index_count( const HevcIndex *idx );
+/* bytes of the recording covered by the index */
+extern uint64_t hevc_index_media_size( const HevcIndex *idx );
+extern int hevc_index_get( const HevcIndex *idx, int64_t i, HevcIndexEntry *e );
+/* last access unit starting at or before offset, -1 if none */
+extern int64_t hevc_index_find( const HevcIndex *idx, uint64_t offset );
+/* record to start decoding at to show access unit i, -1 if there is none */
+extern int64_t hevc_index_seek( const HevcIndex *idx, int64_t i );
+
+#endif  /*HEVC_INDEX_H*/
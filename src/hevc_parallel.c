@@ -0,0 +1,181 @@
+// Last Update:2026-10-17 19:15:02
+/**
+ * @file hevc_parallel.c
+ * @brief NAL indexing of large buffers on several threads
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "hevc.h"
+#include "startcode.h"
+
+#define SCAN_MAX_THREADS 256
+#define SCAN_MIN_CHUNK   (1024*1024)    // below that a thread costs more than it scans
+
+/*
+ * 00 00 01 patterns can't overlap, so the serial scan finds every one of
+ * them; a chunk owns those starting inside it and reads 2 bytes past its
+ * end to see them. The NAL before a start code ends at its leading zero
+ * byte, which only needs the bytes before the start code.
+ */
+typedef struct ScanChunk {
+    const uint8_t *begin;   // patterns starting in [begin, stop)
+    const uint8_t *stop;
+    const uint8_t *end;     // of the buffer
+    NalUnit *nalu;
+    int count;
+    int capacity;
+    int error;
+    const uint8_t *first;   // start code, NULL when the chunk has none
+    int closed;             // ends with the start code closing the buffer
+    pthread_t thread;
+} ScanChunk;
+
+/* end of the NAL at addr, given the start code after it */
+static const uint8_t *nal_end( const uint8_t *addr, const uint8_t *startcode )
+{
+    return startcode > addr && !startcode[-1] ? startcode - 1 : startcode;
+}
+
+static int nal_size( NalUnit *nalu, const uint8_t *end )
+{
+    if ( end - nalu->addr > INT_MAX )
+        return -1;
+    nalu->size = end - nalu->addr;
+    return 0;
+}
+
+static void *scan_chunk( void *arg )
+{
+    ScanChunk *c = arg;
+    const uint8_t *limit = c->end - c->stop > 2 ? c->stop + 2 : c->end;
+    const uint8_t *p = c->begin, *q;
+
+    while ( (q = startcode_find( p, limit )) < limit ) {
+        NalUnit *nalu;
+
+        if ( !c->first )
+            c->first = q;
+        if ( c->count && nal_size( &c->nalu[c->count-1], nal_end( c->nalu[c->count-1].addr, q ) ) < 0 )
+            goto err;
+        // a start code closing the buffer has no NAL after it
+        if ( q + 3 >= c->end ) {
+            c->closed = 1;
+            break;
+        }
+        if ( c->count == c->capacity ) {
+            int capacity = c->capacity ? c->capacity * 2 : 1024;
+
+            if ( !(nalu = realloc( c->nalu, capacity * sizeof(NalUnit) )) )
+                goto err;
+            c->nalu = nalu;
+            c->capacity = capacity;
+        }
+        nalu = &c->nalu[c->count++];
+        nalu->addr = q + 3;
+        nalu->nalu_type = (q[3] >> 1) & 0x3f;
+        nalu->size = 0;
+        p = q + 3;
+    }
+    return NULL;
+
+err:
+    c->error = 1;
+    return NULL;
+}
+
+int hevc_nalu_list_parse_mt( NalUnitList *list, const uint8_t *data_in, size_t size, int threads )
+{
+    ScanChunk *chunks;
+    size_t chunk_size;
+    int i, total = 0, ret = -1;
+
+    if ( !list || (!data_in && size) )
+        return -1;
+
+    if ( threads <= 0 ) {
+        long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+
+        threads = cpus > 0 ? cpus : 1;
+        if ( (size_t)threads > size / SCAN_MIN_CHUNK )
+            threads = size / SCAN_MIN_CHUNK ? size / SCAN_MIN_CHUNK : 1;
+    }
+    if ( threads > SCAN_MAX_THREADS )
+        threads = SCAN_MAX_THREADS;
+    if ( (size_t)threads > size )
+        threads = size ? size : 1;
+    if ( threads == 1 && size <= INT_MAX )
+        return hevc_nalu_list_parse( list, data_in, size );
+
+    chunks = calloc( threads, sizeof(ScanChunk) );
+    if ( !chunks )
+        return -1;
+
+    chunk_size = size / threads;
+    for ( i = 0; i < threads; i++ ) {
+        ScanChunk *c = &chunks[i];
+
+        c->begin = data_in + i * chunk_size;
+        c->stop = i == threads - 1 ? data_in + size : c->begin + chunk_size;
+        c->end = data_in + size;
+        // the first chunk runs here; a thread that can't start too
+        if ( i == 0 || pthread_create( &c->thread, NULL, scan_chunk, c ) ) {
+            c->thread = pthread_self();
+            if ( i )
+                scan_chunk( c );
+        }
+    }
+    scan_chunk( &chunks[0] );
+    for ( i = 1; i < threads; i++ )
+        if ( !pthread_equal( chunks[i].thread, pthread_self() ) )
+            pthread_join( chunks[i].thread, NULL );
+
+    // the last NAL of a chunk ends at the first start code of a later one
+    for ( i = 0; i < threads; i++ ) {
+        ScanChunk *c = &chunks[i];
+        const uint8_t *end = data_in + size;
+        int k;
+
+        if ( c->error || total > INT_MAX - c->count )
+            goto out;
+        total += c->count;
+        if ( !c->count || c->closed )
+            continue;
+        for ( k = i + 1; k < threads; k++ )
+            if ( chunks[k].first ) {
+                end = nal_end( c->nalu[c->count-1].addr, chunks[k].first );
+                break;
+            }
+        if ( nal_size( &c->nalu[c->count-1], end ) < 0 )
+            goto out;
+    }
+
+    if ( total > list->capacity ) {
+        NalUnit *nalu = realloc( list->nalu, total * sizeof(NalUnit) );
+
+        if ( !nalu )
+            goto out;
+        list->nalu = nalu;
+        list->capacity = total;
+    }
+    list->count = 0;
+    for ( i = 0; i < threads; i++ ) {
+        if ( chunks[i].count )
+            memcpy( list->nalu + list->count, chunks[i].nalu, chunks[i].count * sizeof(NalUnit) );
+        list->count += chunks[i].count;
+    }
+    ret = list->count;
+
+out:
+    for ( i = 0; i < threads; i++ )
+        free( chunks[i].nalu );
+    free( chunks );
+    return ret;
+}
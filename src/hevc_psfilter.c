@@ -0,0 +1,179 @@
+// Last Update:2026-10-17 22:48:19
+/**
+ * @file hevc_psfilter.c
+ * @brief drop repeated parameter sets, re-inject them for new consumers
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bs.h"
+#include "hevc.h"
+
+#define PSFILTER_MAX_SETS (HEVC_MAX_VPS_COUNT + HEVC_MAX_SPS_COUNT + HEVC_MAX_PPS_COUNT)
+
+void hevc_psfilter_init( HevcPsFilter *f )
+{
+    memset( f, 0, sizeof(*f) );
+    hevc_ps_init( &f->ps );
+    hevc_au_init( &f->au );
+}
+
+void hevc_psfilter_free( HevcPsFilter *f )
+{
+    if ( !f )
+        return;
+    hevc_ps_free( &f->ps );
+    free( f->inject );
+    f->inject = NULL;
+    f->inject_capacity = 0;
+}
+
+void hevc_psfilter_request( HevcPsFilter *f )
+{
+    if ( f )
+        f->pending = 1;
+}
+
+static int psfilter_is_ps( int type )
+{
+    return type == HEVC_NAL_VPS || type == HEVC_NAL_SPS || type == HEVC_NAL_PPS;
+}
+
+static int pps_id( const NalUnit *nalu )
+{
+    bs_t bs;
+    uint32_t id;
+
+    bs_init_nal( &bs, nalu->addr + 2, nalu->size - 2 );
+    id = bs_read_ue( &bs );
+    return id < HEVC_MAX_PPS_COUNT ? (int)id : -1;
+}
+
+/* store the set, returns 1 when it has to go out, -1 when it can't be parsed */
+static int psfilter_update( HevcPsFilter *f, const NalUnit *nalu )
+{
+    int r = hevc_ps_parse( &f->ps, nalu ), id;
+
+    // some decoders forget the PPSs of a VPS/SPS that changed
+    if ( r > 0 && nalu->nalu_type != HEVC_NAL_PPS )
+        f->pps_resend = ~0ULL;
+    if ( nalu->nalu_type == HEVC_NAL_PPS && (id = pps_id( nalu )) >= 0 &&
+         (f->pps_resend >> id) & 1 ) {
+        f->pps_resend &= ~(1ULL << id);
+        return 1;
+    }
+    // what can't be parsed goes through as it is, even where sets are injected
+    return r < 0 ? -1 : r > 0;
+}
+
+static void inject_add( HevcPsFilter *f, const HEVCParamSetNal *slots, int count, int type,
+                        NalUnitList *out, size_t *pos )
+{
+    int i;
+
+    for ( i = 0; i < count; i++ ) {
+        NalUnit *nalu;
+
+        if ( !slots[i].size )
+            continue;
+        memcpy( f->inject + *pos, slots[i].data, slots[i].size );
+        nalu = &out->nalu[out->count++];
+        nalu->nalu_type = type;
+        nalu->addr = f->inject + *pos;
+        nalu->size = slots[i].size;
+        *pos += slots[i].size;
+        f->bytes_injected += slots[i].size;
+    }
+}
+
+/* copy every stored set to the injection buffer and list it in out */
+static int psfilter_inject( HevcPsFilter *f, NalUnitList *out )
+{
+    size_t size = 0, pos = 0;
+    int i;
+
+    for ( i = 0; i < HEVC_MAX_VPS_COUNT; i++ )
+        size += f->ps.vps_nal[i].size;
+    for ( i = 0; i < HEVC_MAX_SPS_COUNT; i++ )
+        size += f->ps.sps_nal[i].size;
+    for ( i = 0; i < HEVC_MAX_PPS_COUNT; i++ )
+        size += f->ps.pps_nal[i].size;
+    if ( size > f->inject_capacity ) {
+        uint8_t *inject = realloc( f->inject, size );
+
+        if ( !inject )
+            return -1;
+        f->inject = inject;
+        f->inject_capacity = size;
+    }
+
+    inject_add( f, f->ps.vps_nal, HEVC_MAX_VPS_COUNT, HEVC_NAL_VPS, out, &pos );
+    inject_add( f, f->ps.sps_nal, HEVC_MAX_SPS_COUNT, HEVC_NAL_SPS, out, &pos );
+    inject_add( f, f->ps.pps_nal, HEVC_MAX_PPS_COUNT, HEVC_NAL_PPS, out, &pos );
+    f->pending = 0;
+    f->pps_resend = 0;
+    return 0;
+}
+
+int hevc_psfilter_run( HevcPsFilter *f, NalUnitList *out, const NalUnitList *in )
+{
+    int i, k;
+
+    if ( !f || !out || !in || out == in )
+        return -1;
+
+    // one injection per call at most, request() comes between calls
+    if ( out->capacity < in->count + PSFILTER_MAX_SETS ) {
+        NalUnit *nalu = realloc( out->nalu, (in->count + PSFILTER_MAX_SETS) * sizeof(NalUnit) );
+
+        if ( !nalu )
+            return -1;
+        out->nalu = nalu;
+        out->capacity = in->count + PSFILTER_MAX_SETS;
+    }
+
+    out->count = 0;
+    for ( i = 0; i < in->count; i++ ) {
+        const NalUnit *nalu = &in->nalu[i];
+        int type = nalu->nalu_type;
+
+        if ( hevc_au_starts( &f->au, nalu ) ) {
+            f->inject_au = 0;
+            f->au_vcl = 0;
+            // an IRAP access unit gets its sets from us, ahead of its first slice
+            for ( k = i; f->pending && k < in->count; k++ )
+                if ( HEVC_NAL_IS_VCL( in->nalu[k].nalu_type ) ) {
+                    f->inject_au = HEVC_NAL_IS_IRAP( in->nalu[k].nalu_type );
+                    break;
+                }
+        }
+
+        if ( psfilter_is_ps( type ) && nalu->size > 2 ) {
+            int send = psfilter_update( f, nalu );
+
+            if ( f->inject_au && !f->au_vcl && send >= 0 ) {
+                f->bytes_dropped += nalu->size;
+                continue;
+            }
+            if ( !send ) {
+                f->bytes_dropped += nalu->size;
+                continue;
+            }
+        }
+
+        if ( HEVC_NAL_IS_VCL( type ) && !f->au_vcl ) {
+            f->au_vcl = 1;
+            if ( (f->inject_au || (f->pending && HEVC_NAL_IS_IRAP( type ))) &&
+                 psfilter_inject( f, out ) < 0 )
+                return -1;
+            f->inject_au = 0;
+        }
+        out->nalu[out->count++] = *nalu;
+    }
+
+    return out->count;
+}
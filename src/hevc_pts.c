@@ -0,0 +1,223 @@
+// Last Update:2026-10-18 00:21:37
+/**
+ * @file hevc_pts.c
+ * @brief PTS/DTS of raw Annex-B pictures, from the POC and the VUI timing
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hevc_pts.h"
+
+#define PTS_QUEUE 64        // a stream reordering deeper than this is broken
+
+typedef struct PtsEntry {
+    HevcTimestamp ts;
+    int out;                // bumped, pts is set
+} PtsEntry;
+
+struct HevcPtsGen {
+    uint32_t timescale;
+    uint32_t default_tick;
+    uint32_t default_scale;
+    /* picture f is at origin_time + (f - origin_frame) * tick / scale seconds */
+    uint32_t tick;
+    uint32_t scale;
+    uint64_t origin_frame;
+    int64_t  origin_time;
+    int reorder;            // of the active SPS
+    int delay;              // largest reorder so far, the PTS offset
+    uint64_t decoded;
+    uint64_t output;
+    int64_t last_pts;
+    PtsEntry queue[PTS_QUEUE];  // decoding order, from head
+    int head;
+    int count;
+    int waiting;            // not bumped
+    HEVCParamSets ps;
+    HevcPocState poc;
+    HevcTimestampCallback cb;
+    void *opaque;
+};
+
+HevcPtsGen *hevc_pts_new( uint32_t timescale, HevcTimestampCallback cb, void *opaque )
+{
+    HevcPtsGen *g;
+
+    if ( !cb || !(g = calloc( 1, sizeof(*g) )) )
+        return NULL;
+    g->timescale = timescale ? timescale : 90000;
+    g->default_tick = g->tick = 1;
+    g->default_scale = g->scale = 25;
+    g->last_pts = INT64_MIN;
+    hevc_ps_init( &g->ps );
+    hevc_poc_init( &g->poc );
+    g->cb = cb;
+    g->opaque = opaque;
+    return g;
+}
+
+void hevc_pts_free( HevcPtsGen *g )
+{
+    if ( !g )
+        return;
+    hevc_ps_free( &g->ps );
+    free( g );
+}
+
+void hevc_pts_set_frame_rate( HevcPtsGen *g, uint32_t num_units_in_tick, uint32_t time_scale )
+{
+    if ( g && num_units_in_tick && time_scale ) {
+        g->default_tick = num_units_in_tick;
+        g->default_scale = time_scale;
+    }
+}
+
+/* n pictures in the timescale, without the rounding adding up */
+static int64_t pts_span( const HevcPtsGen *g, uint64_t n )
+{
+    uint64_t a = n * g->tick;
+
+    return a / g->scale * g->timescale + a % g->scale * g->timescale / g->scale;
+}
+
+static int64_t pts_time( const HevcPtsGen *g, uint64_t frame )
+{
+    if ( frame < g->origin_frame )
+        return g->origin_time - pts_span( g, g->origin_frame - frame );
+    return g->origin_time + pts_span( g, frame - g->origin_frame );
+}
+
+/* a new picture duration from the next picture on, keeping DTS and PTS increasing */
+static void pts_rebase( HevcPtsGen *g, uint32_t tick, uint32_t scale )
+{
+    int64_t next;
+
+    g->origin_time = pts_time( g, g->decoded );
+    g->origin_frame = g->decoded;
+    g->tick = tick;
+    g->scale = scale;
+    // the next PTS may come out earlier with a shorter duration or delay
+    next = pts_time( g, g->output + g->delay );
+    if ( g->last_pts != INT64_MIN && next <= g->last_pts )
+        g->origin_time += g->last_pts - next + pts_span( g, 1 );
+}
+
+/* output the waiting picture with the lowest POC */
+static void pts_bump( HevcPtsGen *g )
+{
+    PtsEntry *min = NULL;
+    int i;
+
+    for ( i = 0; i < g->count; i++ ) {
+        PtsEntry *e = &g->queue[(g->head + i) % PTS_QUEUE];
+
+        if ( !e->out && (!min || e->ts.poc < min->ts.poc) )
+            min = e;
+    }
+    if ( !min )
+        return;
+    min->out = 1;
+    min->ts.pts = pts_time( g, g->output + g->delay );
+    g->last_pts = min->ts.pts;
+    g->output++;
+    g->waiting--;
+}
+
+/* hand out the pictures with a PTS, in decoding order */
+static void pts_emit( HevcPtsGen *g )
+{
+    while ( g->count && g->queue[g->head].out ) {
+        g->cb( &g->queue[g->head].ts, g->opaque );
+        g->head = (g->head + 1) % PTS_QUEUE;
+        g->count--;
+    }
+}
+
+static void pts_drain( HevcPtsGen *g )
+{
+    while ( g->waiting )
+        pts_bump( g );
+    pts_emit( g );
+}
+
+static int pts_picture( HevcPtsGen *g, const NalUnit *nalu )
+{
+    const HEVCSPS *sps;
+    HEVCSliceHeader sh;
+    PtsEntry *e;
+    uint32_t tick, scale;
+    int new_cvs;
+
+    if ( hevc_parse_slice_header( &g->ps, nalu, &sh ) < 0 )
+        return -1;
+    sps = g->ps.sps[g->ps.pps[sh.pps_id]->sps_id];
+
+    // a coded video sequence restarts the POC, the pictures before go out first
+    new_cvs = HEVC_NAL_IS_IRAP( sh.nal_unit_type ) &&
+              (sh.nal_unit_type < HEVC_NAL_CRA_NUT || g->poc.no_rasl_output);
+    if ( new_cvs )
+        pts_drain( g );
+
+    g->reorder = sps->max_num_reorder_pics[sps->max_sub_layers - 1];
+    if ( g->reorder > g->delay )
+        g->delay = g->reorder;
+    tick = g->default_tick;
+    scale = g->default_scale;
+    if ( sps->timing_info_present_flag && sps->num_units_in_tick && sps->time_scale ) {
+        tick = sps->num_units_in_tick;
+        scale = sps->time_scale;
+    }
+    if ( tick != g->tick || scale != g->scale || (new_cvs && g->decoded) )
+        pts_rebase( g, tick, scale );
+
+    // reordering deeper than the queue: the oldest picture goes out anyway
+    while ( g->count == PTS_QUEUE ) {
+        pts_bump( g );
+        pts_emit( g );
+    }
+
+    e = &g->queue[(g->head + g->count++) % PTS_QUEUE];
+    e->out = 0;
+    e->ts.index = g->decoded;
+    e->ts.dts = pts_time( g, g->decoded );
+    e->ts.pts = e->ts.dts;
+    e->ts.poc = hevc_poc_compute( &g->poc, sps, &sh );
+    e->ts.nalu_type = sh.nal_unit_type;
+    g->decoded++;
+    g->waiting++;
+
+    while ( g->waiting > g->reorder )
+        pts_bump( g );
+    pts_emit( g );
+    return 1;
+}
+
+int hevc_pts_push( HevcPtsGen *g, const NalUnit *nalu )
+{
+    if ( !g || !nalu || nalu->size < 2 )
+        return -1;
+
+    switch ( nalu->nalu_type ) {
+    case HEVC_NAL_VPS:
+    case HEVC_NAL_SPS:
+    case HEVC_NAL_PPS:
+        hevc_ps_parse( &g->ps, nalu );
+        return 0;
+    case HEVC_NAL_EOS_NUT:
+        hevc_poc_eos( &g->poc );
+        return 0;
+    }
+    // first_slice_segment_in_pic_flag is the first payload bit
+    if ( !HEVC_NAL_IS_VCL( nalu->nalu_type ) || nalu->size < 3 || !(nalu->addr[2] & 0x80) )
+        return 0;
+    return pts_picture( g, nalu );
+}
+
+void hevc_pts_flush( HevcPtsGen *g )
+{
+    if ( g )
+        pts_drain( g );
+}
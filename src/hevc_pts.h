@@ -0,0 +1,58 @@
+// Last Update:2026-10-17 23:58:10
+/**
+ * @file hevc_pts.h
+ * @brief PTS/DTS of raw Annex-B pictures, from the POC and the VUI timing
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_PTS_H
+#define HEVC_PTS_H
+
+#include <stdint.h>
+#include "hevc.h"
+
+/*
+ * Timestamps for a stream that has none: every picture lasts
+ * num_units_in_tick / time_scale of the active SPS, DTS goes up by one
+ * picture per picture in decoding order, and PTS follows output order.
+ *
+ * Output order is the one of the DPB bumping process (C.5.2): once more
+ * pictures wait than sps_max_num_reorder_pics allows, the one with the
+ * lowest POC goes out. The k-th picture going out gets the PTS of the
+ * (k + reorder)-th DTS, so PTS >= DTS with the least delay the SPS allows.
+ * A coded video sequence flushes the pictures of the one before it. The
+ * reorder depth used for the offset never shrinks, PTS stays increasing
+ * when a later SPS lowers it; raising it leaves a gap in the PTS.
+ *
+ * Timestamps go out in decoding order, each picture once its PTS is known,
+ * which is at most reorder pictures after it was pushed.
+ */
+typedef struct HevcPtsGen HevcPtsGen;
+
+typedef struct HevcTimestamp {
+    uint64_t index;         // picture, in decoding order from 0
+    int64_t  pts;           // in the timescale of the generator
+    int64_t  dts;           // starts at 0
+    int32_t  poc;
+    uint8_t  nalu_type;     // of the first slice segment
+} HevcTimestamp;
+
+typedef void (*HevcTimestampCallback)( const HevcTimestamp *ts, void *opaque );
+
+/* timescale 0 is 90 kHz */
+extern HevcPtsGen *hevc_pts_new( uint32_t timescale, HevcTimestampCallback cb, void *opaque );
+extern void hevc_pts_free( HevcPtsGen *g );
+/* picture duration while the SPS has no VUI timing, 1/25 s by default */
+extern void hevc_pts_set_frame_rate( HevcPtsGen *g, uint32_t num_units_in_tick, uint32_t time_scale );
+/*
+ * NAL units in decoding order, parameter sets included. returns 1 when
+ * nalu starts a picture (it gets the next index), 0 for other NAL units,
+ * -1 for the first slice of a picture that can't be parsed (no index)
+ */
+extern int hevc_pts_push( HevcPtsGen *g, const NalUnit *nalu );
+/* end of stream: the pictures still waiting go out */
+extern void hevc_pts_flush( HevcPtsGen *g );
+
+#endif  /*HEVC_PTS_H*/
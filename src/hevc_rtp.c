@@ -0,0 +1,502 @@
+// Last Update:2026-10-17 15:02:11
+/**
+ * @file hevc_rtp.c
+ * @brief RTP payload format for HEVC (RFC 7798)
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hevc_rtp.h"
+
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+#define HEVC_RTP_NAL_PACI 50
+
+/* RFC 3550 A.1: a bigger jump means the sender restarted the sequence */
+#define RTP_MAX_DROPOUT  3000
+#define RTP_MAX_MISORDER 100
+
+typedef struct RtpSlot {
+    uint8_t *packet;    // NULL when the slot is free
+    void *packet_opaque;
+    uint8_t *payload;
+    int payload_size;
+    uint32_t timestamp;
+} RtpSlot;
+
+struct HevcRtpDepacketizer {
+    HevcRtpNalCallback cb;
+    HevcRtpRelease release;
+    void *opaque;
+    int donl;
+    int jitter;
+    RtpSlot *slots;     // by sequence number, a power of 2 > jitter of them
+    int mask;
+    int held;
+    int started;
+    uint16_t next_seq;  // the packet to hand out next
+    uint32_t lost;
+    uint8_t *fu;        // fragmented NAL being reassembled
+    int fu_size;
+    int fu_cap;
+    int in_fu;
+};
+
+HevcRtpDepacketizer *hevc_rtp_depack_new( int jitter, int donl, HevcRtpNalCallback cb,
+                                          HevcRtpRelease release, void *opaque )
+{
+    HevcRtpDepacketizer *d;
+    int slots = 1;
+
+    if ( !cb || jitter < 0 || jitter >= RTP_MAX_MISORDER )
+        return NULL;
+
+    while ( slots <= jitter )
+        slots *= 2;
+
+    d = calloc( 1, sizeof(*d) );
+    if ( !d )
+        return NULL;
+    d->slots = calloc( slots, sizeof(RtpSlot) );
+    if ( !d->slots ) {
+        free( d );
+        return NULL;
+    }
+
+    d->cb = cb;
+    d->release = release;
+    d->opaque = opaque;
+    d->donl = donl;
+    d->jitter = jitter;
+    d->mask = slots - 1;
+    return d;
+}
+
+void hevc_rtp_depack_free( HevcRtpDepacketizer *d )
+{
+    int i;
+
+    if ( !d )
+        return;
+
+    // packets still held go back to the caller unprocessed
+    for ( i = 0; i <= d->mask; i++ )
+        if ( d->slots[i].packet && d->release )
+            d->release( d->slots[i].packet, d->slots[i].packet_opaque, d->opaque );
+    free( d->slots );
+    free( d->fu );
+    free( d );
+}
+
+uint32_t hevc_rtp_depack_lost( const HevcRtpDepacketizer *d )
+{
+    return d ? d->lost : 0;
+}
+
+static int rtp_parse( uint8_t *packet, int size, RtpSlot *slot, uint16_t *seq )
+{
+    int off, end = size;
+
+    if ( size < 12 || (packet[0] >> 6) != 2 )
+        return -1;
+
+    off = 12 + (packet[0] & 0x0f) * 4;          // CSRC list
+    if ( packet[0] & 0x10 ) {                   // header extension
+        if ( off + 4 > size )
+            return -1;
+        off += 4 + (packet[off+2] << 8 | packet[off+3]) * 4;
+    }
+    if ( packet[0] & 0x20 ) {                   // padding
+        int pad = packet[size-1];
+
+        if ( !pad || pad > size - off )
+            return -1;
+        end -= pad;
+    }
+    if ( off >= end )
+        return -1;
+
+    *seq = packet[2] << 8 | packet[3];
+    slot->timestamp = (uint32_t)packet[4] << 24 | packet[5] << 16 | packet[6] << 8 | packet[7];
+    slot->payload = packet + off;
+    slot->payload_size = end - off;
+    return 0;
+}
+
+static void depack_emit( HevcRtpDepacketizer *d, const uint8_t *addr, int size, uint32_t timestamp )
+{
+    NalUnit nalu;
+
+    nalu.nalu_type = (addr[0] >> 1) & 0x3f;
+    nalu.addr = addr;
+    nalu.size = size;
+    d->cb( &nalu, timestamp, d->opaque );
+}
+
+static int fu_append( HevcRtpDepacketizer *d, const uint8_t *data, int size )
+{
+    if ( d->fu_size + size > d->fu_cap ) {
+        int cap = d->fu_cap ? d->fu_cap : 4096;
+        uint8_t *fu;
+
+        while ( cap < d->fu_size + size )
+            cap *= 2;
+        fu = realloc( d->fu, cap );
+        if ( !fu )
+            return -1;
+        d->fu = fu;
+        d->fu_cap = cap;
+    }
+
+    memcpy( d->fu + d->fu_size, data, size );
+    d->fu_size += size;
+    return 0;
+}
+
+/* FU: PayloadHdr(2) FU header(1) [DONL(2), first fragment only] payload */
+static void depack_fu( HevcRtpDepacketizer *d, uint8_t *p, int len, uint32_t timestamp )
+{
+    uint8_t fu_header, nal_header[2];
+
+    if ( len < 4 )
+        return;
+
+    fu_header = p[2];
+    if ( fu_header & 0x80 ) {
+        nal_header[0] = (p[0] & 0x81) | (fu_header & 0x3f) << 1;
+        nal_header[1] = p[1];
+        p += 3;
+        len -= 3;
+        if ( d->donl ) {
+            if ( len < 2 )
+                return;
+            p += 2;
+            len -= 2;
+        }
+        d->fu_size = 0;
+        d->in_fu = fu_append( d, nal_header, 2 ) == 0;
+    } else {
+        p += 3;
+        len -= 3;
+    }
+
+    // a middle or last fragment whose start we never saw
+    if ( !d->in_fu )
+        return;
+
+    if ( fu_append( d, p, len ) < 0 ) {
+        d->in_fu = 0;
+        return;
+    }
+
+    if ( fu_header & 0x40 ) {
+        d->in_fu = 0;
+        depack_emit( d, d->fu, d->fu_size, timestamp );
+    }
+}
+
+/* AP: PayloadHdr(2) [DONL(2)] { [DOND(1), all but the first] size(2) NAL }... */
+static void depack_ap( HevcRtpDepacketizer *d, uint8_t *p, int len, uint32_t timestamp )
+{
+    int first = 1;
+
+    p += 2;
+    len -= 2;
+    if ( d->donl ) {
+        p += 2;
+        len -= 2;
+    }
+
+    while ( len > 2 ) {
+        int size;
+
+        if ( d->donl && !first ) {
+            p++;
+            len--;
+        }
+        if ( len < 2 )
+            break;
+        size = p[0] << 8 | p[1];
+        p += 2;
+        len -= 2;
+        if ( size < 2 || size > len )
+            break;
+
+        depack_emit( d, p, size, timestamp );
+        p += size;
+        len -= size;
+        first = 0;
+    }
+}
+
+static void depack_payload( HevcRtpDepacketizer *d, uint8_t *p, int len, uint32_t timestamp )
+{
+    int type;
+
+    if ( len < 3 )
+        return;
+
+    type = (p[0] >> 1) & 0x3f;
+    switch ( type ) {
+    case HEVC_RTP_NAL_AP:
+        depack_ap( d, p, len, timestamp );
+        break;
+    case HEVC_RTP_NAL_FU:
+        depack_fu( d, p, len, timestamp );
+        break;
+    case HEVC_RTP_NAL_PACI:
+        break;
+    default:
+        if ( d->donl ) {
+            if ( len < 5 )
+                return;
+            // move the NAL header over DONL so the NAL is contiguous
+            p[3] = p[1];
+            p[2] = p[0];
+            p += 2;
+            len -= 2;
+        }
+        depack_emit( d, p, len, timestamp );
+        break;
+    }
+}
+
+static void depack_release( HevcRtpDepacketizer *d, uint8_t *packet, void *packet_opaque )
+{
+    if ( d->release )
+        d->release( packet, packet_opaque, d->opaque );
+}
+
+/* hand out next_seq, or count it lost when it isn't there */
+static void depack_step( HevcRtpDepacketizer *d )
+{
+    RtpSlot *slot = &d->slots[d->next_seq & d->mask];
+
+    if ( slot->packet ) {
+        uint8_t *packet = slot->packet;
+
+        depack_payload( d, slot->payload, slot->payload_size, slot->timestamp );
+        slot->packet = NULL;
+        d->held--;
+        depack_release( d, packet, slot->packet_opaque );
+    } else {
+        d->lost++;
+        d->in_fu = 0;
+    }
+    d->next_seq++;
+}
+
+void hevc_rtp_depack_flush( HevcRtpDepacketizer *d )
+{
+    if ( !d )
+        return;
+
+    while ( d->held )
+        depack_step( d );
+}
+
+int hevc_rtp_depack_push( HevcRtpDepacketizer *d, uint8_t *packet, int size, void *packet_opaque )
+{
+    RtpSlot parsed, *slot;
+    uint16_t seq;
+    int diff;
+
+    if ( !d )
+        return -1;
+
+    if ( !packet || rtp_parse( packet, size, &parsed, &seq ) < 0 ) {
+        depack_release( d, packet, packet_opaque );
+        return -1;
+    }
+
+    if ( !d->started ) {
+        d->started = 1;
+        d->next_seq = seq;
+    }
+
+    diff = (int16_t)(seq - d->next_seq);
+    if ( diff < 0 && diff > -RTP_MAX_MISORDER ) {
+        // too late, or a duplicate of a packet already handed out
+        depack_release( d, packet, packet_opaque );
+        return 0;
+    }
+    if ( diff < 0 || diff >= RTP_MAX_DROPOUT ) {
+        hevc_rtp_depack_flush( d );
+        d->in_fu = 0;
+        d->next_seq = seq;
+        diff = 0;
+    }
+
+    // past the window: stop waiting for the oldest missing packets
+    for ( ; diff > d->mask; diff-- )
+        depack_step( d );
+
+    slot = &d->slots[seq & d->mask];
+    if ( slot->packet ) {
+        depack_release( d, packet, packet_opaque );
+        return 0;
+    }
+    parsed.packet = packet;
+    parsed.packet_opaque = packet_opaque;
+    *slot = parsed;
+    d->held++;
+
+    while ( d->slots[d->next_seq & d->mask].packet || d->held > d->jitter )
+        depack_step( d );
+
+    return 0;
+}
+
+int hevc_rtp_pack_init( HevcRtpPacketizer *p, int mtu, uint8_t payload_type, uint32_t ssrc, uint16_t seq )
+{
+    // room for an FU header and at least one payload byte
+    if ( !p || mtu < HEVC_RTP_HEADER_SIZE + 4 )
+        return -1;
+
+    p->mtu = mtu;
+    p->payload_type = payload_type & 0x7f;
+    p->ssrc = ssrc;
+    p->seq = seq;
+    return 0;
+}
+
+static void pack_header( const HevcRtpPacketizer *p, HevcRtpPacket *pkt, uint16_t seq, uint32_t timestamp )
+{
+    uint8_t *h = pkt->header;
+
+    h[0] = 0x80;
+    h[1] = p->payload_type;
+    h[2] = seq >> 8;
+    h[3] = seq;
+    h[4] = timestamp >> 24;
+    h[5] = timestamp >> 16;
+    h[6] = timestamp >> 8;
+    h[7] = timestamp;
+    h[8] = p->ssrc >> 24;
+    h[9] = p->ssrc >> 16;
+    h[10] = p->ssrc >> 8;
+    h[11] = p->ssrc;
+}
+
+static void pack_span( HevcRtpPacket *pkt, const void *base, int len )
+{
+    pkt->iov[pkt->iov_count].iov_base = (void *)base;
+    pkt->iov[pkt->iov_count].iov_len = len;
+    pkt->iov_count++;
+    pkt->size += len;
+}
+
+/* how many NAL units from nalu on go into one AP, 0 or 1 means none */
+static int pack_ap_count( const HevcRtpPacketizer *p, const NalUnit *nalu, int count )
+{
+    int i, size = HEVC_RTP_HEADER_SIZE + 2;
+
+    for ( i = 0; i < count && i < HEVC_RTP_AP_MAX_NALUS; i++ ) {
+        if ( nalu[i].size < 2 || size + 2 + nalu[i].size > p->mtu )
+            break;
+        size += 2 + nalu[i].size;
+    }
+    return i;
+}
+
+static void pack_ap( HevcRtpPacket *pkt, const NalUnit *nalu, int n )
+{
+    uint8_t f = 0, layer_id = 0x3f, tid = 7;
+    int i;
+
+    // F is or-ed, LayerId and TID are the lowest of the aggregated NALs
+    for ( i = 0; i < n; i++ ) {
+        uint8_t nal_layer = (nalu[i].addr[0] & 1) << 5 | nalu[i].addr[1] >> 3;
+
+        f |= nalu[i].addr[0] & 0x80;
+        layer_id = MIN( layer_id, nal_layer );
+        tid = MIN( tid, nalu[i].addr[1] & 7 );
+    }
+    pkt->header[12] = f | HEVC_RTP_NAL_AP << 1 | layer_id >> 5;
+    pkt->header[13] = (layer_id & 0x1f) << 3 | tid;
+    pkt->header[14] = nalu[0].size >> 8;
+    pkt->header[15] = nalu[0].size;
+    pack_span( pkt, pkt->header, HEVC_RTP_HEADER_SIZE + 4 );
+    pack_span( pkt, nalu[0].addr, nalu[0].size );
+
+    for ( i = 1; i < n; i++ ) {
+        uint8_t *size = pkt->ap_sizes + 2 * (i - 1);
+
+        size[0] = nalu[i].size >> 8;
+        size[1] = nalu[i].size;
+        pack_span( pkt, size, 2 );
+        pack_span( pkt, nalu[i].addr, nalu[i].size );
+    }
+}
+
+int hevc_rtp_pack_au( HevcRtpPacketizer *p, const NalUnit *nalu, int count, uint32_t timestamp,
+                      HevcRtpPacket *packets, int max_packets )
+{
+    uint16_t seq;
+    int i = 0, n = 0;
+
+    if ( !p || !packets || (count && !nalu) )
+        return -1;
+
+    seq = p->seq;
+    while ( i < count ) {
+        const NalUnit *nal = &nalu[i];
+        int ap = pack_ap_count( p, nal, count - i );
+
+        if ( nal->size < 2 ) {
+            i++;
+            continue;
+        }
+
+        if ( ap > 1 ) {
+            if ( n >= max_packets )
+                return -1;
+            packets[n].iov_count = packets[n].size = 0;
+            pack_header( p, &packets[n], seq++, timestamp );
+            pack_ap( &packets[n++], nal, ap );
+            i += ap;
+        } else if ( HEVC_RTP_HEADER_SIZE + nal->size <= p->mtu ) {
+            if ( n >= max_packets )
+                return -1;
+            packets[n].iov_count = packets[n].size = 0;
+            pack_header( p, &packets[n], seq++, timestamp );
+            pack_span( &packets[n], packets[n].header, HEVC_RTP_HEADER_SIZE );
+            pack_span( &packets[n++], nal->addr, nal->size );
+            i++;
+        } else {
+            // FU: PayloadHdr(2) FU header(1), the NAL header is not repeated
+            int max_frag = p->mtu - HEVC_RTP_HEADER_SIZE - 3;
+            int off = 2;
+
+            while ( off < nal->size ) {
+                int frag = MIN( max_frag, nal->size - off );
+                HevcRtpPacket *pkt = &packets[n];
+
+                if ( n >= max_packets )
+                    return -1;
+                pkt->iov_count = pkt->size = 0;
+                pack_header( p, pkt, seq++, timestamp );
+                pkt->header[12] = (nal->addr[0] & 0x81) | HEVC_RTP_NAL_FU << 1;
+                pkt->header[13] = nal->addr[1];
+                pkt->header[14] = (off == 2 ? 0x80 : 0) | (off + frag == nal->size ? 0x40 : 0) |
+                                  nal->nalu_type;
+                pack_span( pkt, pkt->header, HEVC_RTP_HEADER_SIZE + 3 );
+                pack_span( pkt, nal->addr + off, frag );
+                off += frag;
+                n++;
+            }
+            i++;
+        }
+    }
+
+    if ( n )
+        packets[n-1].header[1] |= 0x80;    // marker, last packet of the access unit
+    p->seq = seq;
+    return n;
+}
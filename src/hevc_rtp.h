@@ -0,0 +1,90 @@
+// Last Update:2026-10-17 15:02:11
+/**
+ * @file hevc_rtp.h
+ * @brief RTP payload format for HEVC (RFC 7798)
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_RTP_H
+#define HEVC_RTP_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include "hevc.h"
+
+#define HEVC_RTP_NAL_AP 48
+#define HEVC_RTP_NAL_FU 49
+
+#define HEVC_RTP_HEADER_SIZE 12
+
+/*
+ * Depacketizer: RTP packets in, NAL units out, in sequence number order.
+ *
+ * Packets are reordered within a window of jitter packets. A packet stays
+ * owned by the caller but must not be touched until release is called for
+ * it, which happens once its NAL units went out (or it was dropped as late
+ * or duplicate); with jitter 0 that is before hevc_rtp_depack_push()
+ * returns. The packet may be modified in place.
+ *
+ * NAL units of single NAL packets and aggregation packets point into the
+ * packet; fragmentation units are reassembled in the depacketizer, the only
+ * copy made. A NAL unit is only valid during the callback. A sequence gap
+ * drops the fragmented NAL it cuts.
+ *
+ * donl is 1 when the session has sprop-max-don-diff > 0, the DONL/DOND
+ * fields are then skipped; NAL units come out in transmission order.
+ */
+typedef void (*HevcRtpNalCallback)( const NalUnit *nalu, uint32_t timestamp, void *opaque );
+typedef void (*HevcRtpRelease)( uint8_t *packet, void *packet_opaque, void *opaque );
+typedef struct HevcRtpDepacketizer HevcRtpDepacketizer;
+
+extern HevcRtpDepacketizer *hevc_rtp_depack_new( int jitter, int donl, HevcRtpNalCallback cb,
+                                                 HevcRtpRelease release, void *opaque );
+extern void hevc_rtp_depack_free( HevcRtpDepacketizer *d );
+/* packet is a whole RTP packet, header included. returns 0, -1 if it
+ * isn't a valid RTP packet (it is released either way) */
+extern int hevc_rtp_depack_push( HevcRtpDepacketizer *d, uint8_t *packet, int size, void *packet_opaque );
+/* hand out whatever the jitter window holds, e.g. at the end of a stream */
+extern void hevc_rtp_depack_flush( HevcRtpDepacketizer *d );
+/* packets missing from the sequence so far */
+extern uint32_t hevc_rtp_depack_lost( const HevcRtpDepacketizer *d );
+
+/*
+ * Packetizer: the NAL units of one access unit in, RTP packets out. NAL
+ * units that fit together go into aggregation packets (at most
+ * HEVC_RTP_AP_MAX_NALUS each), the ones too big for the MTU are split into
+ * fragmentation units, the rest are sent as they are. mtu is the largest
+ * RTP packet, header included.
+ *
+ * Packets are written into caller slots that can be reused from one access
+ * unit to the next: the RTP header and the payload/FU headers go into the
+ * slot, payload bytes stay in the NAL units and are only referenced by
+ * iov, ready for sendmsg(). The marker bit is set on the last packet.
+ */
+#define HEVC_RTP_AP_MAX_NALUS 8
+
+typedef struct HevcRtpPacket {
+    uint8_t header[HEVC_RTP_HEADER_SIZE + 4];  // RTP header, PayloadHdr, FU header or first NAL size
+    uint8_t ap_sizes[2 * (HEVC_RTP_AP_MAX_NALUS - 1)];
+    struct iovec iov[2 * HEVC_RTP_AP_MAX_NALUS];
+    int iov_count;
+    int size;
+} HevcRtpPacket;
+
+typedef struct HevcRtpPacketizer {
+    int mtu;
+    uint8_t payload_type;
+    uint32_t ssrc;
+    uint16_t seq;       // of the next packet
+} HevcRtpPacketizer;
+
+/* returns -1 when the mtu can't even hold an FU header */
+extern int hevc_rtp_pack_init( HevcRtpPacketizer *p, int mtu, uint8_t payload_type, uint32_t ssrc, uint16_t seq );
+/* returns the number of packets written, -1 when they don't fit in
+ * max_packets slots (nothing is consumed then) */
+extern int hevc_rtp_pack_au( HevcRtpPacketizer *p, const NalUnit *nalu, int count, uint32_t timestamp,
+                             HevcRtpPacket *packets, int max_packets );
+
+#endif  /*HEVC_RTP_H*/
@@ -0,0 +1,285 @@
+// Last Update:2026-10-17 23:18:05
+/**
+ * @file hevc_sei.c
+ * @brief SEI messages, decoded only for the payload types asked for
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "bs.h"
+#include "hevc_sei.h"
+#include "epb.h"
+
+#define SEI_MAX_VALUE (1 << 28)     // payload type or size, way past any NAL unit
+#define SEI_DECODE_MAX 64           // bytes the decoded payload types read at most
+
+void hevc_sei_reader_init( HevcSeiReader *r )
+{
+    memset( r, 0, sizeof(*r) );
+}
+
+int hevc_sei_register( HevcSeiReader *r, int type )
+{
+    switch ( type ) {
+    case HEVC_SEI_USER_DATA_UNREGISTERED:
+    case HEVC_SEI_DECODED_PICTURE_HASH:
+    case HEVC_SEI_TIME_CODE:
+    case HEVC_SEI_MASTERING_DISPLAY:
+    case HEVC_SEI_CONTENT_LIGHT_LEVEL:
+        r->decode[type >> 5] |= 1u << (type & 31);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+int hevc_sei_start( HevcSeiReader *r, const NalUnit *nalu )
+{
+    if ( !r || !nalu || nalu->size < 2 ||
+         (nalu->nalu_type != HEVC_NAL_SEI_PREFIX && nalu->nalu_type != HEVC_NAL_SEI_SUFFIX) )
+        return -1;
+
+    r->p = nalu->addr + 2;
+    r->end = nalu->addr + nalu->size;
+    r->zeros = 0;
+    return 0;
+}
+
+/* step over an emulation_prevention_three_byte at p */
+static void sei_sync( HevcSeiReader *r )
+{
+    if ( r->zeros >= 2 && r->p < r->end && *r->p == 3 ) {
+        r->p++;
+        r->zeros = 0;
+    }
+}
+
+static int sei_byte( HevcSeiReader *r )
+{
+    int b;
+
+    sei_sync( r );
+    if ( r->p >= r->end )
+        return -1;
+    b = *r->p++;
+    r->zeros = b ? 0 : r->zeros + 1;
+    return b;
+}
+
+/*
+ * n RBSP bytes: only a 00 00 03 in the way needs looking at, the search
+ * starts at the zeros before p so a pair split by it is seen
+ */
+static int sei_skip( HevcSeiReader *r, int n )
+{
+    while ( n > 0 ) {
+        const uint8_t *from, *limit, *q;
+
+        if ( r->end - r->p < n )
+            return -1;
+        from = r->p - (r->zeros < 2 ? r->zeros : 2);
+        limit = r->end - r->p > n + 2 ? r->p + n + 2 : r->end;
+        q = epb_next( from, limit );
+        if ( q + 2 - r->p >= n ) {
+            r->p += n;
+            r->zeros = r->p[-1] ? 0 : r->p[-2] ? 1 : 2;
+            return 0;
+        }
+        n -= q + 2 - r->p;
+        r->p = q + 3;
+        r->zeros = 0;
+    }
+    return 0;
+}
+
+/* more_rbsp_data(): not just the rbsp_stop_one_bit byte, and the
+ * trailing_zero_8bits a splitter may have left, ahead */
+static int sei_more_data( const HevcSeiReader *r )
+{
+    const uint8_t *q;
+
+    if ( r->p >= r->end || *r->p != 0x80 )
+        return r->p < r->end;
+    for ( q = r->p + 1; q < r->end; q++ )
+        if ( *q )
+            return 1;
+    return 0;
+}
+
+/* payloadType and payloadSize: 0xff bytes adding up */
+static int sei_value( HevcSeiReader *r )
+{
+    int value = 0, b;
+
+    while ( (b = sei_byte( r )) == 0xff ) {
+        value += 255;
+        if ( value > SEI_MAX_VALUE )
+            return -1;
+    }
+    return b < 0 ? -1 : value + b;
+}
+
+static void decode_time_code( bs_t *bs, HevcSeiTimeCode *tc )
+{
+    int i;
+
+    memset( tc, 0, sizeof(*tc) );
+    tc->num_clock_ts = bs_read_u( bs, 2 );
+    for ( i = 0; i < tc->num_clock_ts; i++ ) {
+        int length;
+
+        if ( !(tc->ts[i].clock_timestamp_flag = bs_read_u1( bs )) )
+            continue;
+        tc->ts[i].units_field_based_flag = bs_read_u1( bs );
+        tc->ts[i].counting_type = bs_read_u( bs, 5 );
+        tc->ts[i].full_timestamp_flag = bs_read_u1( bs );
+        tc->ts[i].discontinuity_flag = bs_read_u1( bs );
+        tc->ts[i].cnt_dropped_flag = bs_read_u1( bs );
+        tc->ts[i].n_frames = bs_read_u( bs, 9 );
+        if ( tc->ts[i].full_timestamp_flag ) {
+            tc->ts[i].seconds = bs_read_u( bs, 6 );
+            tc->ts[i].minutes = bs_read_u( bs, 6 );
+            tc->ts[i].hours = bs_read_u( bs, 5 );
+        } else if ( bs_read_u1( bs ) ) {
+            tc->ts[i].seconds = bs_read_u( bs, 6 );
+            if ( bs_read_u1( bs ) ) {
+                tc->ts[i].minutes = bs_read_u( bs, 6 );
+                if ( bs_read_u1( bs ) )
+                    tc->ts[i].hours = bs_read_u( bs, 5 );
+            }
+        }
+        // time_offset_value is i(v), two's complement on time_offset_length bits
+        if ( (length = bs_read_u( bs, 5 )) ) {
+            uint32_t v = bs_read_u( bs, length );
+
+            tc->ts[i].time_offset = (int32_t)(v << (32 - length)) >> (32 - length);
+        }
+    }
+}
+
+static void decode_mastering_display( bs_t *bs, HevcSeiMasteringDisplay *md )
+{
+    int c;
+
+    for ( c = 0; c < 3; c++ ) {
+        md->display_primaries_x[c] = bs_read_u( bs, 16 );
+        md->display_primaries_y[c] = bs_read_u( bs, 16 );
+    }
+    md->white_point_x = bs_read_u( bs, 16 );
+    md->white_point_y = bs_read_u( bs, 16 );
+    md->max_luminance = bs_read_u( bs, 32 );
+    md->min_luminance = bs_read_u( bs, 32 );
+}
+
+/* the number of components is not in the SEI, it comes from the payload size */
+static int decode_picture_hash( bs_t *bs, HevcSeiPictureHash *ph, int size )
+{
+    static const int hash_size[3] = { 16, 2, 4 };
+    int c;
+
+    memset( ph, 0, sizeof(*ph) );
+    ph->hash_type = bs_read_u8( bs );
+    if ( ph->hash_type > 2 )
+        return -1;
+    ph->components = (size - 1) / hash_size[ph->hash_type];
+    if ( ph->components != 1 && ph->components != 3 )
+        return -1;
+    for ( c = 0; c < ph->components; c++ ) {
+        if ( ph->hash_type == 0 )
+            bs_read_bytes( bs, ph->md5[c], 16 );
+        else if ( ph->hash_type == 1 )
+            ph->crc[c] = bs_read_u( bs, 16 );
+        else
+            ph->checksum[c] = bs_read_u( bs, 32 );
+    }
+    return 0;
+}
+
+/* the first len payload bytes */
+static int sei_unescape( const HevcSeiMessage *m, uint8_t *dst, int len )
+{
+    HevcSeiReader r;
+    int i, b;
+
+    if ( !m->epb ) {
+        memcpy( dst, m->data, len );
+        return len;
+    }
+    r.p = m->data;
+    r.end = m->data + m->data_size;
+    r.zeros = m->zeros;
+    for ( i = 0; i < len; i++ ) {
+        if ( (b = sei_byte( &r )) < 0 )
+            return -1;
+        dst[i] = b;
+    }
+    return len;
+}
+
+/* the decoded types are small, or only their head is: unescaping it to the
+ * stack is cheaper than reading it through the EPB aware bs_t */
+static int sei_decode( HevcSeiMessage *m )
+{
+    uint8_t buf[SEI_DECODE_MAX];
+    int len = m->size < SEI_DECODE_MAX ? m->size : SEI_DECODE_MAX, ret = 0;
+    bs_t bs;
+
+    if ( sei_unescape( m, buf, len ) < 0 )
+        return -1;
+    bs_init( &bs, buf, len );
+    switch ( m->type ) {
+    case HEVC_SEI_USER_DATA_UNREGISTERED:
+        if ( m->size < 16 )
+            return -1;
+        bs_read_bytes( &bs, m->u.user_data.uuid, 16 );
+        break;
+    case HEVC_SEI_DECODED_PICTURE_HASH:
+        ret = decode_picture_hash( &bs, &m->u.picture_hash, m->size );
+        break;
+    case HEVC_SEI_TIME_CODE:
+        decode_time_code( &bs, &m->u.time_code );
+        break;
+    case HEVC_SEI_MASTERING_DISPLAY:
+        decode_mastering_display( &bs, &m->u.mastering_display );
+        break;
+    case HEVC_SEI_CONTENT_LIGHT_LEVEL:
+        m->u.content_light.max_content_light_level = bs_read_u( &bs, 16 );
+        m->u.content_light.max_pic_average_light_level = bs_read_u( &bs, 16 );
+        break;
+    }
+    if ( ret < 0 || bs_overrun( &bs ) )
+        return -1;
+    m->decoded = 1;
+    return 0;
+}
+
+int hevc_sei_next( HevcSeiReader *r, HevcSeiMessage *m )
+{
+    sei_sync( r );
+    if ( !sei_more_data( r ) )
+        return 0;
+
+    if ( (m->type = sei_value( r )) < 0 || (m->size = sei_value( r )) < 0 )
+        return -1;
+    sei_sync( r );
+    m->data = r->p;
+    m->zeros = r->zeros;
+    if ( sei_skip( r, m->size ) < 0 )
+        return -1;
+    m->data_size = r->p - m->data;
+    m->epb = m->data_size != m->size;
+    m->decoded = 0;
+
+    if ( m->type < 256 && (r->decode[m->type >> 5] >> (m->type & 31)) & 1 &&
+         sei_decode( m ) < 0 )
+        return -1;
+    return 1;
+}
+
+int hevc_sei_copy( const HevcSeiMessage *m, uint8_t *dst )
+{
+    return sei_unescape( m, dst, m->size );
+}
@@ -0,0 +1,125 @@
+// Last Update:2026-10-17 23:10:42
+/**
+ * @file hevc_sei.h
+ * @brief SEI messages, decoded only for the payload types asked for
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_SEI_H
+#define HEVC_SEI_H
+
+#include <stdint.h>
+#include "hevc.h"
+
+/* payloadType values (7.3.5, D.2.1) */
+enum {
+    HEVC_SEI_BUFFERING_PERIOD           = 0,
+    HEVC_SEI_PIC_TIMING                 = 1,
+    HEVC_SEI_USER_DATA_REGISTERED       = 4,
+    HEVC_SEI_USER_DATA_UNREGISTERED     = 5,
+    HEVC_SEI_RECOVERY_POINT             = 6,
+    HEVC_SEI_ACTIVE_PARAMETER_SETS      = 129,
+    HEVC_SEI_DECODED_PICTURE_HASH       = 132,
+    HEVC_SEI_TIME_CODE                  = 136,
+    HEVC_SEI_MASTERING_DISPLAY          = 137,
+    HEVC_SEI_CONTENT_LIGHT_LEVEL        = 144,
+};
+
+/* D.2.27, clock_timestamp_flag 0 leaves a timestamp zeroed */
+typedef struct HevcSeiTimeCode {
+    int num_clock_ts;
+    struct {
+        uint8_t  clock_timestamp_flag;
+        uint8_t  units_field_based_flag;
+        uint8_t  counting_type;
+        uint8_t  full_timestamp_flag;
+        uint8_t  discontinuity_flag;
+        uint8_t  cnt_dropped_flag;
+        uint16_t n_frames;
+        uint8_t  seconds;       // seconds/minutes/hours not sent are 0
+        uint8_t  minutes;
+        uint8_t  hours;
+        int32_t  time_offset;
+    } ts[3];
+} HevcSeiTimeCode;
+
+/* D.2.7, the user data follows the uuid in the payload */
+typedef struct HevcSeiUserData {
+    uint8_t uuid[16];
+} HevcSeiUserData;
+
+/* D.2.28, in units of 0.00002 (chromaticity) and 0.0001 cd/m2 */
+typedef struct HevcSeiMasteringDisplay {
+    uint16_t display_primaries_x[3];
+    uint16_t display_primaries_y[3];
+    uint16_t white_point_x;
+    uint16_t white_point_y;
+    uint32_t max_luminance;
+    uint32_t min_luminance;
+} HevcSeiMasteringDisplay;
+
+/* D.2.35 */
+typedef struct HevcSeiContentLight {
+    uint16_t max_content_light_level;
+    uint16_t max_pic_average_light_level;
+} HevcSeiContentLight;
+
+/* D.2.20, one hash per colour component (1 for 4:0:0 streams) */
+typedef struct HevcSeiPictureHash {
+    int hash_type;          // 0 MD5, 1 CRC, 2 checksum
+    int components;
+    uint8_t  md5[3][16];
+    uint16_t crc[3];
+    uint32_t checksum[3];
+} HevcSeiPictureHash;
+
+/*
+ * One message of an SEI NAL unit. data points into the NAL unit: it is
+ * the payload still escaped, data_size bytes holding size bytes of RBSP.
+ * Without epb these are the payload bytes, else hevc_sei_copy() unescapes
+ * them.
+ */
+typedef struct HevcSeiMessage {
+    int type;
+    int size;
+    const uint8_t *data;
+    int data_size;
+    int epb;                // data holds emulation prevention bytes
+    int zeros;              // zero bytes just before data, for the unescaping
+    int decoded;            // the member of type below is filled in
+    union {
+        HevcSeiTimeCode time_code;
+        HevcSeiUserData user_data;
+        HevcSeiMasteringDisplay mastering_display;
+        HevcSeiContentLight content_light;
+        HevcSeiPictureHash picture_hash;
+    } u;
+} HevcSeiMessage;
+
+/*
+ * Walks the payload_type/payload_size chain of a prefix or suffix SEI NAL
+ * unit on the escaped bytes: a message nobody asked for is stepped over
+ * with epb_next(), looking only for the 00 00 03 in the way, and never
+ * copied or unescaped. A registered type gets its first 64 bytes at most
+ * unescaped to the stack and decoded from there.
+ */
+typedef struct HevcSeiReader {
+    uint32_t decode[8];     // bit per payload type
+    const uint8_t *p;
+    const uint8_t *end;
+    int zeros;              // zero bytes just before p
+} HevcSeiReader;
+
+extern void hevc_sei_reader_init( HevcSeiReader *r );
+/* decode this payload type, one of the ones with a struct above */
+extern int hevc_sei_register( HevcSeiReader *r, int type );
+/* returns 0, -1 if nalu is not an SEI NAL unit */
+extern int hevc_sei_start( HevcSeiReader *r, const NalUnit *nalu );
+/* returns 1 with the next message in m, 0 past the last, -1 if malformed */
+extern int hevc_sei_next( HevcSeiReader *r, HevcSeiMessage *m );
+/* the m->size payload bytes to dst, returns m->size, -1 if malformed */
+extern int hevc_sei_copy( const HevcSeiMessage *m, uint8_t *dst );
+
+#endif  /*HEVC_SEI_H*/
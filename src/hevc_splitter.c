@@ -0,0 +1,175 @@
+// Last Update:2026-10-17 11:20:37
+/**
+ * @file hevc_splitter.c
+ * @brief split an Annex-B byte stream fed in arbitrary chunks into NAL units
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hevc.h"
+#include "startcode.h"
+
+struct HevcNalSplitter {
+    HevcNalCallback cb;
+    void *opaque;
+    int in_nal;         // saw a start code, the NAL after it isn't finished
+    int zeros;          // zero bytes at the end of the stream fed so far
+    uint8_t *tail;      // start of the open NAL, when it began in an earlier chunk
+    int tail_size;
+    int tail_cap;
+};
+
+HevcNalSplitter *hevc_splitter_new( HevcNalCallback cb, void *opaque )
+{
+    HevcNalSplitter *s = calloc( 1, sizeof(*s) );
+
+    if ( !s )
+        return NULL;
+
+    s->cb = cb;
+    s->opaque = opaque;
+    return s;
+}
+
+void hevc_splitter_free( HevcNalSplitter *s )
+{
+    if ( !s )
+        return;
+
+    free( s->tail );
+    free( s );
+}
+
+static int splitter_append( HevcNalSplitter *s, const uint8_t *data, int size )
+{
+    if ( s->tail_size + size > s->tail_cap ) {
+        int cap = s->tail_cap ? s->tail_cap : 4096;
+        uint8_t *tail;
+
+        while ( cap < s->tail_size + size )
+            cap *= 2;
+        tail = realloc( s->tail, cap );
+        if ( !tail )
+            return -1;
+        s->tail = tail;
+        s->tail_cap = cap;
+    }
+
+    memcpy( s->tail + s->tail_size, data, size );
+    s->tail_size += size;
+    return 0;
+}
+
+static void splitter_emit( HevcNalSplitter *s, const uint8_t *addr, int size )
+{
+    NalUnit nalu;
+
+    nalu.nalu_type = size > 0 ? (addr[0] >> 1) & 0x3f : 0;
+    nalu.addr = addr;
+    nalu.size = size;
+    s->cb( &nalu, s->opaque );
+}
+
+/*
+ * The open NAL ends at data + end (end <= 0 means the start code began in
+ * the tail and the NAL lost -end bytes of it). Trimming follows
+ * hevc_find_startcode(): a zero byte right before the start code belongs
+ * to it, not to the NAL.
+ */
+static int splitter_close( HevcNalSplitter *s, const uint8_t *nal, const uint8_t *data, int end )
+{
+    if ( !s->tail_size ) {
+        if ( data + end > nal && !data[end-1] )
+            end--;
+        splitter_emit( s, nal, data + end - nal );
+        return 1;
+    }
+
+    if ( end > 0 && splitter_append( s, data, end ) < 0 )
+        return -1;
+    if ( end < 0 )
+        s->tail_size += end;
+    if ( s->tail_size > 0 && !s->tail[s->tail_size-1] )
+        s->tail_size--;
+    splitter_emit( s, s->tail, s->tail_size );
+    s->tail_size = 0;
+    return 1;
+}
+
+int hevc_splitter_feed( HevcNalSplitter *s, const uint8_t *data, int size )
+{
+    const uint8_t *end = data + size, *p = data, *nal = data, *sc;
+    int count = 0, ret, i;
+
+    if ( !s || (!data && size) )
+        return -1;
+    if ( size <= 0 )
+        return 0;
+
+    // start code split between the previous chunk and this one
+    if ( s->zeros >= 2 && data[0] == 1 )
+        p = data + 1;
+    else if ( s->zeros >= 1 && size >= 2 && data[0] == 0 && data[1] == 1 )
+        p = data + 2;
+
+    if ( p != data ) {
+        if ( s->in_nal ) {
+            if ( (ret = splitter_close( s, data, data, p - data - 3 )) < 0 )
+                return -1;
+            count += ret;
+        }
+        s->in_nal = 1;
+        nal = p;
+    }
+
+    while ( (sc = startcode_find( p, end )) < end ) {
+        if ( s->in_nal ) {
+            if ( (ret = splitter_close( s, nal, data, sc - data )) < 0 )
+                return -1;
+            count += ret;
+        }
+        s->in_nal = 1;
+        nal = p = sc + 3;
+    }
+
+    if ( s->in_nal && s->tail_size == 0 && nal < end ) {
+        if ( splitter_append( s, nal, end - nal ) < 0 )
+            return -1;
+    } else if ( s->in_nal && nal == data ) {
+        if ( splitter_append( s, data, size ) < 0 )
+            return -1;
+    }
+
+    // only the last 3 bytes matter for a start code split across chunks
+    for ( i = size - 1; i >= 0 && !data[i] && size - 1 - i < 3; i-- )
+        ;
+    if ( i < 0 )
+        s->zeros = s->zeros + size > 3 ? 3 : s->zeros + size;
+    else
+        s->zeros = size - 1 - i;
+
+    return count;
+}
+
+int hevc_splitter_flush( HevcNalSplitter *s )
+{
+    int count = 0;
+
+    if ( !s )
+        return -1;
+
+    // a start code with nothing after it ends the input, not a NAL
+    if ( s->in_nal && s->tail_size > 0 ) {
+        splitter_emit( s, s->tail, s->tail_size );
+        count = 1;
+    }
+
+    s->in_nal = 0;
+    s->zeros = 0;
+    s->tail_size = 0;
+    return count;
+}
@@ -0,0 +1,163 @@
+// Last Update:2026-10-17 22:10:36
+/**
+ * @file hevc_sublayer.c
+ * @brief temporal sub-layer and IRAP only extraction over NAL unit lists
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hevc.h"
+
+/* end of sequence: the CRA after it gets NoRaslOutputFlag = 1 */
+static const uint8_t eos_nalu[2] = { HEVC_NAL_EOS_NUT << 1, 0x01 };
+
+void hevc_sublayer_set_target( HevcSubLayerFilter *f, int target )
+{
+    f->target = target < HEVC_SUBLAYER_IRAP_ONLY ? HEVC_SUBLAYER_IRAP_ONLY :
+                target >= HEVC_MAX_SUB_LAYERS ? HEVC_MAX_SUB_LAYERS - 1 : target;
+}
+
+void hevc_sublayer_init( HevcSubLayerFilter *f, int target )
+{
+    hevc_au_init( &f->au );
+    hevc_sublayer_set_target( f, target );
+    f->current = f->target;
+    f->decided = 1;
+    f->keep_au = 1;
+    f->skip_rasl = 0;
+    f->eos = 0;
+    f->sent = 0;
+}
+
+static int nal_tid( const NalUnit *nalu )
+{
+    return nalu->size >= 2 ? (nalu->addr[1] & 7) - 1 : 0;
+}
+
+/* the first VCL NAL unit of an access unit decides what to do with it */
+static void sublayer_decide( HevcSubLayerFilter *f, const NalUnit *vcl )
+{
+    int type = vcl->nalu_type, tid = nal_tid( vcl ), irap = HEVC_NAL_IS_IRAP( type );
+    int idr = type == HEVC_NAL_IDR_W_RADL || type == HEVC_NAL_IDR_N_LP;
+
+    f->decided = 1;
+    // IRAP only mode starts at any picture and ends at an IRAP; the POC of a
+    // CRA or BLA is only right next to the pictures before it, hence the EOS
+    if ( f->target == HEVC_SUBLAYER_IRAP_ONLY ||
+         (f->current == HEVC_SUBLAYER_IRAP_ONLY && !irap) ) {
+        f->current = HEVC_SUBLAYER_IRAP_ONLY;
+        f->keep_au = irap;
+        f->eos = irap && !idr && f->sent;
+        return;
+    }
+    // the RASL pictures of a CRA ending it reference dropped ones
+    if ( irap ) {
+        f->skip_rasl = f->current == HEVC_SUBLAYER_IRAP_ONLY && type == HEVC_NAL_CRA_NUT;
+        f->eos = f->current == HEVC_SUBLAYER_IRAP_ONLY && !idr && f->sent;
+    }
+    f->keep_au = !f->skip_rasl || (type != HEVC_NAL_RASL_N && type != HEVC_NAL_RASL_R);
+
+    // down at any picture, up at an IRAP or where a TSA/STSA allows it
+    if ( f->target < f->current || irap )
+        f->current = f->target;
+    else if ( tid == f->current + 1 && tid <= f->target ) {
+        if ( type == HEVC_NAL_TSA_N || type == HEVC_NAL_TSA_R )
+            f->current = f->target;
+        else if ( type == HEVC_NAL_STSA_N || type == HEVC_NAL_STSA_R )
+            f->current = tid;
+    }
+}
+
+static int sublayer_keep( HevcSubLayerFilter *f, const NalUnit *nalu )
+{
+    int type = nalu->nalu_type;
+    // parameter sets may come in any access unit, the pictures after need them
+    int ps = type == HEVC_NAL_VPS || type == HEVC_NAL_SPS || type == HEVC_NAL_PPS ||
+             type == HEVC_NAL_EOS_NUT || type == HEVC_NAL_EOB_NUT;
+
+    if ( f->current == HEVC_SUBLAYER_IRAP_ONLY )
+        return ps || (f->decided && f->keep_au);
+    return nal_tid( nalu ) <= f->current && (ps || !f->decided || f->keep_au);
+}
+
+static int sublayer_reserve( NalUnitList *out, int size )
+{
+    NalUnit *nalu;
+
+    if ( out->capacity >= size )
+        return 0;
+    if ( size < out->capacity * 2 )
+        size = out->capacity * 2;
+    if ( !(nalu = realloc( out->nalu, size * sizeof(NalUnit) )) )
+        return -1;
+    out->nalu = nalu;
+    out->capacity = size;
+    return 0;
+}
+
+int hevc_sublayer_filter( HevcSubLayerFilter *f, NalUnitList *out, const NalUnitList *in )
+{
+    const NalUnit *src;
+    NalUnit *rest = NULL;
+    int i, k, n = 0, count;
+
+    if ( !f || !out || !in )
+        return -1;
+    src = in->nalu;
+    count = in->count;
+    if ( out != in && sublayer_reserve( out, count ) < 0 )
+        return -1;
+
+    // out->nalu[n] is never ahead of src[i] until an EOS makes it so: with out
+    // being in, the entries not read yet then move aside first
+    for ( i = 0; i < count; i++ ) {
+        NalUnit nalu = src[i];
+
+        if ( hevc_au_starts( &f->au, &nalu ) ) {
+            f->decided = 0;
+            // the rest of the AU may be in the next list
+            for ( k = i; k < count; k++ )
+                if ( HEVC_NAL_IS_VCL( src[k].nalu_type ) ) {
+                    sublayer_decide( f, &src[k] );
+                    break;
+                }
+        }
+        if ( !f->decided && HEVC_NAL_IS_VCL( nalu.nalu_type ) )
+            sublayer_decide( f, &nalu );
+        if ( !sublayer_keep( f, &nalu ) )
+            continue;
+
+        if ( f->eos ) {
+            f->eos = 0;
+            if ( out == in && !rest && n + 1 > i ) {
+                if ( !(rest = malloc( (count - i) * sizeof(NalUnit) )) )
+                    return -1;
+                memcpy( rest, src + i + 1, (count - i - 1) * sizeof(NalUnit) );
+                src = rest;
+                count -= i + 1;
+                i = -1;
+            }
+            if ( sublayer_reserve( out, n + 2 ) < 0 ) {
+                free( rest );
+                return -1;
+            }
+            out->nalu[n].nalu_type = HEVC_NAL_EOS_NUT;
+            out->nalu[n].addr = eos_nalu;
+            out->nalu[n++].size = sizeof(eos_nalu);
+        } else if ( sublayer_reserve( out, n + 1 ) < 0 ) {
+            free( rest );
+            return -1;
+        }
+        if ( HEVC_NAL_IS_VCL( nalu.nalu_type ) )
+            f->sent = 1;
+        out->nalu[n++] = nalu;
+    }
+
+    free( rest );
+    out->count = n;
+    return n;
+}
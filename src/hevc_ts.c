@@ -0,0 +1,350 @@
+// Last Update:2026-10-17 16:05:37
+/**
+ * @file hevc_ts.c
+ * @brief MPEG-2 TS front end, HEVC elementary streams to NAL units
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hevc_ts.h"
+
+#define TS_SYNC_BYTE   0x47
+#define TS_PID_PAT     0x0000
+#define TS_MAX_PMTS    8
+#define TS_MAX_STREAMS 8
+
+typedef struct TsStream {
+    int pid;
+    HevcTsDemuxer *d;
+    HevcNalSplitter *splitter;
+    int cc;             // last continuity_counter, -1 before the first packet
+    int in_pes;         // inside a PES we can use
+    int64_t pts;
+    int64_t dts;
+    int carried;        // the open NAL began in the previous PES, which pts/dts are of
+    int64_t next_pts;   // of the current PES then
+    int64_t next_dts;
+} TsStream;
+
+struct HevcTsDemuxer {
+    HevcTsNalCallback cb;
+    void *opaque;
+    int pmt_pids[TS_MAX_PMTS];
+    int pmt_count;
+    TsStream streams[TS_MAX_STREAMS];
+    int stream_count;
+    uint8_t carry[HEVC_TS_PACKET_SIZE];     // packet split between two feeds
+    int carry_size;
+    uint32_t errors;
+};
+
+HevcTsDemuxer *hevc_ts_demux_new( HevcTsNalCallback cb, void *opaque )
+{
+    HevcTsDemuxer *d;
+
+    if ( !cb )
+        return NULL;
+
+    d = calloc( 1, sizeof(*d) );
+    if ( !d )
+        return NULL;
+
+    d->cb = cb;
+    d->opaque = opaque;
+    return d;
+}
+
+void hevc_ts_demux_free( HevcTsDemuxer *d )
+{
+    int i;
+
+    if ( !d )
+        return;
+
+    for ( i = 0; i < d->stream_count; i++ )
+        hevc_splitter_free( d->streams[i].splitter );
+    free( d );
+}
+
+uint32_t hevc_ts_demux_errors( const HevcTsDemuxer *d )
+{
+    return d ? d->errors : 0;
+}
+
+static void on_stream_nalu( const NalUnit *nalu, void *opaque )
+{
+    TsStream *s = opaque;
+
+    s->d->cb( nalu, s->pid, s->pts, s->dts, s->d->opaque );
+    if ( s->carried ) {
+        s->pts = s->next_pts;
+        s->dts = s->next_dts;
+        s->carried = 0;
+    }
+}
+
+/* throw away the open NAL after a continuity error */
+static int stream_reset( TsStream *s )
+{
+    hevc_splitter_free( s->splitter );
+    s->splitter = hevc_splitter_new( on_stream_nalu, s );
+    s->in_pes = 0;
+    s->carried = 0;
+    return s->splitter ? 0 : -1;
+}
+
+static TsStream *find_stream( HevcTsDemuxer *d, int pid )
+{
+    int i;
+
+    for ( i = 0; i < d->stream_count; i++ )
+        if ( d->streams[i].pid == pid )
+            return &d->streams[i];
+    return NULL;
+}
+
+static int is_pmt_pid( const HevcTsDemuxer *d, int pid )
+{
+    int i;
+
+    for ( i = 0; i < d->pmt_count; i++ )
+        if ( d->pmt_pids[i] == pid )
+            return 1;
+    return 0;
+}
+
+/*
+ * PSI section starting in this packet, CRC excluded; NULL when it doesn't
+ * fit. PAT and PMT of a single program never span packets in practice.
+ */
+static const uint8_t *psi_section( const uint8_t *p, int len, int table_id, int *section_len )
+{
+    int ptr, size;
+
+    if ( len < 1 )
+        return NULL;
+    ptr = p[0];
+    p += 1 + ptr;
+    len -= 1 + ptr;
+    if ( len < 12 || p[0] != table_id )
+        return NULL;
+
+    size = 3 + ((p[1] & 0x0f) << 8 | p[2]);
+    if ( size > len || size < 12 )
+        return NULL;
+
+    *section_len = size - 4;
+    return p;
+}
+
+static void parse_pat( HevcTsDemuxer *d, const uint8_t *p, int len )
+{
+    int size, i;
+
+    if ( !(p = psi_section( p, len, 0x00, &size )) )
+        return;
+
+    for ( i = 8; i + 4 <= size; i += 4 ) {
+        int program = p[i] << 8 | p[i+1];
+        int pid = (p[i+2] & 0x1f) << 8 | p[i+3];
+
+        // program 0 is the network PID
+        if ( program && !is_pmt_pid( d, pid ) && d->pmt_count < TS_MAX_PMTS )
+            d->pmt_pids[d->pmt_count++] = pid;
+    }
+}
+
+static int parse_pmt( HevcTsDemuxer *d, const uint8_t *p, int len )
+{
+    int size, i;
+
+    if ( !(p = psi_section( p, len, 0x02, &size )) )
+        return 0;
+
+    // skip program_info
+    for ( i = 12 + ((p[10] & 0x0f) << 8 | p[11]); i + 5 <= size;
+          i += 5 + ((p[i+3] & 0x0f) << 8 | p[i+4]) ) {
+        int pid = (p[i+1] & 0x1f) << 8 | p[i+2];
+        TsStream *s;
+
+        if ( p[i] != HEVC_TS_STREAM_TYPE || find_stream( d, pid ) ||
+             d->stream_count >= TS_MAX_STREAMS )
+            continue;
+
+        s = &d->streams[d->stream_count];
+        memset( s, 0, sizeof(*s) );
+        s->pid = pid;
+        s->d = d;
+        s->cc = -1;
+        s->pts = s->dts = HEVC_TS_NOPTS;
+        if ( !(s->splitter = hevc_splitter_new( on_stream_nalu, s )) )
+            return -1;
+        d->stream_count++;
+    }
+    return 0;
+}
+
+static int64_t pes_timestamp( const uint8_t *p )
+{
+    return (int64_t)(p[0] & 0x0e) << 29 | p[1] << 22 | (p[2] & 0xfe) << 14 |
+           p[3] << 7 | p[4] >> 1;
+}
+
+static int starts_with_startcode( const uint8_t *p, int len )
+{
+    return len >= 3 && !p[0] && !p[1] && (p[2] == 1 || (len >= 4 && !p[2] && p[3] == 1));
+}
+
+static int stream_payload( HevcTsDemuxer *d, TsStream *s, int pusi, const uint8_t *p, int len )
+{
+    if ( pusi ) {
+        int64_t pts = HEVC_TS_NOPTS, dts = HEVC_TS_NOPTS;
+        int header, aligned;
+
+        // PES header, assumed to be in this packet like every muxer does
+        if ( len < 9 || p[0] || p[1] || p[2] != 1 || len < 9 + p[8] ) {
+            d->errors++;
+            if ( s->in_pes && hevc_splitter_flush( s->splitter ) < 0 )
+                return -1;
+            s->in_pes = 0;
+            return 0;
+        }
+        header = 9 + p[8];
+        if ( (p[7] & 0x80) && header >= 14 )
+            pts = dts = pes_timestamp( p + 9 );
+        if ( (p[7] & 0x40) && header >= 19 )
+            dts = pes_timestamp( p + 14 );
+        aligned = (p[6] & 0x04) || starts_with_startcode( p + header, len - header );
+        p += header;
+        len -= header;
+
+        // the NAL ending the previous PES goes out with its timestamps: now
+        // when this PES starts with a NAL unit (data_alignment_indicator or
+        // a start code), else once the rest of it has been fed
+        if ( aligned || !s->in_pes ) {
+            if ( s->in_pes && hevc_splitter_flush( s->splitter ) < 0 )
+                return -1;
+            s->pts = pts;
+            s->dts = dts;
+            s->carried = 0;
+        } else {
+            s->next_pts = pts;
+            s->next_dts = dts;
+            s->carried = 1;
+        }
+        s->in_pes = 1;
+    }
+
+    if ( !s->in_pes || len <= 0 )
+        return 0;
+    return hevc_splitter_feed( s->splitter, p, len ) < 0 ? -1 : 0;
+}
+
+static int ts_packet( HevcTsDemuxer *d, const uint8_t *p )
+{
+    int pid = (p[1] & 0x1f) << 8 | p[2];
+    int pusi = p[1] & 0x40;
+    int afc = (p[3] >> 4) & 0x03;
+    int cc = p[3] & 0x0f;
+    int off = 4, discontinuity = 0;
+    TsStream *s;
+
+    if ( p[1] & 0x80 ) {    // transport_error_indicator
+        d->errors++;
+        return 0;
+    }
+
+    if ( afc & 0x02 ) {
+        if ( p[4] )
+            discontinuity = p[5] & 0x80;
+        off += 1 + p[4];
+    }
+    if ( !(afc & 0x01) || off >= HEVC_TS_PACKET_SIZE )
+        return 0;
+
+    if ( pid == TS_PID_PAT ) {
+        parse_pat( d, p + off, HEVC_TS_PACKET_SIZE - off );
+        return 0;
+    }
+    if ( is_pmt_pid( d, pid ) )
+        return parse_pmt( d, p + off, HEVC_TS_PACKET_SIZE - off );
+    if ( !(s = find_stream( d, pid )) )
+        return 0;
+
+    if ( s->cc >= 0 && !discontinuity && cc != ((s->cc + 1) & 0x0f) ) {
+        if ( cc == s->cc )  // a packet may be sent twice
+            return 0;
+        d->errors++;
+        if ( stream_reset( s ) < 0 )
+            return -1;
+    }
+    s->cc = cc;
+
+    return stream_payload( d, s, pusi, p + off, HEVC_TS_PACKET_SIZE - off );
+}
+
+int hevc_ts_demux_feed( HevcTsDemuxer *d, const uint8_t *data, int size )
+{
+    const uint8_t *end;
+
+    if ( !d || (!data && size) )
+        return -1;
+    end = data + size;
+
+    if ( d->carry_size ) {
+        int n = HEVC_TS_PACKET_SIZE - d->carry_size;
+
+        if ( n > size )
+            n = size;
+        memcpy( d->carry + d->carry_size, data, n );
+        d->carry_size += n;
+        data += n;
+        if ( d->carry_size < HEVC_TS_PACKET_SIZE )
+            return 0;
+        d->carry_size = 0;
+        if ( ts_packet( d, d->carry ) < 0 )
+            return -1;
+    }
+
+    while ( data < end ) {
+        if ( *data != TS_SYNC_BYTE ) {
+            // lost sync, the next 0x47 is the best guess
+            const uint8_t *sync = memchr( data, TS_SYNC_BYTE, end - data );
+
+            d->errors++;
+            if ( !sync )
+                break;
+            data = sync;
+        }
+        if ( end - data < HEVC_TS_PACKET_SIZE ) {
+            memcpy( d->carry, data, end - data );
+            d->carry_size = end - data;
+            break;
+        }
+        if ( ts_packet( d, data ) < 0 )
+            return -1;
+        data += HEVC_TS_PACKET_SIZE;
+    }
+
+    return 0;
+}
+
+int hevc_ts_demux_flush( HevcTsDemuxer *d )
+{
+    int i;
+
+    if ( !d )
+        return -1;
+
+    for ( i = 0; i < d->stream_count; i++ ) {
+        TsStream *s = &d->streams[i];
+
+        if ( s->in_pes && hevc_splitter_flush( s->splitter ) < 0 )
+            return -1;
+    }
+    return 0;
+}
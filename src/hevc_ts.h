@@ -0,0 +1,43 @@
+// Last Update:2026-10-17 16:05:37
+/**
+ * @file hevc_ts.h
+ * @brief MPEG-2 TS front end, HEVC elementary streams to NAL units
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef HEVC_TS_H
+#define HEVC_TS_H
+
+#include <stdint.h>
+#include "hevc.h"
+
+#define HEVC_TS_PACKET_SIZE 188
+#define HEVC_TS_STREAM_TYPE 0x24
+#define HEVC_TS_NOPTS       (-1)
+
+/*
+ * Demuxer: finds the HEVC streams (stream_type 0x24) through PAT/PMT and
+ * splits their PES payloads into NAL units, one hevc_splitter per PID. TS
+ * packets are fed in arbitrary chunks. A NAL unit lying within one TS
+ * packet points into the data fed, only NAL units spanning packets are
+ * copied; either way it is only valid during the callback. pts/dts are the
+ * ones of the PES the NAL unit starts in, HEVC_TS_NOPTS when it has none,
+ * in 90kHz units. A PES is taken to start with a NAL unit when its
+ * data_alignment_indicator is set or its payload opens with a start code;
+ * otherwise its first bytes continue the NAL unit of the PES before.
+ */
+typedef void (*HevcTsNalCallback)( const NalUnit *nalu, int pid, int64_t pts, int64_t dts, void *opaque );
+typedef struct HevcTsDemuxer HevcTsDemuxer;
+
+extern HevcTsDemuxer *hevc_ts_demux_new( HevcTsNalCallback cb, void *opaque );
+extern void hevc_ts_demux_free( HevcTsDemuxer *d );
+/* returns 0, -1 on allocation failure. Continuity errors drop the PES
+ * they hit and are counted */
+extern int hevc_ts_demux_feed( HevcTsDemuxer *d, const uint8_t *data, int size );
+/* hand out the last NAL unit of every stream, at the end of the input */
+extern int hevc_ts_demux_flush( HevcTsDemuxer *d );
+extern uint32_t hevc_ts_demux_errors( const HevcTsDemuxer *d );
+
+#endif  /*HEVC_TS_H*/
@@ -0,0 +1,166 @@
+// Last Update:2026-10-17 10:12:41
+/**
+ * @file startcode.c
+ * @brief start code scanners, one per instruction set
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "startcode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STARTCODE_X86 1
+#include <immintrin.h>
+#endif
+
+static const uint8_t *startcode_find_c( const uint8_t *p, const uint8_t *end )
+{
+    const uint8_t *a = p + 4 - ((intptr_t)p & 3);
+
+    for (end -= 3; p < a && p < end; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    }
+
+    for (end -= 3; p < end; p += 4) {
+        uint32_t x = *(const uint32_t*)p;
+        if ((x - 0x01010101) & (~x) & 0x80808080) { // generic
+            if (p[1] == 0) {
+                if (p[0] == 0 && p[2] == 1)
+                    return p;
+                if (p[2] == 0 && p[3] == 1)
+                    return p+1;
+            }
+            if (p[3] == 0) {
+                if (p[2] == 0 && p[4] == 1)
+                    return p+2;
+                if (p[4] == 0 && p[5] == 1)
+                    return p+3;
+            }
+        }
+    }
+
+    // <= so a start code in the last 3 bytes is found too
+    for (end += 3; p <= end; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    }
+
+    return end + 3;
+}
+
+#ifdef STARTCODE_X86
+
+/*
+ * A start code needs two zero bytes in a row, which compressed data (after
+ * emulation prevention) almost never has, so each block is compared at p and
+ * p+1 against zero and only blocks holding a zero pair are compared at p+2
+ * against 1. The mask bits then give start code positions directly. Blocks
+ * are loaded unaligned, the last bytes are left to the C version.
+ */
+__attribute__((target("sse2")))
+static const uint8_t *startcode_find_sse2( const uint8_t *p, const uint8_t *end )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8( 1 );
+
+    for ( ; end - p >= 18; p += 16 ) {
+        __m128i pair = _mm_and_si128( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)p ), zero ),
+                                      _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)(p + 1) ), zero ) );
+        unsigned mask;
+
+        if ( !_mm_movemask_epi8( pair ) )
+            continue;
+
+        mask = _mm_movemask_epi8( _mm_and_si128( pair,
+                   _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)(p + 2) ), one ) ) );
+        if ( mask )
+            return p + __builtin_ctz( mask );
+    }
+
+    return startcode_find_c( p, end );
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *startcode_find_avx2( const uint8_t *p, const uint8_t *end )
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8( 1 );
+
+    for ( ; end - p >= 34; p += 32 ) {
+        __m256i pair = _mm256_and_si256( _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)p ), zero ),
+                                         _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)(p + 1) ), zero ) );
+        unsigned mask;
+
+        if ( _mm256_testz_si256( pair, pair ) )
+            continue;
+
+        mask = _mm256_movemask_epi8( _mm256_and_si256( pair,
+                   _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)(p + 2) ), one ) ) );
+        if ( mask )
+            return p + __builtin_ctz( mask );
+    }
+
+    return startcode_find_sse2( p, end );
+}
+
+#endif
+
+StartcodeFinder startcode_get_impl( StartcodeImpl impl )
+{
+    switch ( impl ) {
+    case STARTCODE_IMPL_C:
+        return startcode_find_c;
+#ifdef STARTCODE_X86
+    case STARTCODE_IMPL_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "sse2" ) ? startcode_find_sse2 : NULL;
+    case STARTCODE_IMPL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) ? startcode_find_avx2 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+const char *startcode_impl_name( StartcodeImpl impl )
+{
+    static const char *names[STARTCODE_IMPL_NB] = { "c", "sse2", "avx2" };
+
+    if ( impl < 0 || impl >= STARTCODE_IMPL_NB )
+        return "unknown";
+    return names[impl];
+}
+
+static StartcodeFinder startcode_resolve( void )
+{
+    int i;
+
+    for ( i = STARTCODE_IMPL_NB - 1; i > STARTCODE_IMPL_C; i-- ) {
+        StartcodeFinder f = startcode_get_impl( i );
+        if ( f )
+            return f;
+    }
+    return startcode_find_c;
+}
+
+static const uint8_t *startcode_find_init( const uint8_t *p, const uint8_t *end );
+
+/* every thread resolves to the same function, so the first call racing
+ * with another one is harmless */
+static StartcodeFinder startcode_finder = startcode_find_init;
+
+static const uint8_t *startcode_find_init( const uint8_t *p, const uint8_t *end )
+{
+    startcode_finder = startcode_resolve();
+    return startcode_finder( p, end );
+}
+
+const uint8_t *startcode_find( const uint8_t *p, const uint8_t *end )
+{
+    return startcode_finder( p, end );
+}
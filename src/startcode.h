@@ -0,0 +1,31 @@
+// Last Update:2026-10-17 10:12:41
+/**
+ * @file startcode.h
+ * @brief start code scanners, one per instruction set
+ * @author felix
+ * @version 0.1.00
+ * @date 2026-10-17
+ */
+
+#ifndef STARTCODE_H
+#define STARTCODE_H
+
+#include <stdint.h>
+
+/* all variants return the first 00 00 01 in [p, end), or end */
+typedef const uint8_t *(*StartcodeFinder)( const uint8_t *p, const uint8_t *end );
+
+typedef enum StartcodeImpl {
+    STARTCODE_IMPL_C    = 0,
+    STARTCODE_IMPL_SSE2 = 1,
+    STARTCODE_IMPL_AVX2 = 2,
+    STARTCODE_IMPL_NB,
+} StartcodeImpl;
+
+/* the best variant for this cpu, resolved with cpuid on first use */
+extern const uint8_t *startcode_find( const uint8_t *p, const uint8_t *end );
+/* a given variant, NULL if the cpu (or the build) doesn't support it */
+extern StartcodeFinder startcode_get_impl( StartcodeImpl impl );
+extern const char *startcode_impl_name( StartcodeImpl impl );
+
+#endif  /*STARTCODE_H*/
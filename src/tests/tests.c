@@ -1,25 +1,81 @@
 // Last Update:2019-01-10 13:27:20
 /**
  * @file tests.c
- * @brief 
+ * @brief
  * @author felix
  * @version 0.1.00
  * @date 2019-01-10
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <unistd.h>
 
+#include "bs.h"
 #include "hevc.h"
+#include "hevc_rtp.h"
+#include "hevc_ts.h"
+#include "hevc_fmp4.h"
+#include "hevc_gop.h"
+#include "hevc_engine.h"
+#include "hevc_file.h"
+#include "hevc_index.h"
+#include "hevc_sei.h"
+#include "hevc_pts.h"
+#include "startcode.h"
+#include "epb.h"
+
+#define MAX_BUF_LEN 512
 
 static char gbuffer[ MAX_BUF_LEN ];
 
+#include "unit_test.h"
+
+static void DumpBuffer( const char *name, const void *buf, int len, int line )
+{
+    const uint8_t *p = buf;
+    int i;
+
+    printf( "line %d, %s :", line, name );
+    for ( i = 0; i < len; i++ )
+        printf( "%s%02x", i % 16 ? " " : "\n    ", p[i] );
+    printf( "\n" );
+}
+
 #define HEVC_RAW_FILE "../src/tests/media/surfing.265"
-#define BUFFER_SIZE (10*1024*1024)
+
+#define MIN(a,b) ((a) > (b) ? (b) : (a))
+
+/*
+ * AUD, VPS, SPS, PPS, an IDR_W_RADL picture and a TRAIL_R picture made of two
+ * slice segments (the last two with 3 byte start codes).
+ * Main profile level 3.1, 1920x1088 cropped to 1080, 2 temporal sub-layers,
+ * wavefront enabled with min_spatial_segmentation_idc 4, VUI timing
+ * 1001/60000. VPS and SPS carry emulation prevention bytes in the
+ * profile_tier_level.
+ */
+static const uint8_t hevc_stream[] = {
+    0x00, 0x00, 0x00, 0x01, 0x46, 0x01, 0x50, 0x00, 0x00, 0x00, 0x01, 0x40,
+    0x01, 0x0c, 0x03, 0xff, 0xff, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90,
+    0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5d, 0x00, 0x00, 0x91, 0x48,
+    0xa0, 0x48, 0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x03, 0x01, 0x60, 0x00,
+    0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5d,
+    0x00, 0x00, 0xa0, 0x03, 0xc0, 0x80, 0x11, 0x07, 0xcb, 0x96, 0xf2, 0x2c,
+    0x92, 0x24, 0xcd, 0x73, 0xfb, 0xc0, 0x5a, 0x80, 0x80, 0x80, 0x82, 0x00,
+    0x00, 0x07, 0xd2, 0x00, 0x01, 0xd4, 0xc0, 0x59, 0x5a, 0x08, 0x04, 0x10,
+    0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0xc0, 0x73, 0xc1, 0x89, 0x00, 0x00,
+    0x00, 0x01, 0x26, 0x01, 0xaf, 0x80, 0xaf, 0x12, 0x34, 0x56, 0x78, 0x9a,
+    0x00, 0x00, 0x01, 0x02, 0x01, 0xd0, 0x0d, 0xc0, 0xaf, 0x12, 0x34, 0x56,
+    0x78, 0x9a, 0x00, 0x00, 0x01, 0x02, 0x01, 0x5f, 0xe8, 0x06, 0xe0, 0xaf,
+    0x12, 0x34, 0x56, 0x78, 0x9a,
+};
 
 void dump_hevc_config( HEVCDecoderConfigurationRecord * config )
 {
 
-#define DUMP_MEMBER( member ) printf( #member" : %d\n", config->member )
+#define DUMP_MEMBER( member ) printf( #member" : %d\n", (int)config->member )
 
     DUMP_MEMBER( configurationVersion );
     DUMP_MEMBER( general_profile_space );
@@ -44,31 +100,2396 @@ void dump_hevc_config( HEVCDecoderConfigurationRecord * config )
 
 char *test_hevc_parse_config()
 {
-    FILE *fp = fopen( HEVC_RAW_FILE, "r" );
+    HevcFileSource *src = hevc_file_open( HEVC_RAW_FILE, 0 );
+    HEVCDecoderConfigurationRecord config;
+    HEVCParamSets ps;
+    NalUnit nalu;
+    int count = 0;
+
+    // the sample clip is not checked in, only run against it when present
+    if ( !src ) {
+        printf( "[ SKIP ] %s not found\n", HEVC_RAW_FILE );
+        return NULL;
+    }
+
+    hevc_ps_init( &ps );
+    while ( hevc_file_next_nalu( src, &nalu, NULL ) ) {
+        hevc_ps_parse( &ps, &nalu );
+        count++;
+    }
+    mu_assert( count > 0 );
+    ASSERT_EQUAL( hevc_ps_get_config( &ps, &config ), 0 );
+
+    hevc_config_free( &config );
+    hevc_ps_free( &ps );
+    hevc_file_close( src );
+    return NULL;
+}
+
+// bs_write_ue() only handles codes up to 31 bits
+static void write_long_ue( bs_t *bs, uint32_t v )
+{
+    uint64_t code = (uint64_t)v + 1;
+    int len = 64 - __builtin_clzll( code );
+
+    bs_write_u( bs, len - 1, 0 );
+    if ( len > 32 ) {
+        bs_write_u1( bs, 1 );
+        len--;
+    }
+    bs_write_u( bs, len, (uint32_t)code );
+}
+
+char *test_bs_read()
+{
+    uint8_t buf[64];
+    static const uint32_t ue_values[] = { 0, 1, 2, 6, 7, 255, 1920, 65535, (1<<28) - 2, (1<<28) - 1, 1<<29, 0xfffffffe };
+    static const int32_t se_values[] = { 0, 1, -1, 5, -5, 1080, -16000 };
+    bs_t bs;
+    int i;
+
+    memset( buf, 0, sizeof(buf) );
+    bs_init( &bs, buf, sizeof(buf) );
+    bs_write_u( &bs, 3, 5 );
+    bs_write_u1( &bs, 1 );
+    bs_write_u( &bs, 32, 0x60000000 );
+    bs_write_u( &bs, 16, 0x9000 );
+    bs_write_u( &bs, 32, 0x12345678 );
+    for ( i = 0; i < (int)(sizeof(ue_values)/sizeof(ue_values[0])); i++ )
+        write_long_ue( &bs, ue_values[i] );
+    for ( i = 0; i < (int)(sizeof(se_values)/sizeof(se_values[0])); i++ )
+        bs_write_se( &bs, se_values[i] );
+    bs_write_u( &bs, 7, 0x55 );
+
+    bs_init( &bs, buf, sizeof(buf) );
+    ASSERT_EQUAL( bs_read_u( &bs, 3 ), 5 );
+    ASSERT_EQUAL( bs_read_u1( &bs ), 1 );
+    ASSERT_EQUAL( bs_read_u( &bs, 32 ), 0x60000000 );
+    mu_assert( bs_read_ull( &bs, 48 ) == 0x900012345678ULL );
+    for ( i = 0; i < (int)(sizeof(ue_values)/sizeof(ue_values[0])); i++ )
+        mu_assert( bs_read_ue( &bs ) == ue_values[i] );
+    for ( i = 0; i < (int)(sizeof(se_values)/sizeof(se_values[0])); i++ )
+        ASSERT_EQUAL( bs_read_se( &bs ), se_values[i] );
+    ASSERT_EQUAL( bs_read_u( &bs, 7 ), 0x55 );
+    ASSERT_EQUAL( bs_eof( &bs ), 0 );
+
+    return NULL;
+}
+
+char *test_bw_write()
+{
+    static const uint32_t ue_values[] = { 0, 1, 2, 255, 65535, (1<<28) - 1, 0xfffffffe };
+    static const int32_t se_values[] = { 0, 1, -1, 1080, 1<<29, -(1<<29) };
+    uint8_t plain[96], nal[160], escaped[160];
+    int i, n, k, plain_size = 0;
+    bw_t bw;
+    bs_t bs;
+
+    // the same fields into a plain buffer, then as a NAL payload
+    memset( plain, 0xff, sizeof(plain) );
+    memset( nal, 0xff, sizeof(nal) );
+    for ( k = 0; k < 2; k++ ) {
+        if ( k )
+            bw_init_nal( &bw, nal, sizeof(nal) );
+        else
+            bw_init( &bw, plain, sizeof(plain) );
+        bw_write_u( &bw, 3, 5 );
+        bw_write_u1( &bw, 1 );
+        bw_write_u( &bw, 32, 0 );
+        bw_write_u( &bw, 12, 0x001 );
+        bw_write_ull( &bw, 48, 0x900012345678ULL );
+        for ( i = 0; i < (int)(sizeof(ue_values)/sizeof(ue_values[0])); i++ )
+            bw_write_ue( &bw, ue_values[i] );
+        for ( i = 0; i < (int)(sizeof(se_values)/sizeof(se_values[0])); i++ )
+            bw_write_se( &bw, se_values[i] );
+        bw_write_u( &bw, 24, 0 );
+        bw_write_trailing_bits( &bw );
+        mu_assert( bw_byte_aligned( &bw ) );
+        n = bw_flush( &bw );
+        mu_assert( n > 0 );
+        if ( !k )
+            plain_size = n;
+    }
+
+    bs_init( &bs, plain, sizeof(plain) );
+    ASSERT_EQUAL( bs_read_u( &bs, 3 ), 5 );
+    ASSERT_EQUAL( bs_read_u1( &bs ), 1 );
+    ASSERT_EQUAL( bs_read_u( &bs, 32 ), 0 );
+    ASSERT_EQUAL( bs_read_u( &bs, 12 ), 1 );
+    mu_assert( bs_read_ull( &bs, 48 ) == 0x900012345678ULL );
+    for ( i = 0; i < (int)(sizeof(ue_values)/sizeof(ue_values[0])); i++ )
+        mu_assert( bs_read_ue( &bs ) == ue_values[i] );
+    for ( i = 0; i < (int)(sizeof(se_values)/sizeof(se_values[0])); i++ )
+        ASSERT_EQUAL( bs_read_se( &bs ), se_values[i] );
+    ASSERT_EQUAL( bs_read_u( &bs, 24 ), 0 );
+    // 449 bits so far, the stop bit and 6 alignment zeros end the last byte
+    ASSERT_EQUAL( bs_read_u( &bs, 7 ), 0x40 );
+    ASSERT_EQUAL( bs_pos( &bs ), plain_size );
+
+    // inserting on the fly is the same as afterwards
+    k = epb_insert( plain, plain_size, escaped );
+    ASSERT_EQUAL( n, k );
+    mu_assert( !memcmp( nal, escaped, n ) );
+
+    // out of room
+    bw_init( &bw, plain, 3 );
+    bw_write_u( &bw, 32, 0x12345678 );
+    ASSERT_EQUAL( bw_flush( &bw ), -1 );
+
+    return NULL;
+}
+
+char *test_bs_read_tail()
+{
+    // fields straddling the last bytes go through the byte-wise window
+    uint8_t buf[3] = { 0x02, 0xef, 0x37 };
+    bs_t bs;
+
+    bs_init( &bs, buf, sizeof(buf) );
+    bs_skip_u( &bs, 4 );
+    ASSERT_EQUAL( bs_read_ue( &bs ), 4 );
+    ASSERT_EQUAL( bs_read_u( &bs, 13 ), 0x1bcd );
+    ASSERT_EQUAL( bs_read_u( &bs, 2 ), 3 );
+    ASSERT_EQUAL( bs_eof( &bs ), 1 );
+    ASSERT_EQUAL( bs_read_u( &bs, 8 ), 0 );
+
+    return NULL;
+}
+
+char *test_bs_read_nal()
+{
+    // the in place reader must return the same bits as a copied RBSP
+    const uint8_t *sps = hevc_stream + 42;
+    int sps_size = 54;
+    uint8_t rbsp[64];
+    int rbsp_size, i;
+    bs_t a, b;
+
+    ASSERT_EQUAL( sps[0], 0x42 );
+    rbsp_size = hevc_extract_rbsp( sps, sps_size, rbsp );
+    ASSERT_EQUAL( rbsp_size, sps_size - 3 );
+
+    bs_init( &a, rbsp + 2, rbsp_size - 2 );
+    bs_init_nal( &b, sps + 2, sps_size - 2 );
+    for ( i = 0; !bs_eof( &a ); i++ ) {
+        int n = 1 + i % 13;
+
+        if ( i % 5 == 0 ) {
+            ASSERT_EQUAL( bs_read_ue( &a ), bs_read_ue( &b ) );
+        } else {
+            ASSERT_EQUAL( bs_read_u( &a, n ), bs_read_u( &b, n ) );
+        }
+    }
+    ASSERT_EQUAL( bs_eof( &b ), 1 );
+
+    bs_init_nal( &b, sps + 2, sps_size - 2 );
+    bs_skip_bytes( &b, 12 );
+    ASSERT_EQUAL( bs_read_u8( &b ), rbsp[14] );
+
+    return NULL;
+}
+
+char *test_hevc_get_config()
+{
+    HEVCDecoderConfigurationRecord config;
+
+    memset( &config, 0, sizeof(config) );
+    ASSERT_EQUAL( hevc_get_config( hevc_stream, sizeof(hevc_stream), &config ), 0 );
+    ASSERT_EQUAL( config.general_profile_idc, 1 );
+    ASSERT_EQUAL( config.general_level_idc, 93 );
+    ASSERT_EQUAL( config.chromaFormat, 1 );
+    ASSERT_EQUAL( config.bitDepthLumaMinus8, 0 );
+    ASSERT_EQUAL( config.bitDepthChromaMinus8, 0 );
+    ASSERT_EQUAL( config.numTemporalLayers, 2 );
+    ASSERT_EQUAL( config.temporalIdNested, 1 );
+    ASSERT_EQUAL( config.parallelismType, 3 );
+    ASSERT_EQUAL( config.min_spatial_segmentation_idc, 4 );
+    ASSERT_EQUAL( config.general_profile_compatibility_flags, 0x60000000 );
+    mu_assert( config.general_constraint_indicator_flags == 0x900000000000ULL );
+    ASSERT_EQUAL( config.configurationVersion, 1 );
+    ASSERT_EQUAL( config.lengthSizeMinusOne, 3 );
+    ASSERT_EQUAL( config.numOfArrays, 3 );
+    // 60000/1001 fps in frames per 256 s, no HRD to say it is fixed
+    ASSERT_EQUAL( config.avgFrameRate, 15344 );
+    ASSERT_EQUAL( config.constantFrameRate, 0 );
+    hevc_config_free( &config );
+
+    // bad arguments on a record that was never initialized
+    memset( &config, 0xa5, sizeof(config) );
+    ASSERT_EQUAL( hevc_get_config( hevc_stream, 0, &config ), -1 );
+    mu_assert( config.array == NULL );
+    memset( &config, 0xa5, sizeof(config) );
+    ASSERT_EQUAL( hevc_get_config( NULL, sizeof(hevc_stream), &config ), -1 );
+    mu_assert( config.array == NULL );
+    ASSERT_EQUAL( hevc_get_config( hevc_stream, sizeof(hevc_stream), NULL ), -1 );
+    return NULL;
+}
+
+char *test_hevc_config_write()
+{
+    static const uint8_t header[] = {
+        0x01, 0x01, 0x60, 0x00, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x5d, 0xf0, 0x04, 0xff, 0xfd, 0xf8, 0xf8, 0x3b, 0xf0, 0x17, 0x03,
+    };
+    HEVCDecoderConfigurationRecord config, parsed;
+    uint8_t hvcc[256], again[256];
+    int size, i;
+
+    ASSERT_EQUAL( hevc_get_config( hevc_stream, sizeof(hevc_stream), &config ), 0 );
+    // the parameter sets are referenced, not copied
+    for ( i = 0; i < config.numOfArrays; i++ ) {
+        ASSERT_EQUAL( config.array[i].numNalus, 1 );
+        mu_assert( config.array[i].nalUnit[0] > hevc_stream &&
+                   config.array[i].nalUnit[0] < hevc_stream + sizeof(hevc_stream) );
+    }
+    ASSERT_EQUAL( config.array[1].NAL_unit_type, HEVC_NAL_SPS );
+    ASSERT_EQUAL( config.array[1].nalUnitLength[0], 54 );
+
+    size = hevc_config_size( &config );
+    ASSERT_EQUAL( hevc_config_write( &config, hvcc, size - 1 ), -1 );
+    ASSERT_EQUAL( hevc_config_write( &config, hvcc, sizeof(hvcc) ), size );
+    ASSERT_MEM_EQUAL( hvcc, header, (int)sizeof(header) );
+    ASSERT_EQUAL( hvcc[23], (0x80 | HEVC_NAL_VPS) );
+    ASSERT_EQUAL( (hvcc[24] << 8 | hvcc[25]), 1 );
+
+    ASSERT_EQUAL( hevc_config_parse( hvcc, size, &parsed ), size );
+    ASSERT_EQUAL( parsed.numOfArrays, 3 );
+    ASSERT_EQUAL( parsed.min_spatial_segmentation_idc, 4 );
+    mu_assert( parsed.general_constraint_indicator_flags == 0x900000000000ULL );
+    mu_assert( parsed.array[2].nalUnit[0] > hvcc && parsed.array[2].nalUnit[0] < hvcc + size );
+    ASSERT_EQUAL( hevc_config_write( &parsed, again, sizeof(again) ), size );
+    ASSERT_MEM_EQUAL( again, hvcc, size );
+    hevc_config_free( &parsed );
+
+    ASSERT_EQUAL( hevc_config_parse( hvcc, size - 1, &parsed ), -1 );
+
+    hevc_config_free( &parsed );
+    hevc_config_free( &config );
+    return NULL;
+}
+
+char *test_startcode_impls()
+{
+    // every variant must find the same start codes, including ones in the
+    // scalar tail and ones straddling a vector block
+    static uint8_t buf[4096];
+    uint32_t seed = 1;
+    int i, impl;
+
+    for ( i = 0; i < (int)sizeof(buf); i++ ) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (seed >> 16) & 0x7 ? seed >> 24 : 0;
+    }
+    for ( i = 15; i < (int)sizeof(buf) - 3; i += 37 + i % 29 ) {
+        buf[i] = 0; buf[i+1] = 0; buf[i+2] = 1;
+    }
+    buf[sizeof(buf)-3] = 0; buf[sizeof(buf)-2] = 0; buf[sizeof(buf)-1] = 1;
+
+    for ( impl = STARTCODE_IMPL_SSE2; impl < STARTCODE_IMPL_NB; impl++ ) {
+        StartcodeFinder ref = startcode_get_impl( STARTCODE_IMPL_C );
+        StartcodeFinder find = startcode_get_impl( impl );
+        const uint8_t *p = buf, *q = buf, *end = buf + sizeof(buf);
+
+        if ( !find )
+            continue;
+        do {
+            p = ref( p, end );
+            q = find( q, end );
+            ASSERT_EQUAL( (int)(q - buf), (int)(p - buf) );
+            p++; q++;
+        } while ( p < end );
+    }
+
+    ASSERT_EQUAL( (int)(startcode_find( buf, buf + 18 ) - buf), 15 );
+    ASSERT_EQUAL( (int)(startcode_find( buf, buf + 17 ) - buf), 17 );
+
+    return NULL;
+}
+
+/* 1920x1080 main profile SPS without VUI, 2 pictures of reordering */
+static int write_sps_no_vui( uint8_t *buf, int size )
+{
+    bw_t bw;
+
+    bw_init_nal( &bw, buf, size );
+    bw_write_u( &bw, 16, 0x4201 );
+    bw_write_u( &bw, 8, 0x01 );         // vps id, 1 sub-layer, nested
+    bw_write_u( &bw, 8, 0x01 );         // general profile space, tier, Main
+    bw_write_u( &bw, 32, 0x60000000 );
+    bw_write_ull( &bw, 48, 0x900000000000ULL );
+    bw_write_u( &bw, 8, 120 );          // level 4
+    bw_write_ue( &bw, 0 );              // sps id
+    bw_write_ue( &bw, 1 );              // 4:2:0
+    bw_write_ue( &bw, 1920 );
+    bw_write_ue( &bw, 1080 );
+    bw_write_u1( &bw, 0 );              // conformance window
+    bw_write_ue( &bw, 0 );
+    bw_write_ue( &bw, 0 );
+    bw_write_ue( &bw, 4 );              // log2_max_pic_order_cnt_lsb_minus4
+    bw_write_u1( &bw, 1 );
+    bw_write_ue( &bw, 4 );              // max_dec_pic_buffering_minus1
+    bw_write_ue( &bw, 2 );              // max_num_reorder_pics
+    bw_write_ue( &bw, 0 );
+    bw_write_ue( &bw, 0 );              // 8x8 to 64x64 CUs
+    bw_write_ue( &bw, 3 );
+    bw_write_ue( &bw, 0 );
+    bw_write_ue( &bw, 3 );
+    bw_write_ue( &bw, 1 );
+    bw_write_ue( &bw, 1 );
+    bw_write_u( &bw, 4, 0x2 );          // scaling list, amp, sao, pcm
+    bw_write_ue( &bw, 0 );              // no short-term RPS
+    bw_write_u( &bw, 5, 0x4 );          // long-term, tmvp, intra smoothing, vui, extension
+    bw_write_trailing_bits( &bw );
+    return bw_flush( &bw );
+}
+
+char *test_hevc_rewrite_sps()
+{
+    const uint8_t *sps = hevc_stream + 42;
+    uint8_t out[128], again[128];
+    HEVCParamSets ps;
+    HevcSpsPatch patch;
+    NalUnit nalu = { HEVC_NAL_SPS, NULL, 0 };
+    int n, i;
+
+    // nothing patched: the same bytes
+    hevc_sps_patch_init( &patch );
+    ASSERT_EQUAL( hevc_rewrite_sps( sps, 54, &patch, out, sizeof(out) ), 54 );
+    mu_assert( !memcmp( out, sps, 54 ) );
+    ASSERT_EQUAL( hevc_rewrite_sps( hevc_stream + 4, 32, &patch, out, sizeof(out) ), -1 );
+
+    // the fixture has 0 of 3 DPB slots for reordering, and 1001/60000
+    patch.max_num_reorder_pics = 5;
+    patch.num_units_in_tick = 1;
+    patch.time_scale = 25;
+    patch.bitstream_restriction = 1;
+    n = hevc_rewrite_sps( sps, 54, &patch, out, sizeof(out) );
+    mu_assert( n > 0 );
+    ASSERT_EQUAL( hevc_rewrite_sps( sps, 54, &patch, out, n - 1 ), -1 );
+
+    hevc_ps_init( &ps );
+    nalu.addr = out;
+    nalu.size = n;
+    ASSERT_EQUAL( hevc_ps_parse( &ps, &nalu ), 1 );
+    mu_assert( ps.sps[0] != NULL );
+    ASSERT_EQUAL( ps.sps[0]->width, 1920 );
+    ASSERT_EQUAL( ps.sps[0]->height, 1080 );
+    ASSERT_EQUAL( ps.sps[0]->max_num_reorder_pics[0], 2 );
+    ASSERT_EQUAL( ps.sps[0]->max_dec_pic_buffering[0], 3 );
+    ASSERT_EQUAL( ps.sps[0]->timing_info_present_flag, 1 );
+    ASSERT_EQUAL( ps.sps[0]->num_units_in_tick, 1 );
+    ASSERT_EQUAL( ps.sps[0]->time_scale, 25 );
+    hevc_ps_free( &ps );
+
+    // patched again, or kept: no change
+    ASSERT_EQUAL( hevc_rewrite_sps( out, n, &patch, again, sizeof(again) ), n );
+    mu_assert( !memcmp( out, again, n ) );
+    hevc_sps_patch_init( &patch );
+    ASSERT_EQUAL( hevc_rewrite_sps( out, n, &patch, again, sizeof(again) ), n );
+    mu_assert( !memcmp( out, again, n ) );
+
+    // a VUI is added for the timing
+    n = write_sps_no_vui( again, sizeof(again) );
+    mu_assert( n > 0 );
+    patch.max_num_reorder_pics = 0;
+    patch.num_units_in_tick = 1001;
+    patch.time_scale = 30000;
+    nalu.addr = out;
+    for ( i = 0; i < 2; i++ ) {
+        nalu.size = i ? hevc_rewrite_sps( again, n, &patch, out, sizeof(out) ) : n;
+        if ( !i )
+            memcpy( out, again, n );
+        hevc_ps_init( &ps );
+        ASSERT_EQUAL( hevc_ps_parse( &ps, &nalu ), 1 );
+        ASSERT_EQUAL( ps.sps[0]->width, 1920 );
+        ASSERT_EQUAL( ps.sps[0]->max_dec_pic_buffering[0], 5 );
+        ASSERT_EQUAL( ps.sps[0]->max_num_reorder_pics[0], (i ? 0 : 2) );
+        ASSERT_EQUAL( ps.sps[0]->timing_info_present_flag, i );
+        ASSERT_EQUAL( ps.sps[0]->time_scale, (i ? 30000 : 0) );
+        hevc_ps_free( &ps );
+    }
+
+    return NULL;
+}
+
+char *test_epb_impls()
+{
+    // zeros and small values dense enough for runs of patterns
+    static const uint8_t zeros[5] = { 0, 0, 0, 0, 0 };
+    static const uint8_t escaped[8] = { 0, 0, 3, 0, 0, 3, 0, 3 };
+    static uint8_t buf[4096], ref[EPB_INSERT_SIZE( 4096 )], out[EPB_INSERT_SIZE( 4096 )];
+    uint8_t back[4096];
+    uint32_t seed = 7;
+    int i, impl, len, n;
+
+    for ( i = 0; i < (int)sizeof(buf); i++ ) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (seed >> 16) & 0x3 ? (seed >> 24) & 0x3 : seed >> 24;
+    }
+
+    ASSERT_EQUAL( epb_insert( zeros, 5, out ), 8 );
+    mu_assert( !memcmp( out, escaped, 8 ) );
+    ASSERT_EQUAL( epb_remove( escaped, 8, out ), 6 );
+    mu_assert( !memcmp( out, zeros, 5 ) && out[5] == 3 );
+    mu_assert( epb_next( escaped, escaped + 8 ) == escaped );
+    mu_assert( epb_next( escaped + 1, escaped + 8 ) == escaped + 3 );
+    mu_assert( epb_next( escaped + 4, escaped + 8 ) == escaped + 8 );
+    mu_assert( epb_next( zeros, zeros + 5 ) == zeros + 5 );
+
+    for ( impl = EPB_IMPL_C; impl < EPB_IMPL_NB; impl++ ) {
+        EpbFunc remove = epb_get_remove( impl ), insert = epb_get_insert( impl );
+
+        if ( !remove || !insert )
+            continue;
+        // every length up to a few blocks, at every alignment, then long ones
+        for ( len = 0; len < (int)sizeof(buf); len += len < 160 ? 1 : 509 ) {
+            const uint8_t *src = buf + (len & 3);
+
+            n = epb_get_remove( EPB_IMPL_C )( src, len, ref );
+            ASSERT_EQUAL( remove( src, len, out ), n );
+            mu_assert( !memcmp( out, ref, n ) );
+
+            n = epb_get_insert( EPB_IMPL_C )( src, len, ref );
+            mu_assert( n <= EPB_INSERT_SIZE( len ) );
+            ASSERT_EQUAL( insert( src, len, out ), n );
+            mu_assert( !memcmp( out, ref, n ) );
+            // a trailing zero gets an 03 the removal keeps
+            if ( len && src[len-1] ) {
+                ASSERT_EQUAL( remove( out, n, back ), len );
+                mu_assert( !memcmp( back, src, len ) );
+            }
+        }
+    }
 
-    ASSERT_NOT_EQUAL( fp, NULL );
+    return NULL;
+}
+
+typedef struct SplitResult {
+    int count;
+    int copied;
+    int types[16];
+    int sizes[16];
+    uint8_t data[1024];
+    int data_size;
+    const uint8_t *chunk;
+    int chunk_size;
+} SplitResult;
+
+static void on_split_nalu( const NalUnit *nalu, void *opaque )
+{
+    SplitResult *r = opaque;
+
+    if ( r->count >= 16 || r->data_size + nalu->size > (int)sizeof(r->data) )
+        return;
+    if ( nalu->addr < r->chunk || nalu->addr + nalu->size > r->chunk + r->chunk_size )
+        r->copied++;
+    r->types[r->count] = nalu->nalu_type;
+    r->sizes[r->count++] = nalu->size;
+    memcpy( r->data + r->data_size, nalu->addr, nalu->size );
+    r->data_size += nalu->size;
+}
+
+static char *check_splitter( const uint8_t *stream, int size )
+{
+    NalUnit nalu_list[16];
+    int n = hevc_parse_nalu( stream, size, nalu_list, 16 );
+    int chunk, i;
+
+    for ( chunk = 1; chunk <= size; chunk++ ) {
+        SplitResult r;
+        HevcNalSplitter *s;
+        int pos, off = 0;
+
+        memset( &r, 0, sizeof(r) );
+        s = hevc_splitter_new( on_split_nalu, &r );
+        for ( pos = 0; pos < size; pos += chunk ) {
+            r.chunk = stream + pos;
+            r.chunk_size = MIN( chunk, size - pos );
+            mu_assert( hevc_splitter_feed( s, r.chunk, r.chunk_size ) >= 0 );
+        }
+        hevc_splitter_flush( s );
+        hevc_splitter_free( s );
+
+        ASSERT_EQUAL( r.count, n );
+        for ( i = 0; i < n; i++ ) {
+            ASSERT_EQUAL( r.types[i], nalu_list[i].nalu_type );
+            ASSERT_EQUAL( r.sizes[i], nalu_list[i].size );
+            mu_assert( !memcmp( r.data + off, nalu_list[i].addr, r.sizes[i] ) );
+            off += r.sizes[i];
+        }
+        // one chunk: nothing but the last NAL may be copied
+        if ( chunk == size )
+            mu_assert( r.copied <= 1 );
+    }
+
+    return NULL;
+}
+
+char *test_hevc_splitter()
+{
+    // start codes split every way, extra zeros between NALs
+    static const uint8_t odd[] = {
+        0x12, 0x00, 0x00, 0x01, 0x40, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0x01, 0x42, 0x01, 0xaa, 0x00, 0x00, 0x00, 0x01, 0x44, 0x01,
+        0x00, 0x00, 0x01, 0x02, 0x01, 0x00, 0x00, 0x03, 0x01, 0x55,
+    };
+    // the input ends right after a start code
+    static const uint8_t cut[] = { 0x00, 0x00, 0x01, 0x40, 0x01, 0xaa, 0x00, 0x00, 0x00, 0x01 };
+    HevcNalSplitter *s;
+    SplitResult r;
+    char *res;
+    int chunk;
+
+    if ( (res = check_splitter( hevc_stream, sizeof(hevc_stream) )) )
+        return res;
+    if ( (res = check_splitter( odd, sizeof(odd) )) )
+        return res;
+
+    for ( chunk = 1; chunk <= (int)sizeof(cut); chunk++ ) {
+        int pos;
+
+        memset( &r, 0, sizeof(r) );
+        s = hevc_splitter_new( on_split_nalu, &r );
+        for ( pos = 0; pos < (int)sizeof(cut); pos += chunk ) {
+            r.chunk = cut + pos;
+            r.chunk_size = MIN( chunk, (int)sizeof(cut) - pos );
+            mu_assert( hevc_splitter_feed( s, r.chunk, r.chunk_size ) >= 0 );
+        }
+        ASSERT_EQUAL( hevc_splitter_flush( s ), 0 );
+        hevc_splitter_free( s );
+        ASSERT_EQUAL( r.count, 1 );
+        ASSERT_EQUAL( r.sizes[0], 3 );
+    }
+    return NULL;
+}
+
+char *test_hevc_nalu_list()
+{
+    NalUnit nalu_list[4];
+    NalUnitList list;
+    uint8_t *buf;
+    int i, n, capacity;
+
+    // a short list is filled up to its size and reports what it needs
+    memset( nalu_list, 0, sizeof(nalu_list) );
+    ASSERT_EQUAL( hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 3 ), 7 );
+    ASSERT_EQUAL( nalu_list[0].nalu_type, HEVC_NAL_AUD );
+    ASSERT_EQUAL( nalu_list[2].nalu_type, HEVC_NAL_SPS );
+    ASSERT_EQUAL( nalu_list[3].size, 0 );
+    ASSERT_EQUAL( hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), NULL, 0 ), 7 );
+
+    // a second of stream is hundreds of NALs
+    buf = malloc( sizeof(hevc_stream) * 100 );
+    for ( i = 0; i < 100; i++ )
+        memcpy( buf + i * sizeof(hevc_stream), hevc_stream, sizeof(hevc_stream) );
+
+    hevc_nalu_list_init( &list );
+    n = hevc_nalu_list_parse( &list, buf, sizeof(hevc_stream) * 100 );
+    ASSERT_EQUAL( n, 700 );
+    ASSERT_EQUAL( list.count, 700 );
+    ASSERT_EQUAL( list.nalu[699].nalu_type, HEVC_NAL_TRAIL_R );
+    ASSERT_EQUAL( list.nalu[701 - 7].nalu_type, HEVC_NAL_VPS );
+
+    capacity = list.capacity;
+    ASSERT_EQUAL( hevc_nalu_list_parse( &list, buf, sizeof(hevc_stream) * 50 ), 350 );
+    ASSERT_EQUAL( hevc_nalu_list_parse( &list, buf, sizeof(hevc_stream) * 100 ), 700 );
+    ASSERT_EQUAL( list.capacity, capacity );
+
+    hevc_nalu_list_free( &list );
+    free( buf );
+    return NULL;
+}
+
+static int iov_gather( const struct iovec *iov, int count, uint8_t *out )
+{
+    int i, size = 0;
+
+    for ( i = 0; i < count; i++ ) {
+        memcpy( out + size, iov[i].iov_base, iov[i].iov_len );
+        size += iov[i].iov_len;
+    }
+    return size;
+}
+
+char *test_hevc_convert()
+{
+    NalUnit nalu_list[8], back[8];
+    uint8_t annexb[sizeof(hevc_stream)], mp4[sizeof(hevc_stream) + 16], scratch[16];
+    struct iovec iov[8];
+    int n, count, size, i, off;
+
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+
+    // 5 NALs behind 4 byte start codes become one span, the two behind 3 byte
+    // ones get their length from scratch
+    memcpy( annexb, hevc_stream, sizeof(hevc_stream) );
+    count = hevc_annexb_to_mp4( annexb, sizeof(annexb), 0, iov, 8, scratch, sizeof(scratch) );
+    ASSERT_EQUAL( count, 5 );
+    mu_assert( iov[0].iov_base == annexb );
+    mu_assert( iov[1].iov_base == scratch && iov[3].iov_base == scratch + 4 );
+    ASSERT_EQUAL( hevc_annexb_to_mp4( annexb, sizeof(annexb), 0, iov, 8, scratch, 4 ), -1 );
+
+    memcpy( annexb, hevc_stream, sizeof(hevc_stream) );
+    count = hevc_annexb_to_mp4( annexb, sizeof(annexb), 0, iov, 8, scratch, sizeof(scratch) );
+    size = iov_gather( iov, count, mp4 );
+    for ( i = 0, off = 0; i < n; i++ ) {
+        int len = mp4[off] << 24 | mp4[off+1] << 16 | mp4[off+2] << 8 | mp4[off+3];
+
+        ASSERT_EQUAL( len, nalu_list[i].size );
+        mu_assert( !memcmp( mp4 + off + 4, nalu_list[i].addr, len ) );
+        off += 4 + len;
+    }
+    ASSERT_EQUAL( off, size );
+
+    // and back, in place with 4 byte lengths
+    count = hevc_mp4_to_annexb( mp4, size, 4, 0, iov, 8 );
+    ASSERT_EQUAL( count, 1 );
+    ASSERT_EQUAL( hevc_parse_nalu( iov[0].iov_base, iov[0].iov_len, back, 8 ), n );
+    for ( i = 0; i < n; i++ ) {
+        ASSERT_EQUAL( back[i].size, nalu_list[i].size );
+        mu_assert( !memcmp( back[i].addr, nalu_list[i].addr, back[i].size ) );
+    }
+
+    // dropping in-band parameter sets
+    memcpy( annexb, hevc_stream, sizeof(hevc_stream) );
+    count = hevc_annexb_to_mp4( annexb, sizeof(annexb), HEVC_CONVERT_DROP_PS, iov, 8, scratch, sizeof(scratch) );
+    ASSERT_EQUAL( count, 6 );
+    size = iov_gather( iov, count, mp4 );
+    ASSERT_EQUAL( size, (int)sizeof(hevc_stream) - 3 * 4 - nalu_list[1].size - nalu_list[2].size - nalu_list[3].size + 2 );
+
+    // 2 byte lengths go through the static start code
+    mp4[0] = 0; mp4[1] = 3; mp4[2] = 0x46; mp4[3] = 0x01; mp4[4] = 0x50;
+    mp4[5] = 0; mp4[6] = 2; mp4[7] = 0x44; mp4[8] = 0x01;
+    ASSERT_EQUAL( hevc_mp4_to_annexb( mp4, 9, 2, 0, iov, 8 ), 4 );
+    ASSERT_EQUAL( hevc_mp4_to_annexb( mp4, 9, 2, HEVC_CONVERT_DROP_PS, iov, 8 ), 2 );
+    ASSERT_EQUAL( hevc_mp4_to_annexb( mp4, 8, 2, 0, iov, 8 ), -1 );
+
+    return NULL;
+}
+
+// TRAIL_R P slice whose st_ref_pic_set is predicted from the SPS's second one
+static const uint8_t slice_inter_rps[] = {
+    0x02, 0x01, 0xd0, 0x13, 0x7f, 0xaf, 0x12, 0x34,
+};
+
+char *test_hevc_slice_header()
+{
+    NalUnit nalu_list[8], inter = { HEVC_NAL_TRAIL_R, slice_inter_rps, sizeof(slice_inter_rps) };
+    HEVCParamSets ps;
+    HEVCSliceHeader sh;
+    int i, n;
+
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+    ASSERT_EQUAL( n, 7 );
+
+    hevc_ps_init( &ps );
+    ASSERT_EQUAL( hevc_parse_slice_header( &ps, &nalu_list[4], &sh ), -1 );
+    for ( i = 0; i < 4; i++ )
+        ASSERT_EQUAL( hevc_ps_parse( &ps, &nalu_list[i] ), (i > 0) );
+    mu_assert( ps.sps[0] && ps.pps[0] );
+    ASSERT_EQUAL( ps.sps[0]->pic_width_in_luma_samples, 1920 );
+    ASSERT_EQUAL( ps.sps[0]->pic_height_in_luma_samples, 1088 );
+    ASSERT_EQUAL( ps.sps[0]->log2_ctb_size, 6 );
+    ASSERT_EQUAL( ps.sps[0]->conf_win_bottom_offset, 4 );
+    ASSERT_EQUAL( ps.sps[0]->width, 1920 );
+    ASSERT_EQUAL( ps.sps[0]->height, 1080 );
+    ASSERT_EQUAL( ps.sps[0]->max_sub_layers, 2 );
+    ASSERT_EQUAL( ps.sps[0]->max_dec_pic_buffering[0], 3 );
+    ASSERT_EQUAL( ps.sps[0]->max_dec_pic_buffering[1], 4 );
+    ASSERT_EQUAL( ps.sps[0]->max_num_reorder_pics[0], 0 );
+    ASSERT_EQUAL( ps.sps[0]->max_num_reorder_pics[1], 1 );
+    ASSERT_EQUAL( ps.sps[0]->timing_info_present_flag, 1 );
+    ASSERT_EQUAL( ps.sps[0]->num_units_in_tick, 1001 );
+    ASSERT_EQUAL( ps.sps[0]->time_scale, 60000 );
+    ASSERT_EQUAL( ps.sps[0]->num_short_term_ref_pic_sets, 2 );
+    ASSERT_EQUAL( ps.sps[0]->num_delta_pocs[1], 2 );
+    ASSERT_EQUAL( ps.pps[0]->entropy_coding_sync_enabled_flag, 1 );
+
+    ASSERT_EQUAL( hevc_parse_slice_header( &ps, &nalu_list[4], &sh ), 0 );
+    ASSERT_EQUAL( sh.nal_unit_type, HEVC_NAL_IDR_W_RADL );
+    ASSERT_EQUAL( sh.first_slice_segment_in_pic_flag, 1 );
+    ASSERT_EQUAL( sh.slice_type, HEVC_SLICE_I );
+    ASSERT_EQUAL( sh.pic_order_cnt_lsb, 0 );
+
+    ASSERT_EQUAL( hevc_parse_slice_header( &ps, &nalu_list[5], &sh ), 0 );
+    ASSERT_EQUAL( sh.pic_order_cnt_lsb, 1 );
+    ASSERT_EQUAL( sh.short_term_ref_pic_set_sps_flag, 1 );
+    ASSERT_EQUAL( sh.short_term_ref_pic_set_idx, 0 );
+    ASSERT_EQUAL( sh.num_delta_pocs, 1 );
+
+    ASSERT_EQUAL( hevc_parse_slice_header( &ps, &nalu_list[6], &sh ), 0 );
+    ASSERT_EQUAL( sh.first_slice_segment_in_pic_flag, 0 );
+    ASSERT_EQUAL( sh.slice_segment_address, 255 );
+    ASSERT_EQUAL( sh.pic_order_cnt_lsb, 1 );
+
+    ASSERT_EQUAL( hevc_parse_slice_header( &ps, &inter, &sh ), 0 );
+    ASSERT_EQUAL( sh.slice_type, HEVC_SLICE_P );
+    ASSERT_EQUAL( sh.pic_order_cnt_lsb, 2 );
+    ASSERT_EQUAL( sh.short_term_ref_pic_set_sps_flag, 0 );
+    ASSERT_EQUAL( sh.short_term_ref_pic_set_idx, 2 );
+    ASSERT_EQUAL( sh.num_delta_pocs, 3 );
+    // the slice's RPS must not leak into the SPS
+    ASSERT_EQUAL( ps.sps[0]->num_delta_pocs[2], 0 );
+
+    // truncated header
+    inter.size = 3;
+    ASSERT_EQUAL( hevc_parse_slice_header( &ps, &inter, &sh ), -1 );
+
+    hevc_ps_free( &ps );
+    return NULL;
+}
+
+char *test_hevc_ps_cache()
+{
+    NalUnit nalu_list[8], sps;
+    uint8_t buf[64];
+    HEVCParamSets ps;
+    int i, n;
+
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+    hevc_ps_init( &ps );
+    for ( i = 0; i < n; i++ )
+        ASSERT_EQUAL( hevc_ps_parse( &ps, &nalu_list[i] ), (i >= 1 && i <= 3) );
+    ASSERT_EQUAL( hevc_ps_config_changed( &ps ), 1 );
+    ASSERT_EQUAL( hevc_ps_config_changed( &ps ), 0 );
+    ASSERT_EQUAL( ps.sps_nal[0].size, nalu_list[2].size );
+    ASSERT_EQUAL( ps.sps[0]->general_level_idc, 93 );
+    ASSERT_EQUAL( ps.sps[0]->bit_depth_luma, 8 );
+
+    // the copies resent before the next IDR are not parsed again
+    for ( i = 1; i <= 3; i++ )
+        ASSERT_EQUAL( hevc_ps_parse( &ps, &nalu_list[i] ), 0 );
+    ASSERT_EQUAL( hevc_ps_config_changed( &ps ), 0 );
+
+    // a level change is a config change
+    memcpy( buf, nalu_list[2].addr, nalu_list[2].size );
+    sps = nalu_list[2];
+    sps.addr = buf;
+    ASSERT_EQUAL( buf[17], 0x5d );
+    buf[17] = 0x78;
+    ASSERT_EQUAL( hevc_ps_parse( &ps, &sps ), 1 );
+    ASSERT_EQUAL( hevc_ps_config_changed( &ps ), 1 );
+    ASSERT_EQUAL( ps.sps[0]->general_level_idc, 120 );
+    mu_assert( !memcmp( ps.sps_nal[0].data, buf, sps.size ) );
+
+    // going back is one too
+    ASSERT_EQUAL( hevc_ps_parse( &ps, &nalu_list[2] ), 1 );
+    ASSERT_EQUAL( hevc_ps_config_changed( &ps ), 1 );
+
+    // broken ones don't replace what is stored
+    sps.size = 8;
+    ASSERT_EQUAL( hevc_ps_parse( &ps, &sps ), -1 );
+    ASSERT_EQUAL( ps.sps[0]->general_level_idc, 93 );
+
+    hevc_ps_free( &ps );
+    return NULL;
+}
+
+char *test_hevc_au_boundary()
+{
+    static const int expect[7] = { 1, 0, 0, 0, 0, 1, 0 };
+    NalUnit nalu_list[8];
+    HevcAuDetector au;
+    int i, n;
+
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+    hevc_au_init( &au );
+    for ( i = 0; i < n; i++ )
+        ASSERT_EQUAL( hevc_au_starts( &au, &nalu_list[i] ), expect[i] );
+
+    // without AUD, the parameter sets after a picture open the next AU
+    hevc_au_init( &au );
+    for ( i = 1; i < n; i++ )
+        ASSERT_EQUAL( hevc_au_starts( &au, &nalu_list[i] ), (i == 1 || i == 5) );
+    ASSERT_EQUAL( hevc_au_starts( &au, &nalu_list[1] ), 1 );
+    ASSERT_EQUAL( hevc_au_starts( &au, &nalu_list[2] ), 0 );
+
+    return NULL;
+}
+
+typedef struct RtpResult {
+    SplitResult nal;
+    uint32_t timestamps[16];
+    int released;
+    HEVCParamSets ps;
+} RtpResult;
+
+static void on_rtp_nalu( const NalUnit *nalu, uint32_t timestamp, void *opaque )
+{
+    RtpResult *r = opaque;
+
+    if ( r->nal.count < 16 )
+        r->timestamps[r->nal.count] = timestamp;
+    on_split_nalu( nalu, &r->nal );
+    hevc_ps_parse( &r->ps, nalu );
+}
+
+static void on_rtp_release( uint8_t *packet, void *packet_opaque, void *opaque )
+{
+    ((RtpResult *)opaque)->released++;
+}
+
+/* RTP header, 96 PT, then payload; returns the packet size */
+static int rtp_packet( uint8_t *out, uint16_t seq, uint32_t ts, const uint8_t *payload, int size )
+{
+    out[0] = 0x80;
+    out[1] = 96;
+    out[2] = seq >> 8;
+    out[3] = seq;
+    out[4] = ts >> 24; out[5] = ts >> 16; out[6] = ts >> 8; out[7] = ts;
+    memset( out + 8, 0, 4 );
+    memcpy( out + 12, payload, size );
+    return size + 12;
+}
+
+char *test_hevc_rtp_depack()
+{
+    static const int order[7] = { 0, 2, 1, 4, 3, 6, 5 };
+    NalUnit nalu_list[8];
+    uint8_t packets[7][128], payload[128], copy[7][128];
+    int sizes[7], n, i, j, len;
+    HEVCDecoderConfigurationRecord config;
+    HevcRtpDepacketizer *d;
+    RtpResult r;
+
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+
+    // AUD | AP(VPS, SPS, PPS) | IDR in 3 FUs | TRAIL | TRAIL, wrapping the sequence number
+    sizes[0] = rtp_packet( packets[0], 65533, 0, nalu_list[0].addr, nalu_list[0].size );
+    payload[0] = HEVC_RTP_NAL_AP << 1;
+    payload[1] = 1;
+    for ( i = 1, len = 2; i <= 3; i++ ) {
+        payload[len++] = nalu_list[i].size >> 8;
+        payload[len++] = nalu_list[i].size;
+        memcpy( payload + len, nalu_list[i].addr, nalu_list[i].size );
+        len += nalu_list[i].size;
+    }
+    sizes[1] = rtp_packet( packets[1], 65534, 0, payload, len );
+    for ( i = 0, j = 2; i < 3; i++ ) {
+        int frag = i < 2 ? 3 : nalu_list[4].size - 2 - 6;
+
+        payload[0] = HEVC_RTP_NAL_FU << 1;
+        payload[1] = 1;
+        payload[2] = (i == 0 ? 0x80 : 0) | (i == 2 ? 0x40 : 0) | HEVC_NAL_IDR_W_RADL;
+        memcpy( payload + 3, nalu_list[4].addr + j, frag );
+        j += frag;
+        sizes[2+i] = rtp_packet( packets[2+i], 65535 + i, 0, payload, 3 + frag );
+    }
+    for ( i = 5; i < 7; i++ )
+        sizes[i] = rtp_packet( packets[i], i - 5 + 2, 3000 * (i - 4), nalu_list[i].addr, nalu_list[i].size );
+
+    // reordered within the window: same NALs, only the FU one copied
+    memset( &r, 0, sizeof(r) );
+    hevc_ps_init( &r.ps );
+    memcpy( copy, packets, sizeof(packets) );
+    d = hevc_rtp_depack_new( 3, 0, on_rtp_nalu, on_rtp_release, &r );
+    for ( i = 0; i < 7; i++ ) {
+        r.nal.chunk = copy[order[i]];
+        r.nal.chunk_size = sizes[order[i]];
+        ASSERT_EQUAL( hevc_rtp_depack_push( d, copy[order[i]], sizes[order[i]], NULL ), 0 );
+    }
+    hevc_rtp_depack_flush( d );
+    ASSERT_EQUAL( r.released, 7 );
+    ASSERT_EQUAL( r.nal.count, n );
+    ASSERT_EQUAL( hevc_rtp_depack_lost( d ), 0 );
+    for ( i = 0, j = 0; i < n; i++ ) {
+        ASSERT_EQUAL( r.nal.sizes[i], nalu_list[i].size );
+        mu_assert( !memcmp( r.nal.data + j, nalu_list[i].addr, nalu_list[i].size ) );
+        j += nalu_list[i].size;
+    }
+    ASSERT_EQUAL( r.timestamps[6], 6000 );
+    hevc_rtp_depack_free( d );
+
+    // the parameter sets it produced make a config
+    ASSERT_EQUAL( hevc_ps_get_config( &r.ps, &config ), 0 );
+    ASSERT_EQUAL( config.numOfArrays, 3 );
+    ASSERT_EQUAL( config.general_level_idc, 93 );
+    hevc_config_free( &config );
+    hevc_ps_free( &r.ps );
+
+    // the middle fragment lost: the IDR is dropped, nothing else
+    memset( &r, 0, sizeof(r) );
+    memcpy( copy, packets, sizeof(packets) );
+    d = hevc_rtp_depack_new( 0, 0, on_rtp_nalu, on_rtp_release, &r );
+    for ( i = 0; i < 7; i++ )
+        if ( i != 3 )
+            ASSERT_EQUAL( hevc_rtp_depack_push( d, copy[i], sizes[i], NULL ), 0 );
+    ASSERT_EQUAL( r.nal.count, n - 1 );
+    ASSERT_EQUAL( r.nal.types[4], HEVC_NAL_TRAIL_R );
+    ASSERT_EQUAL( hevc_rtp_depack_lost( d ), 1 );
+    // late and broken packets
+    ASSERT_EQUAL( hevc_rtp_depack_push( d, copy[3], sizes[3], NULL ), 0 );
+    ASSERT_EQUAL( hevc_rtp_depack_push( d, copy[3], 8, NULL ), -1 );
+    ASSERT_EQUAL( r.nal.count, n - 1 );
+    ASSERT_EQUAL( r.released, 8 );
+    hevc_rtp_depack_free( d );
+    hevc_ps_free( &r.ps );
+
+    // DONL in a single NAL packet
+    memset( &r, 0, sizeof(r) );
+    payload[0] = nalu_list[5].addr[0];
+    payload[1] = nalu_list[5].addr[1];
+    payload[2] = 0;
+    payload[3] = 7;
+    memcpy( payload + 4, nalu_list[5].addr + 2, nalu_list[5].size - 2 );
+    len = rtp_packet( copy[0], 1, 0, payload, nalu_list[5].size + 2 );
+    d = hevc_rtp_depack_new( 0, 1, on_rtp_nalu, NULL, &r );
+    ASSERT_EQUAL( hevc_rtp_depack_push( d, copy[0], len, NULL ), 0 );
+    ASSERT_EQUAL( r.nal.count, 1 );
+    ASSERT_MEM_EQUAL( r.nal.data, nalu_list[5].addr, nalu_list[5].size );
+    hevc_rtp_depack_free( d );
+    hevc_ps_free( &r.ps );
+
+    return NULL;
+}
+
+char *test_hevc_rtp_pack()
+{
+    NalUnit nalu_list[8];
+    HevcRtpPacket packets[16];
+    HevcRtpPacketizer pack;
+    HevcRtpDepacketizer *d;
+    uint8_t wire[16][64];
+    int n, count, i, j;
+    RtpResult r;
+
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+    ASSERT_EQUAL( hevc_rtp_pack_init( &pack, 15, 96, 0x1234, 0 ), -1 );
+
+    // 48 bytes: AUD+VPS and PPS+IDR+TRAIL go into APs, the 54 byte SPS is
+    // fragmented, the last TRAIL goes alone
+    ASSERT_EQUAL( hevc_rtp_pack_init( &pack, 48, 96, 0x1234, 65535 ), 0 );
+    ASSERT_EQUAL( hevc_rtp_pack_au( &pack, nalu_list, n, 9000, packets, 2 ), -1 );
+    ASSERT_EQUAL( pack.seq, 65535 );
+    count = hevc_rtp_pack_au( &pack, nalu_list, n, 9000, packets, 16 );
+    ASSERT_EQUAL( count, 5 );
+    ASSERT_EQUAL( pack.seq, 4 );
+
+    ASSERT_EQUAL( ((packets[0].header[12] >> 1) & 0x3f), HEVC_RTP_NAL_AP );
+    ASSERT_EQUAL( ((packets[1].header[12] >> 1) & 0x3f), HEVC_RTP_NAL_FU );
+    ASSERT_EQUAL( packets[1].header[14], (0x80 | HEVC_NAL_SPS) );
+    ASSERT_EQUAL( packets[2].header[14], (0x40 | HEVC_NAL_SPS) );
+    ASSERT_EQUAL( packets[3].iov_count, 6 );
+    ASSERT_EQUAL( packets[4].iov_count, 2 );
+    for ( i = 0; i < count; i++ ) {
+        mu_assert( packets[i].size <= 48 );
+        ASSERT_EQUAL( (packets[i].header[1] & 0x80), (i == count - 1 ? 0x80 : 0) );
+    }
+    // payload is referenced, not copied
+    mu_assert( packets[0].iov[1].iov_base == nalu_list[0].addr );
+    mu_assert( packets[1].iov[1].iov_base == nalu_list[2].addr + 2 );
+
+    // and back through the depacketizer
+    memset( &r, 0, sizeof(r) );
+    d = hevc_rtp_depack_new( 0, 0, on_rtp_nalu, NULL, &r );
+    for ( i = 0; i < count; i++ ) {
+        int size = 0;
+
+        for ( j = 0; j < packets[i].iov_count; j++ ) {
+            memcpy( wire[i] + size, packets[i].iov[j].iov_base, packets[i].iov[j].iov_len );
+            size += packets[i].iov[j].iov_len;
+        }
+        ASSERT_EQUAL( size, packets[i].size );
+        ASSERT_EQUAL( hevc_rtp_depack_push( d, wire[i], size, NULL ), 0 );
+    }
+    ASSERT_EQUAL( r.nal.count, n );
+    for ( i = 0, j = 0; i < n; i++ ) {
+        ASSERT_EQUAL( r.nal.sizes[i], nalu_list[i].size );
+        mu_assert( !memcmp( r.nal.data + j, nalu_list[i].addr, nalu_list[i].size ) );
+        j += nalu_list[i].size;
+    }
+    hevc_rtp_depack_free( d );
+    hevc_ps_free( &r.ps );
+
+    return NULL;
+}
+
+typedef struct TsResult {
+    SplitResult nal;
+    int64_t pts[16];
+    int64_t dts[16];
+} TsResult;
+
+static void on_ts_nalu( const NalUnit *nalu, int pid, int64_t pts, int64_t dts, void *opaque )
+{
+    TsResult *r = opaque;
+
+    if ( pid != 0x101 )
+        return;
+    if ( r->nal.count < 16 ) {
+        r->pts[r->nal.count] = pts;
+        r->dts[r->nal.count] = dts;
+    }
+    on_split_nalu( nalu, &r->nal );
+}
+
+/* one TS packet carrying as much of payload as fits, stuffed with an
+ * adaptation field when it is short. returns the payload bytes used */
+static int ts_put_packet( uint8_t *out, int pid, int pusi, int *cc, const uint8_t *payload, int len )
+{
+    int room = HEVC_TS_PACKET_SIZE - 4, used = MIN( len, room );
+
+    out[0] = 0x47;
+    out[1] = (pusi ? 0x40 : 0) | pid >> 8;
+    out[2] = pid;
+    out[3] = 0x10 | (*cc & 0x0f);
+    (*cc)++;
+    if ( used < room ) {
+        int af = room - used - 1;
+
+        out[3] |= 0x20;
+        out[4] = af;
+        if ( af ) {
+            out[5] = 0;
+            memset( out + 6, 0xff, af - 1 );
+        }
+    }
+    memcpy( out + HEVC_TS_PACKET_SIZE - used, payload, used );
+    return used;
+}
+
+static void ts_put_timestamp( uint8_t *p, int prefix, int64_t ts )
+{
+    p[0] = prefix << 4 | ((ts >> 29) & 0x0e) | 1;
+    p[1] = ts >> 22;
+    p[2] = ((ts >> 14) & 0xfe) | 1;
+    p[3] = ts >> 7;
+    p[4] = ((ts << 1) & 0xfe) | 1;
+}
+
+char *test_hevc_ts_demux()
+{
+    static const uint8_t pat[] = {
+        0x00, 0x00, 0xb0, 0x0d, 0x00, 0x01, 0xc1, 0x00, 0x00,
+        0x00, 0x01, 0xe1, 0x00, 0xde, 0xad, 0xbe, 0xef,
+    };
+    static const uint8_t pmt[] = {
+        0x00, 0x02, 0xb0, 0x12, 0x00, 0x01, 0xc1, 0x00, 0x00, 0xe1, 0x01, 0xf0, 0x00,
+        0x24, 0xe1, 0x01, 0xf0, 0x00, 0xde, 0xad, 0xbe, 0xef,
+    };
+    static uint8_t ts[HEVC_TS_PACKET_SIZE * 16];
+    uint8_t es[304 + sizeof(hevc_stream)], pes[sizeof(es) + 19];
+    NalUnit nalu_list[8];
+    HevcTsDemuxer *d;
+    int n, i, k, size = 0, cc = 0, chunk;
+    TsResult r;
+
+    // filler data NAL long enough to cross packets, then the fixture
+    memset( es, 0xff, 304 );
+    memcpy( es, "\x00\x00\x00\x01\x4c\x01", 6 );
+    es[303] = 0x80;
+    memcpy( es + 304, hevc_stream, sizeof(hevc_stream) );
+    n = hevc_parse_nalu( es, sizeof(es), nalu_list, 8 );
+    ASSERT_EQUAL( n, 8 );
+
+    size += HEVC_TS_PACKET_SIZE;
+    ts_put_packet( ts, 0, 1, &cc, pat, sizeof(pat) );
+    size += HEVC_TS_PACKET_SIZE;
+    ts_put_packet( ts + HEVC_TS_PACKET_SIZE, 0x100, 1, &cc, pmt, sizeof(pmt) );
+
+    // two PES of 3 packets, PTS/DTS 3600/0 and 7200/3600
+    cc = 0;
+    for ( k = 0; k < 2; k++ ) {
+        int len = sizeof(pes), off = 0;
+
+        memcpy( pes, "\x00\x00\x01\xe0\x00\x00\x80\xc0\x0a", 9 );
+        ts_put_timestamp( pes + 9, 3, 3600 * (k + 1) );
+        ts_put_timestamp( pes + 14, 1, 3600 * k );
+        memcpy( pes + 19, es, sizeof(es) );
+        while ( off < len ) {
+            off += ts_put_packet( ts + size, 0x101, off == 0, &cc, pes + off, len - off );
+            size += HEVC_TS_PACKET_SIZE;
+        }
+    }
+    ASSERT_EQUAL( size, 8 * HEVC_TS_PACKET_SIZE );
+
+    for ( chunk = 1; chunk <= size; chunk += (chunk < 200 ? 37 : size) ) {
+        memset( &r, 0, sizeof(r) );
+        r.nal.chunk = ts;
+        r.nal.chunk_size = size;
+        d = hevc_ts_demux_new( on_ts_nalu, &r );
+        for ( i = 0; i < size; i += chunk )
+            ASSERT_EQUAL( hevc_ts_demux_feed( d, ts + i, MIN( chunk, size - i ) ), 0 );
+        ASSERT_EQUAL( hevc_ts_demux_flush( d ), 0 );
+        ASSERT_EQUAL( hevc_ts_demux_errors( d ), 0 );
+        ASSERT_EQUAL( r.nal.count, 2 * n );
+        for ( i = 0, k = 0; i < 2 * n; i++ ) {
+            const NalUnit *nal = &nalu_list[i % n];
+
+            ASSERT_EQUAL( r.nal.sizes[i], nal->size );
+            mu_assert( !memcmp( r.nal.data + k, nal->addr, nal->size ) );
+            k += nal->size;
+            mu_assert( r.pts[i] == 3600 * (i / n + 1) && r.dts[i] == 3600 * (i / n) );
+        }
+        // only the filler and the SPS cross a packet boundary and are copied
+        if ( chunk > size )
+            ASSERT_EQUAL( r.nal.copied, 4 );
+        hevc_ts_demux_free( d );
+    }
+
+    // a lost packet drops the rest of its PES
+    memset( &r, 0, sizeof(r) );
+    d = hevc_ts_demux_new( on_ts_nalu, &r );
+    ASSERT_EQUAL( hevc_ts_demux_feed( d, ts, 3 * HEVC_TS_PACKET_SIZE ), 0 );
+    ASSERT_EQUAL( hevc_ts_demux_feed( d, ts + 4 * HEVC_TS_PACKET_SIZE, size - 4 * HEVC_TS_PACKET_SIZE ), 0 );
+    ASSERT_EQUAL( hevc_ts_demux_flush( d ), 0 );
+    ASSERT_EQUAL( hevc_ts_demux_errors( d ), 1 );
+    ASSERT_EQUAL( r.nal.count, n );
+    ASSERT_EQUAL( (int)r.pts[0], 7200 );
+    hevc_ts_demux_free( d );
+
+    // the second PES starts inside the filler NAL, without
+    // data_alignment_indicator: the filler goes out whole, with the PTS of
+    // the PES it began in
+    size = 2 * HEVC_TS_PACKET_SIZE;
+    cc = 0;
+    for ( k = 0; k < 2; k++ ) {
+        int from = k ? 150 : 0, to = k ? (int)sizeof(es) : 150, len = 14 + to - from, off = 0;
+
+        memcpy( pes, "\x00\x00\x01\xe0\x00\x00\x80\x80\x05", 9 );
+        ts_put_timestamp( pes + 9, 2, 3600 * (k + 1) );
+        memcpy( pes + 14, es + from, to - from );
+        while ( off < len ) {
+            off += ts_put_packet( ts + size, 0x101, off == 0, &cc, pes + off, len - off );
+            size += HEVC_TS_PACKET_SIZE;
+        }
+    }
+    memset( &r, 0, sizeof(r) );
+    d = hevc_ts_demux_new( on_ts_nalu, &r );
+    ASSERT_EQUAL( hevc_ts_demux_feed( d, ts, size ), 0 );
+    ASSERT_EQUAL( hevc_ts_demux_flush( d ), 0 );
+    ASSERT_EQUAL( hevc_ts_demux_errors( d ), 0 );
+    ASSERT_EQUAL( r.nal.count, n );
+    for ( i = 0, k = 0; i < n; i++ ) {
+        ASSERT_EQUAL( r.nal.sizes[i], nalu_list[i].size );
+        mu_assert( !memcmp( r.nal.data + k, nalu_list[i].addr, nalu_list[i].size ) );
+        k += nalu_list[i].size;
+        mu_assert( r.pts[i] == (i ? 7200 : 3600) && r.dts[i] == r.pts[i] );
+    }
+    hevc_ts_demux_free( d );
+
+    return NULL;
+}
+
+static uint32_t be32( const uint8_t *p )
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/* first box of type inside [p, end), descending into the container path */
+static const uint8_t *find_box( const uint8_t *p, const uint8_t *end, const char *type )
+{
+    while ( end - p >= 8 ) {
+        uint32_t size = be32( p );
+
+        if ( size < 8 || size > (uint32_t)(end - p) )
+            return NULL;
+        if ( !memcmp( p + 4, type, 4 ) )
+            return p;
+        p += size;
+    }
+    return NULL;
+}
+
+char *test_hevc_fmp4()
+{
+    NalUnit nalu_list[8];
+    HEVCDecoderConfigurationRecord config;
+    HevcFmp4Writer w;
+    HevcFmp4Sample samples[2];
+    HEVCParamSets ps;
+    uint8_t init[1024], header[256], seg[1024];
+    const uint8_t *moov, *box, *trun;
+    struct iovec iov[16];
+    int n, size, count, i, off;
+
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+    hevc_ps_init( &ps );
+    for ( i = 0; i < n; i++ )
+        hevc_ps_parse( &ps, &nalu_list[i] );
+    ASSERT_EQUAL( hevc_ps_get_config( &ps, &config ), 0 );
+
+    hevc_fmp4_init( &w, ps.sps[0] );
+    ASSERT_EQUAL( w.timescale, 60000 );
+    ASSERT_EQUAL( w.default_duration, 1001 );
+
+    size = hevc_fmp4_init_segment( &w, &config, init, sizeof(init) );
+    mu_assert( size > 0 );
+    ASSERT_EQUAL( hevc_fmp4_init_segment( &w, &config, init, size - 1 ), -1 );
+    ASSERT_EQUAL( hevc_fmp4_init_segment( &w, &config, init, size ), size );
+    mu_assert( find_box( init, init + size, "ftyp" ) == init );
+    moov = find_box( init, init + size, "moov" );
+    mu_assert( moov && moov + be32( moov ) == init + size );
+    box = find_box( moov + 8, moov + be32( moov ), "trak" );
+    box = find_box( box + 8, box + be32( box ), "tkhd" );
+    ASSERT_EQUAL( be32( box + 84 ), 1920 << 16 );
+    ASSERT_EQUAL( be32( box + 88 ), 1080 << 16 );
+    for ( i = 0; i + 4 <= size && memcmp( init + i, "hvcC", 4 ); i++ );
+    ASSERT_EQUAL( (int)be32( init + i - 4 ), 8 + hevc_config_size( &config ) );
+
+    // AUD+VPS+SPS+PPS+IDR, then the two TRAIL_R slices 2 ticks later
+    samples[0].nalu = nalu_list;
+    samples[0].nalu_count = 5;
+    samples[0].duration = 0;
+    samples[0].cts_offset = 1001;
+    samples[1].nalu = nalu_list + 5;
+    samples[1].nalu_count = 2;
+    samples[1].duration = 2002;
+    samples[1].cts_offset = -1001;
+    ASSERT_EQUAL( hevc_fmp4_media_segment( &w, samples, 2, header, 60, iov, 16 ), -1 );
+    count = hevc_fmp4_media_segment( &w, samples, 2, header, hevc_fmp4_header_size( 2, 7 ), iov, 16 );
+    ASSERT_EQUAL( count, 8 );
+    mu_assert( iov[1].iov_base == nalu_list[0].addr );
+    ASSERT_EQUAL( w.sequence_number, 2 );
+    mu_assert( w.decode_time == 3003 );
+
+    size = iov_gather( iov, count, seg );
+    mu_assert( find_box( seg, seg + size, "moof" ) == seg );
+    box = find_box( seg, seg + size, "mdat" );
+    mu_assert( box && box + be32( box ) == seg + size );
+    trun = find_box( seg + 8, seg + size, "traf" );
+    trun = find_box( trun + 8, trun + be32( trun ), "trun" );
+    ASSERT_EQUAL( be32( trun + 12 ), 2 );                               // sample_count
+    ASSERT_EQUAL( (int)be32( trun + 16 ), (int)(box + 8 - seg) );      // data_offset
+    ASSERT_EQUAL( be32( trun + 20 ), 1001 );
+    ASSERT_EQUAL( be32( trun + 24 ), 4 + 3 + 4 + 10 );                 // AUD + IDR
+    ASSERT_EQUAL( be32( trun + 28 ), 0x02000000 );
+    ASSERT_EQUAL( be32( trun + 40 ), 4 + 11 + 4 + 12 );
+    ASSERT_EQUAL( be32( trun + 44 ), 0x01010000 );
+    ASSERT_EQUAL( (int32_t)be32( trun + 48 ), -1001 );
+
+    // length prefixed NALs in the mdat
+    off = box + 8 - seg;
+    for ( i = 0; i < n; i++ ) {
+        if ( i >= 1 && i <= 3 )
+            continue;
+        ASSERT_EQUAL( (int)be32( seg + off ), nalu_list[i].size );
+        mu_assert( !memcmp( seg + off + 4, nalu_list[i].addr, nalu_list[i].size ) );
+        off += 4 + nalu_list[i].size;
+    }
+    ASSERT_EQUAL( off, size );
+
+    hevc_config_free( &config );
+    hevc_ps_free( &ps );
+    return NULL;
+}
+
+typedef struct GopStress {
+    HevcGopRing *ring;
+    uint32_t count;     // NAL units the writer pushes
+    int errors;
+    int joins;
+} GopStress;
+
+/* synthetic slice carrying its sequence number, an IDR every 30 */
+static void gop_stress_nal( uint32_t seq, uint8_t buf[7], NalUnit *nalu )
+{
+    nalu->nalu_type = seq % 30 ? HEVC_NAL_TRAIL_R : HEVC_NAL_IDR_W_RADL;
+    buf[0] = nalu->nalu_type << 1;
+    buf[1] = 1;
+    buf[2] = 0x80;
+    buf[3] = seq >> 24;
+    buf[4] = seq >> 16;
+    buf[5] = seq >> 8;
+    buf[6] = seq;
+    nalu->addr = buf;
+    nalu->size = 7;
+}
+
+static void *gop_stress_writer( void *arg )
+{
+    GopStress *g = arg;
+    uint8_t buf[7];
+    NalUnit nalu;
+    uint32_t i;
+
+    for ( i = 0; i < g->count; i++ ) {
+        gop_stress_nal( i, buf, &nalu );
+        hevc_gop_push( g->ring, &nalu, i );
+    }
+    return NULL;
+}
+
+static void *gop_stress_reader( void *arg )
+{
+    GopStress *g = arg;
+    HevcGopNal *nal;
+    uint32_t cursor = 0, seq;
+    int joined = 0, ret;
+
+    while ( !joined || cursor < g->count ) {
+        if ( !joined ) {
+            if ( hevc_gop_join( g->ring, &cursor ) == 0 ) {
+                joined = 1;
+                g->joins++;
+            }
+            continue;
+        }
+        ret = hevc_gop_read( g->ring, &cursor, &nal );
+        if ( ret < 0 ) {
+            joined = 0;
+            continue;
+        }
+        if ( ret == 0 )
+            continue;
+        seq = (uint32_t)nal->data[3] << 24 | nal->data[4] << 16 | nal->data[5] << 8 | nal->data[6];
+        if ( seq != cursor - 1 || nal->timestamp != seq || nal->size != 7 )
+            g->errors++;
+        hevc_gop_nal_unref( nal );
+    }
+    return NULL;
+}
+
+char *test_hevc_gop_ring()
+{
+    NalUnit nalu_list[8];
+    HevcGopRing *ring;
+    HevcGopNal *nal;
+    GopStress g[4];
+    pthread_t writer, readers[4];
+    uint32_t cursor, old = 0;
+    int n, i, gop;
+
+    mu_assert( hevc_gop_ring_new( 0 ) == NULL );
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+    ASSERT_EQUAL( n, 7 );
+
+    // nothing to join before the first IRAP
+    ring = hevc_gop_ring_new( 10 );
+    mu_assert( ring != NULL );
+    ASSERT_EQUAL( hevc_gop_push( ring, &nalu_list[0], 0 ), 0 );
+    ASSERT_EQUAL( hevc_gop_join( ring, &cursor ), -1 );
+    ASSERT_EQUAL( hevc_gop_read( ring, &old, &nal ), 1 );
+    ASSERT_EQUAL( nal->nalu_type, HEVC_NAL_AUD );
+    hevc_gop_nal_unref( nal );
+    ASSERT_EQUAL( hevc_gop_read( ring, &old, &nal ), 0 );
+    for ( i = 1; i < n; i++ )
+        hevc_gop_push( ring, &nalu_list[i], 0 );
+
+    // a late reader starts at the AUD of the last IDR access unit
+    for ( i = 0; i < n; i++ )
+        hevc_gop_push( ring, &nalu_list[i], 1 );
+    ASSERT_EQUAL( hevc_gop_join( ring, &cursor ), 0 );
+    ASSERT_EQUAL( cursor, 7 );
+    for ( i = 0; i < n; i++ ) {
+        ASSERT_EQUAL( hevc_gop_read( ring, &cursor, &nal ), 1 );
+        ASSERT_EQUAL( nal->nalu_type, nalu_list[i].nalu_type );
+        ASSERT_EQUAL( nal->size, nalu_list[i].size );
+        mu_assert( !memcmp( nal->data, nalu_list[i].addr, nal->size ) );
+        mu_assert( nal->timestamp == 1 );
+        // the reference outlives the slot
+        if ( i == 4 ) {
+            for ( gop = 0; gop < 16; gop++ )
+                hevc_gop_push( ring, &nalu_list[1], 2 );
+            ASSERT_EQUAL( nal->nalu_type, HEVC_NAL_IDR_W_RADL );
+        }
+        hevc_gop_nal_unref( nal );
+        if ( i == 4 )
+            break;
+    }
+    // the first reader fell a whole ring behind
+    ASSERT_EQUAL( hevc_gop_read( ring, &old, &nal ), -1 );
+    // the current GOP outgrew the ring, until the next IRAP
+    ASSERT_EQUAL( hevc_gop_join( ring, &cursor ), -1 );
+    hevc_gop_push( ring, &nalu_list[5], 3 );
+    hevc_gop_push( ring, &nalu_list[0], 4 );
+    hevc_gop_push( ring, &nalu_list[4], 4 );
+    ASSERT_EQUAL( hevc_gop_join( ring, &cursor ), 0 );
+    ASSERT_EQUAL( cursor, 31 );
+    hevc_gop_ring_free( ring );
+
+    // one writer, readers joining, lagging behind and joining again
+    ring = hevc_gop_ring_new( 64 );
+    mu_assert( ring != NULL );
+    for ( i = 0; i < 4; i++ ) {
+        g[i].ring = ring;
+        g[i].count = 200000;
+        g[i].errors = g[i].joins = 0;
+    }
+    for ( i = 0; i < 4; i++ )
+        ASSERT_EQUAL( pthread_create( &readers[i], NULL, gop_stress_reader, &g[i] ), 0 );
+    ASSERT_EQUAL( pthread_create( &writer, NULL, gop_stress_writer, &g[0] ), 0 );
+    pthread_join( writer, NULL );
+    for ( i = 0; i < 4; i++ ) {
+        pthread_join( readers[i], NULL );
+        ASSERT_EQUAL( g[i].errors, 0 );
+        mu_assert( g[i].joins > 0 );
+    }
+    hevc_gop_ring_free( ring );
+
+    return NULL;
+}
+
+char *test_hevc_poc()
+{
+    static const struct { uint8_t type, tid; uint16_t lsb; int32_t poc; } pics[] = {
+        { HEVC_NAL_IDR_W_RADL, 0, 0,  0 },
+        { HEVC_NAL_TRAIL_R,    0, 6,  6 },
+        { HEVC_NAL_TRAIL_R,    0, 12, 12 },
+        { HEVC_NAL_TRAIL_R,    0, 2,  18 },     // lsb wrapped
+        { HEVC_NAL_TRAIL_N,    0, 15, 15 },     // not a reference for the MSB
+        { HEVC_NAL_TRAIL_R,    1, 14, 14 },     // neither is a sub-layer
+        { HEVC_NAL_CRA_NUT,    0, 4,  20 },
+        { HEVC_NAL_RASL_N,     0, 1,  17 },
+        { HEVC_NAL_TRAIL_R,    0, 6,  22 },
+    };
+    HEVCSPS sps;
+    HEVCSliceHeader sh;
+    HevcPocState s;
+    int i;
+
+    memset( &sps, 0, sizeof(sps) );
+    memset( &sh, 0, sizeof(sh) );
+    sps.log2_max_pic_order_cnt_lsb = 4;
+    hevc_poc_init( &s );
+    for ( i = 0; i < (int)(sizeof(pics)/sizeof(pics[0])); i++ ) {
+        sh.nal_unit_type = pics[i].type;
+        sh.temporal_id = pics[i].tid;
+        sh.pic_order_cnt_lsb = pics[i].lsb;
+        ASSERT_EQUAL( hevc_poc_compute( &s, &sps, &sh ), pics[i].poc );
+    }
+
+    // a CRA after end of sequence starts over
+    hevc_poc_eos( &s );
+    sh.nal_unit_type = HEVC_NAL_CRA_NUT;
+    sh.temporal_id = 0;
+    sh.pic_order_cnt_lsb = 4;
+    ASSERT_EQUAL( hevc_poc_compute( &s, &sps, &sh ), 4 );
+
+    return NULL;
+}
+
+static int write_media( const char *path, int copies )
+{
+    FILE *f = fopen( path, "wb" );
+    int i;
+
+    if ( !f )
+        return -1;
+    for ( i = 0; i < copies; i++ )
+        fwrite( hevc_stream, sizeof(hevc_stream), 1, f );
+    return fclose( f );
+}
+
+static int file_equal( const char *a, const char *b )
+{
+    static uint8_t buf_a[4096], buf_b[4096];
+    FILE *fa = fopen( a, "rb" ), *fb = fopen( b, "rb" );
+    size_t na = 0, nb = 0;
+
+    if ( fa ) {
+        na = fread( buf_a, 1, sizeof(buf_a), fa );
+        fclose( fa );
+    }
+    if ( fb ) {
+        nb = fread( buf_b, 1, sizeof(buf_b), fb );
+        fclose( fb );
+    }
+    return fa && fb && na == nb && !memcmp( buf_a, buf_b, na );
+}
+
+char *test_hevc_index()
+{
+    char media[] = "/tmp/hevc_index_XXXXXX", sidecar[64], fresh[64];
+    uint64_t trail = 120, size = sizeof(hevc_stream);
+    HevcIndexEntry e;
+    HevcIndex *idx;
+    FILE *f;
+    int fd;
+
+    fd = mkstemp( media );
+    mu_assert( fd >= 0 );
+    close( fd );
+    snprintf( sidecar, sizeof(sidecar), "%s.idx", media );
+    snprintf( fresh, sizeof(fresh), "%s.fresh", media );
+    ASSERT_EQUAL( hevc_stream[trail + 3], HEVC_NAL_TRAIL_R << 1 );
+
+    // IDR and TRAIL_R pictures
+    ASSERT_EQUAL( write_media( media, 2 ), 0 );
+    mu_assert( hevc_index_update( media, sidecar ) == 4 );
+    idx = hevc_index_open( sidecar );
+    mu_assert( idx != NULL );
+    mu_assert( hevc_index_count( idx ) == 4 );
+    mu_assert( hevc_index_media_size( idx ) == 2 * size );
+    ASSERT_EQUAL( hevc_index_get( idx, 0, &e ), 0 );
+    mu_assert( e.offset == 0 );
+    ASSERT_EQUAL( e.nalu_type, HEVC_NAL_IDR_W_RADL );
+    ASSERT_EQUAL( e.poc, 0 );
+    ASSERT_EQUAL( e.irap, 0 );
+    ASSERT_EQUAL( e.vps_id, 0 );
+    ASSERT_EQUAL( e.sps_id, 0 );
+    ASSERT_EQUAL( e.pps_id, 0 );
+    ASSERT_EQUAL( hevc_index_get( idx, 3, &e ), 0 );
+    mu_assert( e.offset == size + trail );
+    ASSERT_EQUAL( e.nalu_type, HEVC_NAL_TRAIL_R );
+    ASSERT_EQUAL( e.poc, 1 );
+    ASSERT_EQUAL( e.irap, 2 );
+    ASSERT_EQUAL( e.temporal_id, 0 );
+    ASSERT_EQUAL( hevc_index_get( idx, 4, &e ), -1 );
+
+    // the recording grows: same records as a full scan, appended under a reader
+    ASSERT_EQUAL( write_media( media, 3 ), 0 );
+    mu_assert( hevc_index_update( media, sidecar ) == 6 );
+    mu_assert( hevc_index_update( media, fresh ) == 6 );
+    mu_assert( file_equal( sidecar, fresh ) );
+    mu_assert( hevc_index_count( idx ) == 4 );
+    ASSERT_EQUAL( hevc_index_get( idx, 3, &e ), 0 );
+    mu_assert( e.offset == size + trail );
+    ASSERT_EQUAL( e.irap, 2 );
+    hevc_index_close( idx );
+
+    // a picture cut in its slice header waits for the rest
+    f = fopen( media, "ab" );
+    mu_assert( f != NULL );
+    fwrite( hevc_stream, 112, 1, f );
+    mu_assert( fclose( f ) == 0 );
+    ASSERT_EQUAL( hevc_stream[110], HEVC_NAL_IDR_W_RADL << 1 );
+    mu_assert( hevc_index_update( media, sidecar ) == 6 );
+    idx = hevc_index_open( sidecar );
+    mu_assert( idx != NULL );
+    mu_assert( hevc_index_media_size( idx ) == 3 * size );
+    hevc_index_close( idx );
+    ASSERT_EQUAL( write_media( media, 4 ), 0 );
+    mu_assert( hevc_index_update( media, sidecar ) == 8 );
+    mu_assert( hevc_index_update( media, fresh ) == 8 );
+    mu_assert( file_equal( sidecar, fresh ) );
+
+    idx = hevc_index_open( sidecar );
+    mu_assert( idx != NULL );
+    mu_assert( hevc_index_find( idx, 0 ) == 0 );
+    mu_assert( hevc_index_find( idx, trail - 1 ) == 0 );
+    mu_assert( hevc_index_find( idx, trail ) == 1 );
+    mu_assert( hevc_index_find( idx, 2 * size ) == 4 );
+    mu_assert( hevc_index_find( idx, UINT64_MAX ) == 7 );
+    mu_assert( hevc_index_seek( idx, 5 ) == 4 );
+    mu_assert( hevc_index_seek( idx, 1 ) == 0 );
+    mu_assert( hevc_index_seek( idx, 8 ) == -1 );
+    hevc_index_close( idx );
+
+    // a recording replaced by a shorter one is indexed again
+    ASSERT_EQUAL( write_media( media, 1 ), 0 );
+    mu_assert( hevc_index_update( media, sidecar ) == 2 );
+
+    // a recording cut in the middle of a GOP: nothing to decode before the IDR
+    f = fopen( media, "wb" );
+    mu_assert( f != NULL );
+    fwrite( hevc_stream + trail, size - trail, 1, f );
+    fwrite( hevc_stream, size, 1, f );
+    mu_assert( fclose( f ) == 0 );
+    unlink( sidecar );
+    mu_assert( hevc_index_update( media, sidecar ) == 3 );
+    idx = hevc_index_open( sidecar );
+    mu_assert( idx != NULL );
+    ASSERT_EQUAL( hevc_index_get( idx, 0, &e ), 0 );
+    ASSERT_EQUAL( e.nalu_type, HEVC_NAL_TRAIL_R );
+    mu_assert( e.irap == HEVC_INDEX_NO_IRAP );
+    mu_assert( hevc_index_seek( idx, 0 ) == -1 );
+    mu_assert( hevc_index_seek( idx, 1 ) == 1 );
+    mu_assert( hevc_index_seek( idx, 2 ) == 1 );
+    hevc_index_close( idx );
+
+    unlink( media );
+    unlink( sidecar );
+    unlink( fresh );
+    return NULL;
+}
+
+char *test_hevc_file_source()
+{
+    char path[] = "/tmp/hevc_file_XXXXXX";
+    NalUnit nalu_list[8], nalu;
+    HevcFileSource *src;
+    NalUnitList list;
+    const uint8_t *first = NULL, *p;
+    uint64_t offset, expect;
+    int fd, n, i, count, copies = 300;
+
+    n = hevc_parse_nalu( hevc_stream, sizeof(hevc_stream), nalu_list, 8 );
+    ASSERT_EQUAL( n, 7 );
+    fd = mkstemp( path );
+    mu_assert( fd >= 0 );
+    close( fd );
+    ASSERT_EQUAL( write_media( path, copies ), 0 );
+    mu_assert( hevc_file_open( "/nonexistent/clip.265", 0 ) == NULL );
+
+    // one page windows, most of the file is dropped behind the cursor
+    src = hevc_file_open( path, 1 );
+    mu_assert( src != NULL );
+    mu_assert( hevc_file_size( src ) == copies * sizeof(hevc_stream) );
+    for ( count = 0; hevc_file_next_nalu( src, &nalu, &offset ); count++ ) {
+        int k = count % n;
+
+        // every copy is framed like the fixture
+        p = hevc_find_startcode( hevc_stream, hevc_stream + sizeof(hevc_stream) );
+        for ( i = 0; i < k; i++ )
+            hevc_next_nalu( &p, hevc_stream + sizeof(hevc_stream), &nalu_list[7] );
+        expect = (uint64_t)(count / n) * sizeof(hevc_stream) + (p - hevc_stream);
+        mu_assert( offset == expect );
+        ASSERT_EQUAL( nalu.nalu_type, nalu_list[k].nalu_type );
+        ASSERT_EQUAL( nalu.size, nalu_list[k].size );
+        mu_assert( nalu.addr == hevc_file_data( src ) + (count / n) * sizeof(hevc_stream) + (nalu_list[k].addr - hevc_stream) );
+        if ( !first )
+            first = nalu.addr;
+    }
+    ASSERT_EQUAL( count, n * copies );
+    // still readable after MADV_DONTNEED
+    mu_assert( !memcmp( first, nalu_list[0].addr, nalu_list[0].size ) );
+
+    // spans end on NAL boundaries, whatever their size
+    hevc_nalu_list_init( &list );
+    for ( i = 1; i < 200; i += 37 ) {
+        ASSERT_EQUAL( hevc_file_seek( src, 0 ), 0 );
+        count = 0;
+        while ( (n = hevc_file_parse( src, &list, i )) > 0 ) {
+            int k, j;
+
+            for ( k = 0; k < n; k++, count++ ) {
+                j = count % 7;
+                ASSERT_EQUAL( list.nalu[k].nalu_type, nalu_list[j].nalu_type );
+                ASSERT_EQUAL( list.nalu[k].size, nalu_list[j].size );
+            }
+        }
+        ASSERT_EQUAL( n, 0 );
+        ASSERT_EQUAL( count, 7 * copies );
+    }
+    ASSERT_EQUAL( hevc_file_seek( src, sizeof(hevc_stream) * (copies - 1) + 4 ), 0 );
+    ASSERT_EQUAL( hevc_file_next_nalu( src, &nalu, NULL ), 1 );
+    ASSERT_EQUAL( nalu.nalu_type, HEVC_NAL_VPS );
+    hevc_nalu_list_free( &list );
+    hevc_file_close( src );
+
+    unlink( path );
+    return NULL;
+}
+
+static int nalu_list_equal( const NalUnitList *a, const NalUnitList *b )
+{
+    int i;
+
+    if ( a->count != b->count )
+        return 0;
+    for ( i = 0; i < a->count; i++ )
+        if ( a->nalu[i].addr != b->nalu[i].addr || a->nalu[i].size != b->nalu[i].size ||
+             a->nalu[i].nalu_type != b->nalu[i].nalu_type )
+            return 0;
+    return 1;
+}
+
+char *test_hevc_parse_mt()
+{
+    static uint8_t buf[64 * 1024];
+    NalUnitList serial, mt;
+    uint32_t seed = 1;
+    int size, i, threads;
+
+    hevc_nalu_list_init( &serial );
+    hevc_nalu_list_init( &mt );
+
+    // the fixture repeated, then bytes mostly 0 and 1: start codes, 4 byte
+    // ones and zero runs everywhere, chunk borders fall inside all of them
+    for ( size = 0; size + (int)sizeof(hevc_stream) <= (int)sizeof(buf) / 2; size += sizeof(hevc_stream) )
+        memcpy( buf + size, hevc_stream, sizeof(hevc_stream) );
+    for ( ; size < (int)sizeof(buf); size++ ) {
+        seed = seed * 1103515245 + 12345;
+        buf[size] = (seed >> 16) % 5 < 3 ? 0 : (seed >> 16) % 5 == 3 ? 1 : (seed >> 24);
+    }
+
+    ASSERT_EQUAL( hevc_nalu_list_parse_mt( &mt, buf, 0, 4 ), 0 );
+    for ( i = 0; i < 4; i++ ) {
+        // ending in a start code, in a zero run, mid NAL
+        int len = i == 0 ? sizeof(buf) : i == 1 ? 3 * (int)sizeof(hevc_stream) + 4 :
+                  i == 2 ? 3 * (int)sizeof(hevc_stream) + 2 : sizeof(buf) - 7;
+
+        mu_assert( hevc_nalu_list_parse( &serial, buf, len ) > 0 );
+        for ( threads = 0; threads <= 64; threads++ ) {
+            ASSERT_EQUAL( hevc_nalu_list_parse_mt( &mt, buf, len, threads ), serial.count );
+            mu_assert( nalu_list_equal( &serial, &mt ) );
+        }
+    }
+
+    hevc_nalu_list_free( &serial );
+    hevc_nalu_list_free( &mt );
+    return NULL;
+}
+
+#define ENGINE_STREAMS 64
+#define ENGINE_COPIES  50
+
+typedef struct EngineResult {
+    atomic_int busy;    // set while a callback of the stream runs
+    int nalus;
+    int configs;
+    int errors;
+} EngineResult;
+
+static const uint8_t engine_types[7] = { 35, 32, 33, 34, 19, 1, 1 };
+
+static void on_engine_nalu( const NalUnit *nalu, void *opaque )
+{
+    EngineResult *r = opaque;
+
+    if ( atomic_exchange( &r->busy, 1 ) )
+        r->errors++;
+    if ( nalu->nalu_type != engine_types[r->nalus % 7] )
+        r->errors++;
+    r->nalus++;
+    atomic_store( &r->busy, 0 );
+}
+
+static void on_engine_config( const HEVCDecoderConfigurationRecord *config, void *opaque )
+{
+    EngineResult *r = opaque;
+
+    if ( config->numOfArrays != 3 )
+        r->errors++;
+    r->configs++;
+}
+
+typedef struct EngineFeeder {
+    HevcStream **streams;
+    int count;
+    uint32_t seed;
+} EngineFeeder;
+
+/* the fixture, cut at random and interleaved over the streams */
+static void *engine_feed_thread( void *arg )
+{
+    EngineFeeder *f = arg;
+    int offset[ENGINE_STREAMS] = { 0 }, copies[ENGINE_STREAMS] = { 0 }, left = f->count, i;
+
+    while ( left ) {
+        for ( i = 0; i < f->count; i++ ) {
+            int n;
+
+            if ( copies[i] == ENGINE_COPIES )
+                continue;
+            f->seed = f->seed * 1103515245 + 12345;
+            n = 1 + (f->seed >> 16) % 48;
+            if ( n > (int)sizeof(hevc_stream) - offset[i] )
+                n = sizeof(hevc_stream) - offset[i];
+            hevc_engine_feed( f->streams[i], hevc_stream + offset[i], n );
+            offset[i] += n;
+            if ( offset[i] == sizeof(hevc_stream) ) {
+                offset[i] = 0;
+                if ( ++copies[i] == ENGINE_COPIES )
+                    left--;
+            }
+        }
+    }
+    return NULL;
+}
+
+char *test_hevc_engine()
+{
+    static EngineResult results[ENGINE_STREAMS];
+    HevcStream *streams[ENGINE_STREAMS];
+    EngineFeeder feeders[2];
+    pthread_t threads[2];
+    HevcEngine *e;
+    int i;
+
+    e = hevc_engine_new( 4 );
+    mu_assert( e != NULL );
+    ASSERT_EQUAL( hevc_engine_threads( e ), 4 );
+    mu_assert( hevc_engine_add_stream( e, NULL, NULL, NULL ) == NULL );
+    for ( i = 0; i < ENGINE_STREAMS; i++ ) {
+        memset( &results[i], 0, sizeof(results[i]) );
+        streams[i] = hevc_engine_add_stream( e, on_engine_nalu, on_engine_config, &results[i] );
+        mu_assert( streams[i] != NULL );
+    }
+
+    // one feeding thread per half of the streams
+    for ( i = 0; i < 2; i++ ) {
+        feeders[i].streams = streams + i * ENGINE_STREAMS / 2;
+        feeders[i].count = ENGINE_STREAMS / 2;
+        feeders[i].seed = i + 1;
+        ASSERT_EQUAL( pthread_create( &threads[i], NULL, engine_feed_thread, &feeders[i] ), 0 );
+    }
+    for ( i = 0; i < 2; i++ )
+        pthread_join( threads[i], NULL );
+
+    // everything but the last NAL of each stream
+    hevc_engine_wait( e );
+    for ( i = 0; i < ENGINE_STREAMS; i++ ) {
+        ASSERT_EQUAL( results[i].nalus, 7 * ENGINE_COPIES - 1 );
+        ASSERT_EQUAL( results[i].configs, 1 );
+    }
+
+    ASSERT_EQUAL( hevc_engine_flush( streams[0] ), 0 );
+    hevc_engine_wait( e );
+    ASSERT_EQUAL( results[0].nalus, 7 * ENGINE_COPIES );
+    for ( i = 1; i < ENGINE_STREAMS / 2; i++ )
+        ASSERT_EQUAL( hevc_engine_remove_stream( streams[i] ), 0 );
+    hevc_engine_wait( e );
+    for ( i = 0; i < ENGINE_STREAMS; i++ ) {
+        ASSERT_EQUAL( results[i].nalus, 7 * ENGINE_COPIES - (i >= ENGINE_STREAMS / 2) );
+        ASSERT_EQUAL( results[i].errors, 0 );
+    }
+
+    // the rest goes with the engine
+    hevc_engine_free( e );
+    return NULL;
+}
+
+/* picture type and TemporalId per access unit, decoding order */
+static const uint8_t sublayer_aus[][2] = {
+    { HEVC_NAL_IDR_W_RADL, 0 }, { HEVC_NAL_TRAIL_R, 0 }, { HEVC_NAL_TSA_R, 1 }, { HEVC_NAL_TSA_N, 2 },
+    { HEVC_NAL_TRAIL_R, 0 }, { HEVC_NAL_STSA_R, 1 }, { HEVC_NAL_TRAIL_N, 2 }, { HEVC_NAL_CRA_NUT, 0 },
+    { HEVC_NAL_RASL_N, 1 }, { HEVC_NAL_TRAIL_R, 0 },
+};
+
+#define SUBLAYER_AUS (int)(sizeof(sublayer_aus)/sizeof(sublayer_aus[0]))
+
+/* AUD, prefix SEI and one slice per AU, parameter sets before the IDR */
+static void sublayer_stream( uint8_t *buf, NalUnitList *list )
+{
+    int i, j, n = 0;
+
+    for ( i = 0; i < SUBLAYER_AUS; i++ ) {
+        int types[6] = { HEVC_NAL_AUD, HEVC_NAL_SEI_PREFIX, sublayer_aus[i][0] }, count = 3;
+
+        if ( !i ) {
+            types[1] = HEVC_NAL_VPS;
+            types[2] = HEVC_NAL_SPS;
+            types[3] = HEVC_NAL_PPS;
+            types[4] = HEVC_NAL_SEI_PREFIX;
+            types[5] = sublayer_aus[i][0];
+            count = 6;
+        }
+        for ( j = 0; j < count; j++, n++ ) {
+            uint8_t *p = buf + 3 * n;
+            int ps = types[j] >= HEVC_NAL_VPS && types[j] <= HEVC_NAL_PPS;
+
+            p[0] = types[j] << 1;
+            p[1] = (ps ? 0 : sublayer_aus[i][1]) + 1;
+            p[2] = 0x80;    // first_slice_segment_in_pic_flag
+            list->nalu[n].nalu_type = types[j];
+            list->nalu[n].addr = p;
+            list->nalu[n].size = 3;
+        }
+    }
+    list->count = n;
+}
+
+/* the access units of out, as a bit mask of sublayer_aus indexes */
+static int sublayer_kept( const NalUnitList *out, const uint8_t *buf )
+{
+    int i, mask = 0, au = -1;
+
+    for ( i = 0; i < out->count; i++ ) {
+        // zero copy: the entries point into the stream
+        int n = (out->nalu[i].addr - buf) / 3;
+
+        if ( HEVC_NAL_IS_VCL( out->nalu[i].nalu_type ) ) {
+            au = n <= 5 ? 0 : (n - 6) / 3 + 1;
+            mask |= 1 << au;
+        }
+    }
+    return mask;
+}
+
+char *test_hevc_sublayer()
+{
+    static uint8_t buf[3 * 64], cra[3 * 8];
+    NalUnit in_nalu[64], cra_nalu[8];
+    NalUnitList in = { in_nalu, 0, 64 }, out, part;
+    HevcSubLayerFilter f;
+    int i, tid;
+
+    sublayer_stream( buf, &in );
+    hevc_nalu_list_init( &out );
+
+    // a fixed target: every NAL unit up to its TemporalId
+    for ( tid = 0; tid <= 2; tid++ ) {
+        int expect = 0;
+
+        for ( i = 0; i < in.count; i++ )
+            expect += (in.nalu[i].addr[1] & 7) - 1 <= tid;
+        hevc_sublayer_init( &f, tid );
+        ASSERT_EQUAL( hevc_sublayer_filter( &f, &out, &in ), expect );
+        for ( i = 0; i < out.count; i++ )
+            mu_assert( (out.nalu[i].addr[1] & 7) - 1 <= tid );
+    }
+    ASSERT_EQUAL( out.count, in.count );
+    ASSERT_EQUAL( sublayer_kept( &out, buf ), 0x3ff );
+
+    // IRAP only: the parameter sets and the IDR/CRA access units, an EOS
+    // ending the sequence ahead of the CRA
+    hevc_sublayer_init( &f, HEVC_SUBLAYER_IRAP_ONLY );
+    ASSERT_EQUAL( hevc_sublayer_filter( &f, &out, &in ), 10 );
+    ASSERT_EQUAL( sublayer_kept( &out, buf ), 0x81 );
+    ASSERT_EQUAL( out.nalu[6].nalu_type, HEVC_NAL_EOS_NUT );
+    ASSERT_EQUAL( out.nalu[6].size, 2 );
+    ASSERT_EQUAL( out.nalu[6].addr[0], HEVC_NAL_EOS_NUT << 1 );
+    ASSERT_EQUAL( out.nalu[7].nalu_type, HEVC_NAL_AUD );
+
+    // CRA only: every CRA after the first starts a sequence of its own, the
+    // same in place, where out outgrows in
+    for ( i = 0; i < 8; i++ ) {
+        uint8_t *p = cra + 3 * i;
+
+        cra_nalu[i].nalu_type = i & 1 ? HEVC_NAL_CRA_NUT : HEVC_NAL_AUD;
+        cra_nalu[i].addr = p;
+        cra_nalu[i].size = 3;
+        p[0] = cra_nalu[i].nalu_type << 1;
+        p[1] = 1;
+        p[2] = 0x80;
+    }
+    part.nalu = cra_nalu;
+    part.count = part.capacity = 8;
+    hevc_sublayer_init( &f, HEVC_SUBLAYER_IRAP_ONLY );
+    ASSERT_EQUAL( hevc_sublayer_filter( &f, &out, &part ), 11 );
+    part.nalu = malloc( 8 * sizeof(NalUnit) );
+    mu_assert( part.nalu != NULL );
+    memcpy( part.nalu, cra_nalu, 8 * sizeof(NalUnit) );
+    hevc_sublayer_init( &f, HEVC_SUBLAYER_IRAP_ONLY );
+    ASSERT_EQUAL( hevc_sublayer_filter( &f, &part, &part ), 11 );
+    for ( i = 0; i < 11; i++ ) {
+        int type = i < 2 ? cra_nalu[i].nalu_type :
+                   (i - 2) % 3 == 0 ? HEVC_NAL_EOS_NUT : cra_nalu[i - 1 - (i - 2) / 3].nalu_type;
+
+        ASSERT_EQUAL( out.nalu[i].nalu_type, type );
+        mu_assert( part.nalu[i].addr == out.nalu[i].addr );
+    }
+    hevc_nalu_list_free( &part );
+
+    // up from 0 after AU 1: TSA at AU 2 switches straight to 2
+    part = in;
+    part.count = 9;
+    hevc_sublayer_init( &f, 0 );
+    hevc_sublayer_filter( &f, &out, &part );
+    ASSERT_EQUAL( sublayer_kept( &out, buf ), 0x3 );
+    hevc_sublayer_set_target( &f, 2 );
+    part.nalu = in.nalu + 9;
+    part.count = in.count - 9;
+    hevc_sublayer_filter( &f, &out, &part );
+    ASSERT_EQUAL( sublayer_kept( &out, buf ), 0x3fc );
+
+    // up after AU 3: the STSA at AU 5 reaches 1 only, the CRA 2
+    part = in;
+    part.count = 15;
+    hevc_sublayer_init( &f, 0 );
+    hevc_sublayer_filter( &f, &out, &part );
+    ASSERT_EQUAL( sublayer_kept( &out, buf ), 0x3 );
+    hevc_sublayer_set_target( &f, 2 );
+    part.nalu = in.nalu + 15;
+    part.count = in.count - 15;
+    hevc_sublayer_filter( &f, &out, &part );
+    ASSERT_EQUAL( sublayer_kept( &out, buf ), 0x3b0 );
+
+    // out of IRAP only at the CRA, without its RASL picture, in place: the
+    // EOS makes out longer than in
+    part = in;
+    part.count = 24;
+    hevc_sublayer_init( &f, HEVC_SUBLAYER_IRAP_ONLY );
+    hevc_sublayer_filter( &f, &out, &part );
+    ASSERT_EQUAL( sublayer_kept( &out, buf ), 0x1 );
+    hevc_sublayer_set_target( &f, 2 );
+    part.nalu = in.nalu + 24;
+    part.count = in.count - 24;
+    part.capacity = in.capacity - 24;
+    ASSERT_EQUAL( hevc_sublayer_filter( &f, &part, &part ), 7 );
+    ASSERT_EQUAL( part.nalu[0].nalu_type, HEVC_NAL_EOS_NUT );
+    ASSERT_EQUAL( part.nalu[1].nalu_type, HEVC_NAL_AUD );
+    ASSERT_EQUAL( sublayer_kept( &part, buf ), 0x280 );
+
+    hevc_nalu_list_free( &out );
+    return NULL;
+}
+
+char *test_hevc_psfilter()
+{
+    static uint8_t buf[4 * sizeof(hevc_stream)];
+    // sps_max_sub_layers_minus1 of 7
+    static const uint8_t bad_sps[] = { 0x42, 0x01, 0xff, 0xff, 0xff, 0xff };
+    uint8_t sps[128];
+    const NalUnit *copy;
+    NalUnit bad[8];
+    NalUnitList in, out, part;
+    HEVCParamSets ps;
+    HevcSpsPatch patch;
+    HevcPsFilter f;
+    size_t ps_size;
+    int i, n;
+
+    for ( i = 0; i < 4; i++ )
+        memcpy( buf + i * sizeof(hevc_stream), hevc_stream, sizeof(hevc_stream) );
+    hevc_nalu_list_init( &in );
+    hevc_nalu_list_init( &out );
+    ASSERT_EQUAL( hevc_nalu_list_parse( &in, buf, sizeof(buf) ), 28 );
+    ps_size = in.nalu[1].size + in.nalu[2].size + in.nalu[3].size;
+
+    // the repeats of the first three copies go
+    hevc_psfilter_init( &f );
+    part = in;
+    part.count = 21;
+    ASSERT_EQUAL( hevc_psfilter_run( &f, &out, &part ), 15 );
+    for ( i = 7; i < out.count; i++ )
+        mu_assert( out.nalu[i].nalu_type < HEVC_NAL_VPS || out.nalu[i].nalu_type > HEVC_NAL_PPS );
+    mu_assert( f.bytes_dropped == 2 * ps_size );
+    ASSERT_EQUAL( hevc_psfilter_run( &f, &out, &out ), -1 );
+
+    // a new consumer: the IDR of the last copy gets them back, after the AUD
+    hevc_psfilter_request( &f );
+    part.nalu = in.nalu + 21;
+    part.count = 7;
+    ASSERT_EQUAL( hevc_psfilter_run( &f, &out, &part ), 7 );
+    ASSERT_EQUAL( out.nalu[0].nalu_type, HEVC_NAL_AUD );
+    for ( i = 1; i < 4; i++ ) {
+        ASSERT_EQUAL( out.nalu[i].nalu_type, part.nalu[i].nalu_type );
+        ASSERT_EQUAL( out.nalu[i].size, part.nalu[i].size );
+        mu_assert( out.nalu[i].addr != part.nalu[i].addr );
+        mu_assert( !memcmp( out.nalu[i].addr, part.nalu[i].addr, out.nalu[i].size ) );
+    }
+    ASSERT_EQUAL( out.nalu[4].nalu_type, HEVC_NAL_IDR_W_RADL );
+    mu_assert( f.bytes_injected == ps_size );
+
+    // a changed SPS goes out with the unchanged PPS, then both are repeats
+    hevc_sps_patch_init( &patch );
+    patch.num_units_in_tick = 1;
+    patch.time_scale = 25;
+    n = hevc_rewrite_sps( in.nalu[9].addr, in.nalu[9].size, &patch, sps, sizeof(sps) );
+    mu_assert( n > 0 );
+    in.nalu[9].addr = sps;
+    in.nalu[9].size = n;
+    in.nalu[16].addr = sps;
+    in.nalu[16].size = n;
+    part.nalu = in.nalu + 7;
+    part.count = 14;
+    ASSERT_EQUAL( hevc_psfilter_run( &f, &out, &part ), 10 );
+    copy = out.nalu;
+    ASSERT_EQUAL( copy[1].nalu_type, HEVC_NAL_SPS );
+    mu_assert( copy[1].addr == sps );
+    ASSERT_EQUAL( copy[2].nalu_type, HEVC_NAL_PPS );
+    ASSERT_EQUAL( copy[6].nalu_type, HEVC_NAL_AUD );
+    ASSERT_EQUAL( copy[7].nalu_type, HEVC_NAL_IDR_W_RADL );
+
+    // an SPS the parser rejects is never stored: in a requested IRAP access
+    // unit it goes through, ahead of the injected sets
+    memcpy( bad, in.nalu + 21, 4 * sizeof(NalUnit) );
+    bad[4].nalu_type = HEVC_NAL_SPS;
+    bad[4].addr = bad_sps;
+    bad[4].size = sizeof(bad_sps);
+    memcpy( bad + 5, in.nalu + 25, 3 * sizeof(NalUnit) );
+    hevc_ps_init( &ps );
+    ASSERT_EQUAL( hevc_ps_parse( &ps, &bad[4] ), -1 );
+    hevc_ps_free( &ps );
+    hevc_psfilter_request( &f );
+    part.nalu = bad;
+    part.count = 8;
+    ASSERT_EQUAL( hevc_psfilter_run( &f, &out, &part ), 8 );
+    ASSERT_EQUAL( out.nalu[0].nalu_type, HEVC_NAL_AUD );
+    mu_assert( out.nalu[1].addr == bad_sps );
+    for ( i = 2; i < 5; i++ )
+        ASSERT_EQUAL( out.nalu[i].nalu_type, bad[i - 1].nalu_type );
+    ASSERT_EQUAL( out.nalu[5].nalu_type, HEVC_NAL_IDR_W_RADL );
+
+    hevc_psfilter_free( &f );
+    hevc_nalu_list_free( &in );
+    hevc_nalu_list_free( &out );
+    return NULL;
+}
+
+static void sei_header( bw_t *bw, int type, int size )
+{
+    for ( ; type >= 255; type -= 255 )
+        bw_write_u( bw, 8, 0xff );
+    bw_write_u( bw, 8, type );
+    for ( ; size >= 255; size -= 255 )
+        bw_write_u( bw, 8, 0xff );
+    bw_write_u( bw, 8, size );
+}
+
+/*
+ * A prefix SEI with a reserved type 300 and an unregistered user data
+ * message both 255 bytes of mostly zeros (the size ends in a 0 byte, so
+ * the first EPB of the payload counts a zero of the header), a time code,
+ * HDR mastering display (an EPB in min_luminance) and content light level.
+ */
+static int write_prefix_sei( uint8_t *buf, int size )
+{
+    static const uint16_t md[8] = { 13250, 34500, 7500, 3000, 34000, 16000, 15635, 16450 };
+    bw_t bw;
+    int i;
+
+    bw_init_nal( &bw, buf, size );
+    bw_write_u( &bw, 16, 0x4e01 );
+    sei_header( &bw, 300, 255 );
+    for ( i = 0; i < 255; i++ )
+        bw_write_u( &bw, 8, 0 );
+    sei_header( &bw, HEVC_SEI_USER_DATA_UNREGISTERED, 255 );
+    for ( i = 0; i < 255; i++ )
+        bw_write_u( &bw, 8, i < 16 ? i * 7 : 0 );
+    sei_header( &bw, HEVC_SEI_TIME_CODE, 6 );
+    bw_write_u( &bw, 2, 1 );            // num_clock_ts
+    bw_write_u( &bw, 10, 0x204 );       // clock timestamp, counting_type 0, full timestamp
+    bw_write_u( &bw, 9, 12 );
+    bw_write_u( &bw, 6, 34 );
+    bw_write_u( &bw, 6, 56 );
+    bw_write_u( &bw, 5, 7 );
+    bw_write_u( &bw, 5, 5 );            // time_offset_length
+    bw_write_u( &bw, 5, 0x1d );         // -3
+    sei_header( &bw, HEVC_SEI_MASTERING_DISPLAY, 24 );
+    for ( i = 0; i < 8; i++ )
+        bw_write_u( &bw, 16, md[i] );
+    bw_write_u( &bw, 32, 10000000 );
+    bw_write_u( &bw, 32, 1 );
+    sei_header( &bw, HEVC_SEI_CONTENT_LIGHT_LEVEL, 4 );
+    bw_write_u( &bw, 16, 1000 );
+    bw_write_u( &bw, 16, 400 );
+    bw_write_trailing_bits( &bw );
+    return bw_flush( &bw );
+}
+
+char *test_hevc_sei()
+{
+    static const int types[5] = { 300, 5, 136, 137, 144 };
+    uint8_t buf[1024], payload[255];
+    NalUnit nalu = { HEVC_NAL_SEI_PREFIX, buf, 0 };
+    HevcSeiReader r;
+    HevcSeiMessage m;
+    int i;
+
+    nalu.size = write_prefix_sei( buf, sizeof(buf) );
+    mu_assert( nalu.size > 2 * 255 );
+
+    // nothing registered: spans only
+    hevc_sei_reader_init( &r );
+    ASSERT_EQUAL( hevc_sei_start( &r, &nalu ), 0 );
+    for ( i = 0; i < 5; i++ ) {
+        ASSERT_EQUAL( hevc_sei_next( &r, &m ), 1 );
+        ASSERT_EQUAL( m.type, types[i] );
+        ASSERT_EQUAL( m.decoded, 0 );
+        mu_assert( m.data > buf && m.data + m.data_size <= buf + nalu.size );
+        ASSERT_EQUAL( m.epb, (m.data_size > m.size) );
+        if ( i < 2 ) {
+            ASSERT_EQUAL( m.size, 255 );
+            ASSERT_EQUAL( m.zeros, 1 );
+            mu_assert( m.epb );
+            ASSERT_EQUAL( hevc_sei_copy( &m, payload ), 255 );
+            ASSERT_EQUAL( payload[i ? 15 : 0], (i ? 105 : 0) );
+            ASSERT_EQUAL( payload[254], 0 );
+        }
+    }
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 0 );
+
+    // registered ones decoded too
+    ASSERT_EQUAL( hevc_sei_register( &r, HEVC_SEI_PIC_TIMING ), -1 );
+    ASSERT_EQUAL( hevc_sei_register( &r, HEVC_SEI_USER_DATA_UNREGISTERED ), 0 );
+    ASSERT_EQUAL( hevc_sei_register( &r, HEVC_SEI_TIME_CODE ), 0 );
+    ASSERT_EQUAL( hevc_sei_register( &r, HEVC_SEI_MASTERING_DISPLAY ), 0 );
+    ASSERT_EQUAL( hevc_sei_register( &r, HEVC_SEI_CONTENT_LIGHT_LEVEL ), 0 );
+    hevc_sei_start( &r, &nalu );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 1 );
+    ASSERT_EQUAL( m.decoded, 0 );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 1 );
+    ASSERT_EQUAL( m.decoded, 1 );
+    for ( i = 0; i < 16; i++ )
+        ASSERT_EQUAL( m.u.user_data.uuid[i], i * 7 );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 1 );
+    ASSERT_EQUAL( m.decoded, 1 );
+    ASSERT_EQUAL( m.u.time_code.num_clock_ts, 1 );
+    ASSERT_EQUAL( m.u.time_code.ts[0].clock_timestamp_flag, 1 );
+    ASSERT_EQUAL( m.u.time_code.ts[0].full_timestamp_flag, 1 );
+    ASSERT_EQUAL( m.u.time_code.ts[0].n_frames, 12 );
+    ASSERT_EQUAL( m.u.time_code.ts[0].seconds, 34 );
+    ASSERT_EQUAL( m.u.time_code.ts[0].minutes, 56 );
+    ASSERT_EQUAL( m.u.time_code.ts[0].hours, 7 );
+    ASSERT_EQUAL( m.u.time_code.ts[0].time_offset, -3 );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 1 );
+    ASSERT_EQUAL( m.decoded, 1 );
+    mu_assert( m.epb );
+    ASSERT_EQUAL( m.u.mastering_display.display_primaries_x[0], 13250 );
+    ASSERT_EQUAL( m.u.mastering_display.display_primaries_y[2], 16000 );
+    ASSERT_EQUAL( m.u.mastering_display.white_point_y, 16450 );
+    ASSERT_EQUAL( m.u.mastering_display.max_luminance, 10000000 );
+    ASSERT_EQUAL( m.u.mastering_display.min_luminance, 1 );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 1 );
+    ASSERT_EQUAL( m.u.content_light.max_content_light_level, 1000 );
+    ASSERT_EQUAL( m.u.content_light.max_pic_average_light_level, 400 );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 0 );
+
+    // cut short inside the user data
+    nalu.size = 500;
+    hevc_sei_start( &r, &nalu );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 1 );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), -1 );
+    nalu.nalu_type = HEVC_NAL_PPS;
+    ASSERT_EQUAL( hevc_sei_start( &r, &nalu ), -1 );
+    return NULL;
+}
+
+char *test_hevc_sei_picture_hash()
+{
+    uint8_t buf[64];
+    NalUnit nalu = { HEVC_NAL_SEI_SUFFIX, buf, 0 };
+    HevcSeiReader r;
+    HevcSeiMessage m;
+    bw_t bw;
+    int c, i;
+
+    bw_init_nal( &bw, buf, sizeof(buf) );
+    bw_write_u( &bw, 16, 0x5001 );
+    sei_header( &bw, HEVC_SEI_DECODED_PICTURE_HASH, 49 );
+    bw_write_u( &bw, 8, 0 );            // MD5
+    for ( i = 0; i < 48; i++ )
+        bw_write_u( &bw, 8, i < 16 ? 0 : i );
+    bw_write_trailing_bits( &bw );
+    nalu.size = bw_flush( &bw );
+
+    hevc_sei_reader_init( &r );
+    hevc_sei_register( &r, HEVC_SEI_DECODED_PICTURE_HASH );
+    ASSERT_EQUAL( hevc_sei_start( &r, &nalu ), 0 );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 1 );
+    ASSERT_EQUAL( m.decoded, 1 );
+    ASSERT_EQUAL( m.u.picture_hash.hash_type, 0 );
+    ASSERT_EQUAL( m.u.picture_hash.components, 3 );
+    for ( c = 0; c < 3; c++ )
+        for ( i = 0; i < 16; i++ )
+            ASSERT_EQUAL( m.u.picture_hash.md5[c][i], (c ? c * 16 + i : 0) );
+    ASSERT_EQUAL( hevc_sei_next( &r, &m ), 0 );
+    return NULL;
+}
+
+/* the first slice segment of a picture against the fixture parameter sets:
+ * PPS 0, 8 bit POC LSB and the first of the two RPS of the SPS */
+static int write_pts_slice( uint8_t *buf, int size, int type, int poc_lsb )
+{
+    bw_t bw;
+
+    bw_init_nal( &bw, buf, size );
+    bw_write_u( &bw, 16, (type << 9) | 1 );
+    bw_write_u1( &bw, 1 );              // first_slice_segment_in_pic_flag
+    if ( HEVC_NAL_IS_IRAP( type ) )
+        bw_write_u1( &bw, 0 );
+    bw_write_ue( &bw, 0 );
+    if ( type == HEVC_NAL_IDR_W_RADL || type == HEVC_NAL_IDR_N_LP ) {
+        bw_write_ue( &bw, HEVC_SLICE_I );
+    } else {
+        bw_write_ue( &bw, HEVC_SLICE_P );
+        bw_write_u( &bw, 8, poc_lsb );
+        bw_write_u( &bw, 2, 0x2 );      // the RPS of the SPS, index 0
+    }
+    bw_write_u( &bw, 8, 0xa5 );
+    bw_write_trailing_bits( &bw );
+    return bw_flush( &bw );
+}
+
+static void on_timestamp( const HevcTimestamp *ts, void *opaque )
+{
+    HevcTimestamp *out = opaque;
+
+    out[ts->index] = *ts;
+    out[ts->index].index++;     // 0 is not handed out
+}
+
+char *test_hevc_pts()
+{
+    static const int pocs[7] = { 0, 2, 1, 4, 3, 6, 5 };
+    uint8_t buf[128];
+    HevcTimestamp ts[16] = { { 0 } };
+    NalUnitList list;
+    NalUnit nalu;
+    HevcPtsGen *g = hevc_pts_new( 60000, on_timestamp, ts );
+    int i;
+
+    mu_assert( g != NULL );
+    hevc_nalu_list_init( &list );
+    hevc_nalu_list_parse( &list, hevc_stream, sizeof(hevc_stream) );
+    for ( i = 0; i < 4; i++ )
+        ASSERT_EQUAL( hevc_pts_push( g, &list.nalu[i] ), 0 );
+
+    // reorder 1, a picture lasts 1001/60000: one picture of delay
+    nalu.addr = buf;
+    for ( i = 0; i < 7; i++ ) {
+        nalu.nalu_type = i ? HEVC_NAL_TRAIL_R : HEVC_NAL_IDR_W_RADL;
+        nalu.size = write_pts_slice( buf, sizeof(buf), nalu.nalu_type, pocs[i] );
+        ASSERT_EQUAL( hevc_pts_push( g, &nalu ), 1 );
+        // in decoding order, a reordered picture waits for the one before it
+        mu_assert( !ts[i].index && (i < 2 || ts[i-2].index == (uint64_t)i - 1) );
+    }
+    mu_assert( ts[4].index && !ts[5].index );
+    ASSERT_EQUAL( hevc_pts_push( g, &list.nalu[6] ), 0 );
+    for ( i = 0; i < 5; i++ ) {
+        mu_assert( ts[i].dts == i * 1001 );
+        mu_assert( ts[i].pts == (pocs[i] + 1) * 1001 );
+        ASSERT_EQUAL( ts[i].poc, pocs[i] );
+    }
+    ASSERT_EQUAL( ts[0].nalu_type, HEVC_NAL_IDR_W_RADL );
+
+    // an SPS without timing at the next IDR: the pictures before go out, the
+    // default 1/50 s applies and the reorder 2 delays the PTS one more
+    nalu.nalu_type = HEVC_NAL_SPS;
+    nalu.size = write_sps_no_vui( buf, sizeof(buf) );
+    hevc_pts_push( g, &nalu );
+    hevc_pts_set_frame_rate( g, 1, 50 );
+    nalu.nalu_type = HEVC_NAL_IDR_N_LP;
+    for ( i = 7; i < 9; i++ ) {
+        nalu.size = write_pts_slice( buf, sizeof(buf), nalu.nalu_type, 0 );
+        ASSERT_EQUAL( hevc_pts_push( g, &nalu ), 1 );
+    }
+    mu_assert( ts[5].pts == 7 * 1001 && ts[6].pts == 6 * 1001 && ts[6].dts == 6 * 1001 );
+    mu_assert( ts[7].dts == 7 * 1001 && ts[7].pts == 7 * 1001 + 2 * 1200 );
+    mu_assert( !ts[8].index );
+    hevc_pts_flush( g );
+    mu_assert( ts[8].dts == 7 * 1001 + 1200 && ts[8].pts == 7 * 1001 + 3 * 1200 );
+    mu_assert( !ts[9].index );
+
+    // a slice without its parameter sets gets no index
+    hevc_pts_free( g );
+    g = hevc_pts_new( 0, on_timestamp, ts );
+    ASSERT_EQUAL( hevc_pts_push( g, &list.nalu[4] ), -1 );
+    hevc_pts_free( g );
+    hevc_nalu_list_free( &list );
     return NULL;
 }
 
 static char *all_tests()
 {
     RUN_TEST_CASE( test_hevc_parse_config );
+    RUN_TEST_CASE( test_bs_read );
+    RUN_TEST_CASE( test_bs_read_tail );
+    RUN_TEST_CASE( test_bs_read_nal );
+    RUN_TEST_CASE( test_bw_write );
+    RUN_TEST_CASE( test_hevc_rewrite_sps );
+    RUN_TEST_CASE( test_hevc_get_config );
+    RUN_TEST_CASE( test_hevc_config_write );
+    RUN_TEST_CASE( test_startcode_impls );
+    RUN_TEST_CASE( test_epb_impls );
+    RUN_TEST_CASE( test_hevc_splitter );
+    RUN_TEST_CASE( test_hevc_nalu_list );
+    RUN_TEST_CASE( test_hevc_convert );
+    RUN_TEST_CASE( test_hevc_slice_header );
+    RUN_TEST_CASE( test_hevc_ps_cache );
+    RUN_TEST_CASE( test_hevc_au_boundary );
+    RUN_TEST_CASE( test_hevc_rtp_depack );
+    RUN_TEST_CASE( test_hevc_rtp_pack );
+    RUN_TEST_CASE( test_hevc_ts_demux );
+    RUN_TEST_CASE( test_hevc_fmp4 );
+    RUN_TEST_CASE( test_hevc_gop_ring );
+    RUN_TEST_CASE( test_hevc_poc );
+    RUN_TEST_CASE( test_hevc_index );
+    RUN_TEST_CASE( test_hevc_file_source );
+    RUN_TEST_CASE( test_hevc_parse_mt );
+    RUN_TEST_CASE( test_hevc_engine );
+    RUN_TEST_CASE( test_hevc_sublayer );
+    RUN_TEST_CASE( test_hevc_psfilter );
+    RUN_TEST_CASE( test_hevc_sei );
+    RUN_TEST_CASE( test_hevc_sei_picture_hash );
+    RUN_TEST_CASE( test_hevc_pts );
 
     return NULL;
 }
 
 int main()
 {
-    HEVCDecoderConfigurationRecord config;
-    char *res = AllTests();
-
-    dump_hevc_config( &config );
+    char *res = all_tests();
 
     if ( res ) {
         printf("%s\n", res );
+        return 1;
     } else {
         printf("[ AdtsDecodeTest ] test pass\n");
     }
     return 0;
 }
-